@@ -0,0 +1,161 @@
+/*
+ * Serial Wire Debug Open Library.
+ * Bit pack/unpack kernels benchmark.
+ *
+ * Copyright (C) 2010-2013, Tomasz Boleslaw CEDRO (http://www.tomek.cedro.info)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the Tomasz Boleslaw CEDRO nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.*
+ *
+ * Written by Tomasz Boleslaw CEDRO <cederom@tlen.pl>, 2010-2013;
+ *
+ */
+
+/** \file libswd_bench_bitpack.c Bit pack/unpack kernels benchmark.
+ * Compares per-transfer CPU cost of converting 64KB transfer between
+ * bit-per-char and packed form with bit-at-a-time loops (before, as used by
+ * libswdapp_interface_ftdi_transfer_bits()) and libswd_bin_pack() /
+ * libswd_bin_unpack() kernels (after).
+ * Build with: make libswd_bench_bitpack
+ * or: cc -O2 libswd_bench_bitpack.c -lswd -o libswd_bench_bitpack
+ */
+
+#include <libswd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Transfer size in packed bytes. */
+#define LIBSWD_BENCH_BYTES 65536
+#define LIBSWD_BENCH_BITS  (LIBSWD_BENCH_BYTES*8)
+
+/* Interface driver is not used here. */
+int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst){ return bits; }
+int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst){ return bits; }
+int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst){ *data=0; return bits; }
+int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst){ *data=0; return bits; }
+int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits){ return bits; }
+int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits){ return bits; }
+int libswd_log(libswd_ctx_t *libswdctx, libswd_loglevel_t loglevel, char *msg, ...){ return LIBSWD_OK; }
+int libswd_log_level_inherit(libswd_ctx_t *libswdctx, int loglevel){ return LIBSWD_OK; }
+
+static double libswd_bench_now(void){
+ return (double)clock()/CLOCKS_PER_SEC;
+}
+
+/* Bit-at-a-time reference, same loops as the FTDI transfer used before. */
+static void libswd_bench_pack_ref(unsigned char *packed, char *bits, int count){
+ int byte, i;
+ unsigned char databuf;
+ for (byte=0;byte*8<count;byte++){
+  databuf=0;
+  for (i=0;i<8;i++) databuf|=bits[byte*8+i]?(1<<i):0;
+  packed[byte]=databuf;
+ }
+}
+
+static void libswd_bench_unpack_ref(char *bits, unsigned char *packed, int count){
+ int byte, bit;
+ for (byte=0;byte*8<count;byte++)
+  for (bit=0;bit<8;bit++)
+   bits[byte*8+bit]=packed[byte]&(1<<bit)?1:0;
+}
+
+int main(int argc, char **argv){
+ int i, count=(argc>1)?atoi(argv[1]):200;
+ unsigned char *packed, *packedref;
+ char *bits, *bitsout, *bitsref;
+ double t, packbefore, packafter, unpackbefore, unpackafter;
+ unsigned int sum=0;
+
+ if (count<1) count=1;
+ packed=(unsigned char*)malloc(LIBSWD_BENCH_BYTES);
+ packedref=(unsigned char*)malloc(LIBSWD_BENCH_BYTES);
+ bits=(char*)malloc(LIBSWD_BENCH_BITS);
+ bitsout=(char*)malloc(LIBSWD_BENCH_BITS);
+ bitsref=(char*)malloc(LIBSWD_BENCH_BITS);
+ if (!packed || !packedref || !bits || !bitsout || !bitsref) return EXIT_FAILURE;
+
+ // Any nonzero char is a logic one, so use a few different values.
+ srand(1);
+ for (i=0;i<LIBSWD_BENCH_BITS;i++) bits[i]=(rand()&1)?(char)(1+(rand()&0x7f)):0;
+
+ // Kernels must match the reference for whole bytes of any length.
+ for (i=0;i<=LIBSWD_BENCH_BITS;i+=(i<512)?8:4096+8){
+  libswd_bench_pack_ref(packedref, bits, i);
+  libswd_bin_pack(packed, bits, i);
+  if (memcmp(packed, packedref, i/8)){
+   printf("libswd_bin_pack() mismatch at %d bits!\n", i);
+   return EXIT_FAILURE;
+  }
+  libswd_bench_unpack_ref(bitsref, packedref, i);
+  libswd_bin_unpack(bitsout, packedref, i);
+  if (memcmp(bitsout, bitsref, i)){
+   printf("libswd_bin_unpack() mismatch at %d bits!\n", i);
+   return EXIT_FAILURE;
+  }
+ }
+
+ t=libswd_bench_now();
+ for (i=0;i<count;i++){
+  libswd_bench_pack_ref(packedref, bits, LIBSWD_BENCH_BITS);
+  sum+=packedref[i&(LIBSWD_BENCH_BYTES-1)];
+ }
+ packbefore=libswd_bench_now()-t;
+
+ t=libswd_bench_now();
+ for (i=0;i<count;i++){
+  libswd_bin_pack(packed, bits, LIBSWD_BENCH_BITS);
+  sum+=packed[i&(LIBSWD_BENCH_BYTES-1)];
+ }
+ packafter=libswd_bench_now()-t;
+
+ t=libswd_bench_now();
+ for (i=0;i<count;i++){
+  libswd_bench_unpack_ref(bitsref, packed, LIBSWD_BENCH_BITS);
+  sum+=bitsref[i];
+ }
+ unpackbefore=libswd_bench_now()-t;
+
+ t=libswd_bench_now();
+ for (i=0;i<count;i++){
+  libswd_bin_unpack(bitsout, packed, LIBSWD_BENCH_BITS);
+  sum+=bitsout[i];
+ }
+ unpackafter=libswd_bench_now()-t;
+
+ printf("64KB transfers converted: %d (checksum 0x%08X)\n", count, sum);
+ printf(" pack   bit-at-a-time      : %8.2f us/transfer\n", packbefore*1e6/count);
+ printf(" pack   libswd_bin_pack()  : %8.2f us/transfer (%.1fx)\n", packafter*1e6/count, (packafter>0)?packbefore/packafter:0);
+ printf(" unpack bit-at-a-time      : %8.2f us/transfer\n", unpackbefore*1e6/count);
+ printf(" unpack libswd_bin_unpack(): %8.2f us/transfer (%.1fx)\n", unpackafter*1e6/count, (unpackafter>0)?unpackbefore/unpackafter:0);
+
+ free(packed);
+ free(packedref);
+ free(bits);
+ free(bitsout);
+ free(bitsref);
+ return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+/*
+ * Serial Wire Debug Open Library.
+ * Request header generation benchmark.
+ *
+ * Copyright (C) 2010-2013, Tomasz Boleslaw CEDRO (http://www.tomek.cedro.info)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the Tomasz Boleslaw CEDRO nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.*
+ *
+ * Written by Tomasz Boleslaw CEDRO <cederom@tlen.pl>, 2010-2013;
+ *
+ */
+
+/** \file libswd_bench_request.c Request header generation benchmark.
+ * Compares per-transfer CPU cost of building Request header with
+ * libswd_bitgen8_request() (before) and LIBSWD_REQUEST_HEADER table (after).
+ * Build with: make libswd_bench_request
+ * or: cc -O2 libswd_bench_request.c -lswd -o libswd_bench_request
+ */
+
+#include <libswd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Interface driver is not used here, bus functions only count the bits. */
+int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst){
+ (void)libswdctx; (void)cmd; (void)data; (void)nLSBfirst;
+ return bits;
+}
+int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst){
+ (void)libswdctx; (void)cmd; (void)data; (void)nLSBfirst;
+ return bits;
+}
+int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst){
+ (void)libswdctx; (void)cmd; (void)nLSBfirst;
+ *data=0;
+ return bits;
+}
+int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst){
+ (void)libswdctx; (void)cmd; (void)nLSBfirst;
+ *data=0;
+ return bits;
+}
+int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits){
+ (void)libswdctx;
+ return bits;
+}
+int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits){
+ (void)libswdctx;
+ return bits;
+}
+int libswd_log(libswd_ctx_t *libswdctx, libswd_loglevel_t loglevel, char *msg, ...){
+ (void)libswdctx; (void)loglevel; (void)msg;
+ return LIBSWD_OK;
+}
+int libswd_log_level_inherit(libswd_ctx_t *libswdctx, int loglevel){
+ (void)libswdctx; (void)loglevel;
+ return LIBSWD_OK;
+}
+
+static double libswd_bench_now(void){
+ return (double)clock()/CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv){
+ int i, res, count=(argc>1)?atoi(argv[1]):10000000;
+ char APnDP, RnW, addr, request, sum=0;
+ double t, before, after;
+ libswd_ctx_t *libswdctx;
+
+ if (count<1) count=1;
+ libswdctx=libswd_init();
+ if (libswdctx==NULL) return EXIT_FAILURE;
+
+ // Table must match the generator for every APnDP, RnW and A[3:2].
+ for (i=0;i<16;i++){
+  APnDP=i&1;
+  RnW=(i>>1)&1;
+  addr=(i>>2)<<2;
+  res=libswd_bitgen8_request(libswdctx, &APnDP, &RnW, &addr, &request);
+  if (res<0 || request!=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(APnDP, RnW, addr)]){
+   printf("Request header table mismatch at index %d!\n", i);
+   return EXIT_FAILURE;
+  }
+ }
+
+ t=libswd_bench_now();
+ for (i=0;i<count;i++){
+  APnDP=i&1;
+  RnW=(i>>1)&1;
+  addr=i&0x0C;
+  libswd_bitgen8_request(libswdctx, &APnDP, &RnW, &addr, &request);
+  sum+=request;
+ }
+ before=libswd_bench_now()-t;
+
+ t=libswd_bench_now();
+ for (i=0;i<count;i++){
+  request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(i&1, (i>>1)&1, i&0x0C)];
+  sum+=request;
+ }
+ after=libswd_bench_now()-t;
+
+ printf("Request headers generated: %d (checksum 0x%02X)\n", count, (unsigned char)sum);
+ printf(" libswd_bitgen8_request(): %8.2f ns/transfer\n", before*1e9/count);
+ printf(" LIBSWD_REQUEST_HEADER[] : %8.2f ns/transfer\n", after*1e9/count);
+
+ libswd_deinit(libswdctx);
+ return EXIT_SUCCESS;
+}
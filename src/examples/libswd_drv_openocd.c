@@ -57,9 +57,9 @@ int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[8], mosidata[8];
+ unsigned int i;
+ signed int res;
+ char misodata[8], mosidata[8]={0};
 
  /* Split output data into char array. */
  for (i=0;i<8;i++) mosidata[(nLSBfirst==LIBSWD_DIR_LSBFIRST)?(i):(bits-1-i)]=((1<<i)&(*data))?1:0; 
@@ -86,9 +86,9 @@ int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[32], mosidata[32];
+ unsigned int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
 
  //UrJTAG drivers shift data LSB-First.
  for (i=0;i<32;i++) mosidata[(nLSBfirst==LIBSWD_DIR_LSBFIRST)?(i):(bits-1-i)]=((1<<i)&(*data))?1:0; 
@@ -112,9 +112,9 @@ int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static int i;
- static signed int res;
- static char misodata[8], mosidata[8];
+ int i;
+ signed int res;
+ char misodata[8], mosidata[8]={0};
 
  res=jtag_interface->transfer(NULL, bits, mosidata, misodata, LIBSWD_DIR_LSBFIRST);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -140,9 +140,9 @@ int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static int i;
- static signed int res;
- static char misodata[32], mosidata[32];
+ int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
 
  res=jtag_interface->transfer(NULL, bits, mosidata, misodata, LIBSWD_DIR_LSBFIRST);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -154,6 +154,56 @@ int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  return i;
 }       
 
+/**
+ * Use OpenOCD's driver to write packed bits, see libswd_driver_t mosi_packed().
+ * Bit n is the bit (n%8) of byte (n/8) and it is shifted n-th (LSB-first).
+ * OpenOCD transfer() shifts one bit per char, so bits are converted once here.
+ * Set libswdctx->driver->mosi_packed to this function to use it.
+ * \param *libswdctx swd context to work on.
+ * \param *cmd point to the actual command being sent.
+ * \param *data points to the packed data.
+ * \param bits tells how many bits to send (at most 32).
+ * \return data count transferred, or negative LIBSWD_ERROR code on failure.
+ */
+int libswd_drv_openocd_mosi_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits){
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
+
+ int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
+
+ for (i=0;i<bits;i++) mosidata[i]=(data[i>>3]>>(i&7))&1;
+ res=jtag_interface->transfer(NULL, bits, mosidata, misodata, LIBSWD_DIR_LSBFIRST);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ return bits;
+}
+
+/**
+ * Use OpenOCD's driver to read packed bits, see libswd_driver_t miso_packed().
+ * Bit n is the bit (n%8) of byte (n/8) and it is shifted n-th (LSB-first).
+ * Set libswdctx->driver->miso_packed to this function to use it.
+ * \param *libswdctx swd context to work on.
+ * \param *cmd point to the actual command being sent.
+ * \param *data points to the packed data buffer.
+ * \param bits tells how many bits to receive (at most 32).
+ * \return data count transferred, or negative LIBSWD_ERROR code on failure.
+ */
+int libswd_drv_openocd_miso_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits){
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
+
+ int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
+
+ res=jtag_interface->transfer(NULL, bits, mosidata, misodata, LIBSWD_DIR_LSBFIRST);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ for (i=0;i<(bits+7)/8;i++) data[i]=0;
+ for (i=0;i<bits;i++) if (misodata[i]) data[i>>3]|=1<<(i&7);
+ return bits;
+}
+
 /**
  * This function sets interface buffers to MOSI direction.
  * MOSI (Master Output Slave Input) is a SWD Write operation.
@@ -169,7 +219,7 @@ int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits){
   return LIBSWD_ERROR_TURNAROUND; 
 
  int res, val=0;
- static char buf[LIBSWD_TURNROUND_MAX_VAL];
+ char buf[LIBSWD_TURNROUND_MAX_VAL]={0};
  /* Use driver method to set low (write) signal named RnW. */
  res=jtag_interface->bitbang(NULL, "RnW", 0, &val);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -195,8 +245,8 @@ int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits){
  if (bits<LIBSWD_TURNROUND_MIN_VAL && bits>LIBSWD_TURNROUND_MAX_VAL)
   return LIBSWD_ERROR_TURNAROUND; 
 
- static int res, val=1;
- static char buf[LIBSWD_TURNROUND_MAX_VAL];
+ int res, val=1;
+ char buf[LIBSWD_TURNROUND_MAX_VAL]={0};
 
  /* Use driver method to set high (read) signal named RnW. */
  res=jtag_interface->bitbang(NULL, "RnW", 0xFFFFFFFF, &val);
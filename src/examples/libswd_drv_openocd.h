@@ -42,6 +42,8 @@ int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
 int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
 int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
 int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
+int libswd_drv_openocd_mosi_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits);
+int libswd_drv_openocd_miso_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits);
 int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits);
 int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits);
 int libswd_log_level_inherit(libswd_ctx_t *libswdctx, int loglevel);
@@ -53,9 +53,9 @@ int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[8], mosidata[8];
+ unsigned int i;
+ signed int res;
+ char misodata[8], mosidata[8]={0};
 
  //UrJTAG drivers shift data LSB-First.
  for (i=0;i<8;i++) mosidata[(nLSBfirst==LIBSWD_DIR_LSBFIRST)?(i):(7-i)]=((1<<i)&(*data))?1:0; 
@@ -80,9 +80,9 @@ int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[32], mosidata[32];
+ unsigned int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
 
  //UrJTAG drivers shift data LSB-First.
  for (i=0;i<32;i++) mosidata[(nLSBfirst==LIBSWD_DIR_LSBFIRST)?(i):(31-i)]=((1<<i)&(*data))?1:0; 
@@ -107,9 +107,9 @@ int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[8], mosidata[8];
+ unsigned int i;
+ signed int res;
+ char misodata[8], mosidata[8]={0};
 
  res=urj_tap_cable_transfer((urj_cable_t *)libswdctx->driver->device, bits, mosidata, misodata);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -135,9 +135,9 @@ int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  if (bits<0 && bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[32], mosidata[32];
+ unsigned int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
 
  res=urj_tap_cable_transfer((urj_cable_t *)libswdctx->driver->device, bits, mosidata, misodata);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -148,6 +148,58 @@ int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  return i;
 }       
 
+/**
+ * Use UrJTAG's driver to write packed bits, see libswd_driver_t mosi_packed().
+ * Bit n is the bit (n%8) of byte (n/8) and it is shifted n-th (LSB-first).
+ * UrJTAG cable API shifts one bit per char, so bits are converted once here.
+ * Set libswdctx->driver->mosi_packed to this function to use it.
+ * \param *libswdctx swd context to work on.
+ * \param *cmd point to the actual command being sent.
+ * \param *data points to the packed data.
+ * \param bits tells how many bits to send (at most 32).
+ * \return data count transferred, or negative LIBSWD_ERROR code on failure.
+ */
+int libswd_drv_urjtag_mosi_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits){
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
+
+ int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
+
+ for (i=0;i<bits;i++) mosidata[i]=(data[i>>3]>>(i&7))&1;
+ res=urj_tap_cable_transfer((urj_cable_t *)libswdctx->driver->device, bits, mosidata, misodata);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ urj_tap_cable_flush((urj_cable_t *)libswdctx->driver->device, URJ_TAP_CABLE_COMPLETELY);
+ return bits;
+}
+
+/**
+ * Use UrJTAG's driver to read packed bits, see libswd_driver_t miso_packed().
+ * Bit n is the bit (n%8) of byte (n/8) and it is shifted n-th (LSB-first).
+ * Set libswdctx->driver->miso_packed to this function to use it.
+ * \param *libswdctx swd context to work on.
+ * \param *cmd point to the actual command being sent.
+ * \param *data points to the packed data buffer.
+ * \param bits tells how many bits to receive (at most 32).
+ * \return data count transferred, or negative LIBSWD_ERROR code on failure.
+ */
+int libswd_drv_urjtag_miso_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits){
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
+
+ int i;
+ signed int res;
+ char misodata[32], mosidata[32]={0};
+
+ res=urj_tap_cable_transfer((urj_cable_t *)libswdctx->driver->device, bits, mosidata, misodata);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ urj_tap_cable_flush((urj_cable_t *)libswdctx->driver->device, URJ_TAP_CABLE_COMPLETELY);
+ for (i=0;i<(bits+7)/8;i++) data[i]=0;
+ for (i=0;i<bits;i++) if (misodata[i]) data[i>>3]|=1<<(i&7);
+ return bits;
+}
+
 /**
  * This function sets interface buffers to MOSI direction.
  * MOSI (Master Output Slave Input) is a SWD Write operation.
@@ -179,7 +231,7 @@ int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits){
  if (bits<LIBSWD_TURNROUND_MIN_VAL && bits>LIBSWD_TURNROUND_MAX_VAL)
   return LIBSWD_ERROR_TURNAROUND; 
 
- static int res;
+ int res;
 
  res=urj_tap_cable_set_signal((urj_cable_t *)libswdctx->driver->device, URJ_POD_CS_RnW, URJ_POD_CS_RnW); 
  if (res<0) return LIBSWD_ERROR_DRIVER;
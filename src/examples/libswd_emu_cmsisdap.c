@@ -0,0 +1,552 @@
+/*
+ * Serial Wire Debug Open Library.
+ * Emulated CMSIS-DAP style probe with transaction-level driver.
+ *
+ * Copyright (C) 2010-2013, Tomasz Boleslaw CEDRO (http://www.tomek.cedro.info)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the Tomasz Boleslaw CEDRO nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.*
+ *
+ * Written by Tomasz Boleslaw CEDRO <cederom@tlen.pl>, 2010-2013;
+ *
+ */
+
+/** \file libswd_emu_cmsisdap.c Emulated CMSIS-DAP style probe.
+ * Probe firmware with hardware SWD engine is emulated in-process on top of
+ * a bit-level SW-DP and MEM-AP target model. The same target is accessed
+ * with a bit-level driver (every shift is a probe round trip) and with the
+ * transaction-level driver (transfer() and transfer_block() entry points),
+ * memory contents and probe round trips are then compared.
+ * Retry loop semantics (attempt limit, time budget, exponential backoff cap,
+ * expiry flag) are checked on the same context setup.
+ * With threads argument given both drivers are also run at the same time,
+ * each thread with its own context, probe and target, to check that no
+ * state is shared between contexts.
+ * Usage: libswd_emu_cmsisdap [words [threads]]
+ * Build with: make libswd_emu_cmsisdap
+ * or: cc -O2 libswd_emu_cmsisdap.c -lswd -lpthread -o libswd_emu_cmsisdap
+ */
+
+#include <libswd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/** Emulated target RAM size in words, at LIBSWD_EMU_MEMBASE. */
+#define LIBSWD_EMU_MEMWORDS 1024
+#define LIBSWD_EMU_MEMBASE  0x20000000
+/** Consecutive SWDIO high cycles that make a line reset. */
+#define LIBSWD_EMU_LINERESET 50
+
+/** SW-DP line state of the emulated target. */
+typedef enum {
+ LIBSWD_EMU_IDLE,
+ LIBSWD_EMU_REQUEST,
+ LIBSWD_EMU_TRN,
+ LIBSWD_EMU_ACK,
+ LIBSWD_EMU_RDATA,
+ LIBSWD_EMU_RTRN,
+ LIBSWD_EMU_WTRN,
+ LIBSWD_EMU_WDATA
+} libswd_emu_state_t;
+
+/** Emulated target, SW-DP with a single MEM-AP, clocked bit by bit. */
+typedef struct {
+ libswd_emu_state_t state;
+ int bitcnt, ones;
+ unsigned int request, ack, rdata, wdata;
+ unsigned int ctrlstat, select, rdbuff, csw, tar;
+ unsigned int clocks;
+ unsigned int mem[LIBSWD_EMU_MEMWORDS];
+} libswd_emu_target_t;
+
+/** Emulated probe, keeps its target and USB round trip counter. */
+typedef struct {
+ libswd_emu_target_t *target;
+ int roundtrips;
+} libswd_emu_probe_t;
+
+/** One concurrent run, every thread owns its target. */
+typedef struct {
+ pthread_t thread;
+ char name[32];
+ libswd_emu_target_t target;
+ int transaction, count, seed, res;
+} libswd_emu_thread_t;
+
+int libswd_log(libswd_ctx_t *libswdctx, libswd_loglevel_t loglevel, char *msg, ...){
+ int res;
+ va_list ap;
+ va_start(ap, msg);
+ res=libswd_log_internal_va(libswdctx, loglevel, msg, ap);
+ va_end(ap);
+ return res;
+}
+int libswd_log_level_inherit(libswd_ctx_t *libswdctx, int loglevel){ return LIBSWD_OK; }
+
+static unsigned int *libswd_emu_mem(libswd_emu_target_t *target){
+ return &target->mem[((target->tar-LIBSWD_EMU_MEMBASE)>>2)%LIBSWD_EMU_MEMWORDS];
+}
+
+static unsigned int libswd_emu_ap_read(libswd_emu_target_t *target, int addr){
+ unsigned int data;
+ switch (addr){
+  case LIBSWD_MEMAP_CSW_ADDR: return target->csw;
+  case LIBSWD_MEMAP_TAR_ADDR: return target->tar;
+  case LIBSWD_MEMAP_DRW_ADDR:
+   data=*libswd_emu_mem(target);
+   if (target->csw&LIBSWD_MEMAP_CSW_ADDRINC) target->tar+=4;
+   return data;
+  case LIBSWD_MEMAP_BASE_ADDR: return 0xE00FF003;
+  case LIBSWD_MEMAP_IDR_ADDR: return 0x24770011;
+ }
+ return 0;
+}
+
+static void libswd_emu_ap_write(libswd_emu_target_t *target, int addr, unsigned int data){
+ switch (addr){
+  case LIBSWD_MEMAP_CSW_ADDR: target->csw=data; break;
+  case LIBSWD_MEMAP_TAR_ADDR: target->tar=data; break;
+  case LIBSWD_MEMAP_DRW_ADDR:
+   *libswd_emu_mem(target)=data;
+   if (target->csw&LIBSWD_MEMAP_CSW_ADDRINC) target->tar+=4;
+   break;
+ }
+}
+
+/** Clock the target once.
+ * \param *target emulated target.
+ * \param swdio line state driven by the probe (ignored when target drives it).
+ * \return line state driven by the target.
+ */
+static int libswd_emu_clock(libswd_emu_target_t *target, int swdio){
+ int apndp, rnw, addr, out=0;
+ char parity;
+
+ target->clocks++;
+ if (swdio && (target->state==LIBSWD_EMU_IDLE || target->state==LIBSWD_EMU_REQUEST || target->state==LIBSWD_EMU_WDATA)){
+  if (++target->ones>=LIBSWD_EMU_LINERESET){
+   target->state=LIBSWD_EMU_IDLE;
+   return 0;
+  }
+ } else if (!swdio) target->ones=0;
+
+ apndp=(target->request>>1)&1;
+ rnw=(target->request>>2)&1;
+ addr=((target->request>>3)&3)<<2;
+ switch (target->state){
+  case LIBSWD_EMU_IDLE:
+   // Start bit.
+   if (swdio){
+    target->request=1;
+    target->bitcnt=1;
+    target->state=LIBSWD_EMU_REQUEST;
+   }
+   break;
+  case LIBSWD_EMU_REQUEST:
+   target->request|=(swdio&1)<<target->bitcnt;
+   if (++target->bitcnt<LIBSWD_REQUEST_BITLEN) break;
+   // Stop, Park and Parity must be valid, otherwise it is not a Request.
+   if (LIBSWD_REQUEST_HEADER[(target->request>>1)&0x0F]!=(char)target->request){
+    target->state=LIBSWD_EMU_IDLE;
+    break;
+   }
+   target->state=LIBSWD_EMU_TRN;
+   break;
+  case LIBSWD_EMU_TRN:
+   target->ack=LIBSWD_ACK_OK_VAL;
+   if (rnw){
+    if (apndp){
+     // AP reads are posted, data of the previous read is returned.
+     target->rdata=target->rdbuff;
+     target->rdbuff=libswd_emu_ap_read(target, (target->select&LIBSWD_DP_SELECT_APBANKSEL)|addr);
+    } else switch (addr){
+     case LIBSWD_DP_IDCODE_ADDR: target->rdata=0x2BA01477; break;
+     case LIBSWD_DP_CTRLSTAT_ADDR:
+      // Power-up requests are acknowledged at once.
+      target->rdata=target->ctrlstat|((target->ctrlstat&(LIBSWD_DP_CTRLSTAT_CDBGPWRUPREQ|LIBSWD_DP_CTRLSTAT_CSYSPWRUPREQ))<<1);
+      break;
+     case LIBSWD_DP_RDBUFF_ADDR: target->rdata=target->rdbuff; break;
+     default: target->rdata=0;
+    }
+   }
+   target->bitcnt=0;
+   target->state=LIBSWD_EMU_ACK;
+   break;
+  case LIBSWD_EMU_ACK:
+   out=(target->ack>>target->bitcnt)&1;
+   if (++target->bitcnt<LIBSWD_ACK_BITLEN) break;
+   target->bitcnt=0;
+   target->state=rnw?LIBSWD_EMU_RDATA:LIBSWD_EMU_WTRN;
+   break;
+  case LIBSWD_EMU_RDATA:
+   if (target->bitcnt<LIBSWD_DATA_BITLEN){
+    out=(target->rdata>>target->bitcnt)&1;
+   } else {
+    libswd_bin32_parity_even((int*)&target->rdata, &parity);
+    out=parity;
+   }
+   if (++target->bitcnt>LIBSWD_DATA_BITLEN) target->state=LIBSWD_EMU_RTRN;
+   break;
+  case LIBSWD_EMU_RTRN:
+   target->state=LIBSWD_EMU_IDLE;
+   break;
+  case LIBSWD_EMU_WTRN:
+   target->wdata=0;
+   target->bitcnt=0;
+   target->state=LIBSWD_EMU_WDATA;
+   break;
+  case LIBSWD_EMU_WDATA:
+   if (target->bitcnt<LIBSWD_DATA_BITLEN) target->wdata|=(unsigned int)(swdio&1)<<target->bitcnt;
+   if (++target->bitcnt<=LIBSWD_DATA_BITLEN) break;
+   if (apndp){
+    libswd_emu_ap_write(target, (target->select&LIBSWD_DP_SELECT_APBANKSEL)|addr, target->wdata);
+   } else if (addr==LIBSWD_DP_CTRLSTAT_ADDR){
+    target->ctrlstat=target->wdata;
+   } else if (addr==LIBSWD_DP_SELECT_ADDR) target->select=target->wdata;
+   target->state=LIBSWD_EMU_IDLE;
+   break;
+ }
+ return out;
+}
+
+/* Bit-level driver, every entry point call is a probe round trip. */
+
+static int libswd_emu_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ int i;
+ probe->roundtrips++;
+ for (i=0;i<bits;i++)
+  libswd_emu_clock(probe->target, (*data>>((nLSBfirst==LIBSWD_DIR_LSBFIRST)?i:bits-1-i))&1);
+ return bits;
+}
+
+static int libswd_emu_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ int i;
+ probe->roundtrips++;
+ for (i=0;i<bits;i++)
+  libswd_emu_clock(probe->target, (*data>>((nLSBfirst==LIBSWD_DIR_LSBFIRST)?i:bits-1-i))&1);
+ return bits;
+}
+
+static int libswd_emu_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ int i;
+ probe->roundtrips++;
+ *data=0;
+ for (i=0;i<bits;i++)
+  if (libswd_emu_clock(probe->target, 0))
+   *data|=1<<((nLSBfirst==LIBSWD_DIR_LSBFIRST)?i:bits-1-i);
+ return bits;
+}
+
+static int libswd_emu_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ int i;
+ probe->roundtrips++;
+ *data=0;
+ for (i=0;i<bits;i++)
+  if (libswd_emu_clock(probe->target, 0))
+   *data|=1<<((nLSBfirst==LIBSWD_DIR_LSBFIRST)?i:bits-1-i);
+ return bits;
+}
+
+static int libswd_emu_trn(libswd_ctx_t *libswdctx, int bits){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ int i;
+ probe->roundtrips++;
+ for (i=0;i<bits;i++) libswd_emu_clock(probe->target, 0);
+ return bits;
+}
+
+/* Probe firmware SWD engine, as in CMSIS-DAP DAP_Transfer. */
+
+/** Execute one SWD transaction on the emulated target.
+ * \return LIBSWD_OK, or LIBSWD_ERROR_PARITY on read data parity mismatch.
+ */
+static int libswd_emu_swd_transfer(libswd_emu_target_t *target, char request, int *data, char *ack){
+ int i, rdata=0;
+ char parity, rparity;
+
+ for (i=0;i<LIBSWD_REQUEST_BITLEN;i++) libswd_emu_clock(target, (request>>i)&1);
+ libswd_emu_clock(target, 0);
+ *ack=0;
+ for (i=0;i<LIBSWD_ACK_BITLEN;i++) *ack|=libswd_emu_clock(target, 0)<<i;
+ if (*ack!=LIBSWD_ACK_OK_VAL){
+  libswd_emu_clock(target, 0);
+  return LIBSWD_OK;
+ }
+ if (request&LIBSWD_REQUEST_RnW){
+  for (i=0;i<LIBSWD_DATA_BITLEN;i++) rdata|=libswd_emu_clock(target, 0)<<i;
+  rparity=libswd_emu_clock(target, 0);
+  libswd_emu_clock(target, 0);
+  *data=rdata;
+  libswd_bin32_parity_even(&rdata, &parity);
+  if (parity!=rparity) return LIBSWD_ERROR_PARITY;
+ } else {
+  libswd_emu_clock(target, 0);
+  for (i=0;i<LIBSWD_DATA_BITLEN;i++) libswd_emu_clock(target, (*data>>i)&1);
+  libswd_bin32_parity_even(data, &parity);
+  libswd_emu_clock(target, parity);
+ }
+ return LIBSWD_OK;
+}
+
+static int libswd_emu_transfer(libswd_ctx_t *libswdctx, char request, int *data, char *ack){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ probe->roundtrips++;
+ return libswd_emu_swd_transfer(probe->target, request, data, ack);
+}
+
+static int libswd_emu_transfer_block(libswd_ctx_t *libswdctx, char request, int *data, int count, char *ack){
+ libswd_emu_probe_t *probe=(libswd_emu_probe_t*)libswdctx->driver->ctx;
+ int i, res;
+ probe->roundtrips++;
+ for (i=0;i<count;i++){
+  res=libswd_emu_swd_transfer(probe->target, request, &data[i], ack);
+  if (res==LIBSWD_ERROR_PARITY || *ack!=LIBSWD_ACK_OK_VAL) break;
+ }
+ return i;
+}
+
+/** Write count words to target RAM then read them back through one context
+ * using given probe driver, each direction is flushed as a single queue.
+ * \param seed makes data pattern unique for each concurrent run.
+ * \return number of words that do not match, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_emu_run(const char *name, libswd_emu_target_t *target, int transaction, int count, int seed){
+ libswd_ctx_t *libswdctx;
+ libswd_driver_t driver;
+ libswd_emu_probe_t probe;
+ int i, res, bad=0, csw, tar, *idcode, *wdata, *rdata;
+ unsigned int clocks;
+ char request;
+
+ memset(target, 0, sizeof(libswd_emu_target_t));
+ memset(&probe, 0, sizeof(probe));
+ probe.target=target;
+ memset(&driver, 0, sizeof(driver));
+ driver.ctx=&probe;
+ driver.mosi_8=libswd_emu_mosi_8;
+ driver.mosi_32=libswd_emu_mosi_32;
+ driver.miso_8=libswd_emu_miso_8;
+ driver.miso_32=libswd_emu_miso_32;
+ driver.mosi_trn=libswd_emu_trn;
+ driver.miso_trn=libswd_emu_trn;
+ if (transaction){
+  driver.transfer=libswd_emu_transfer;
+  driver.transfer_block=libswd_emu_transfer_block;
+ }
+
+ wdata=(int*)calloc(count, sizeof(int));
+ rdata=(int*)calloc(count+1, sizeof(int));
+ libswdctx=libswd_init();
+ if (!wdata || !rdata || !libswdctx) return LIBSWD_ERROR_OUTOFMEM;
+ libswd_log_level_set(libswdctx, LIBSWD_LOGLEVEL_ERROR);
+ res=libswd_drv_register(libswdctx, &driver);
+ if (res<0) return res;
+
+ res=libswd_dap_init(libswdctx, LIBSWD_OPERATION_EXECUTE, &idcode);
+ if (res<0) return res;
+ res=libswd_memap_init(libswdctx, LIBSWD_OPERATION_EXECUTE);
+ if (res<0) return res;
+ csw=libswdctx->log.memap.csw|LIBSWD_MEMAP_CSW_ADDRINC_SINGLE;
+ res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_CSW_ADDR, &csw);
+ if (res<0) return res;
+ probe.roundtrips=0;
+ clocks=target->clocks;
+
+ for (i=0;i<count;i++) wdata[i]=i*0x01010101^0x5EED1234^seed;
+ tar=LIBSWD_EMU_MEMBASE;
+ res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_ENQUEUE, LIBSWD_MEMAP_TAR_ADDR, &tar);
+ if (res<0) return res;
+ for (i=0;i<count;i++){
+  res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_ENQUEUE, LIBSWD_MEMAP_DRW_ADDR, &wdata[i]);
+  if (res<0) return res;
+ }
+ res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, LIBSWD_OPERATION_EXECUTE);
+ if (res<0) return res;
+
+ // AP reads are posted, so every read returns the previous word.
+ res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_ENQUEUE, LIBSWD_MEMAP_TAR_ADDR, &tar);
+ if (res<0) return res;
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(1, 1, LIBSWD_MEMAP_DRW_ADDR)];
+ for (i=0;i<count;i++){
+  res=libswd_bus_transfer_read_buf(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request, (char*)rdata, i*4, 4);
+  if (res<0) return res;
+ }
+ res=libswd_dp_read_buf(libswdctx, LIBSWD_OPERATION_ENQUEUE, LIBSWD_DP_RDBUFF_ADDR, (char*)rdata, count*4, 4);
+ if (res<0) return res;
+ res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, LIBSWD_OPERATION_EXECUTE);
+ if (res<0) return res;
+
+ for (i=0;i<count;i++)
+  if (rdata[i+1]!=wdata[i] || target->mem[i]!=(unsigned int)wdata[i]) bad++;
+ printf("%-18s: IDCODE=0x%08X, %d words written and read back, %d bad, %d probe round trips, %u clock cycles.\n",
+        name, *idcode, count, bad, probe.roundtrips, target->clocks-clocks);
+
+ libswd_deinit(libswdctx);
+ free(wdata);
+ free(rdata);
+ return bad;
+}
+
+/** Run retry loop of given operation class with given policy.
+ * \param stop is the attempt that succeeds, 0 if none does.
+ * \return number of attempts made.
+ */
+static int libswd_emu_retry_loop(libswd_ctx_t *libswdctx, libswd_retry_class_t opclass, libswd_retry_policy_t *policy, int stop, libswd_retry_t *retry){
+ int attempts=0;
+ if (policy && libswd_retry_policy_set(libswdctx, opclass, policy)<0) return -1;
+ for (libswd_retry_start(libswdctx, opclass, retry); libswd_retry_next(retry);){
+  attempts++;
+  if (attempts==stop) break;
+ }
+ return attempts;
+}
+
+/** Check retry loop semantics of libswd_retry_start() and libswd_retry_next().
+ * \return number of failed checks, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_emu_retry(void){
+ libswd_ctx_t *libswdctx;
+ libswd_retry_policy_t policy;
+ libswd_retry_t retry;
+ struct timeval tstart, tstop;
+ int res, elapsed, bad=0;
+
+ libswdctx=libswd_init();
+ if (!libswdctx) return LIBSWD_ERROR_OUTOFMEM;
+ libswd_log_level_set(libswdctx, LIBSWD_LOGLEVEL_ERROR);
+
+ // Attempt limit, loop ends with expiry flag set.
+ memset(&policy, 0, sizeof(policy));
+ policy.attempts=5;
+ res=libswd_emu_retry_loop(libswdctx, LIBSWD_RETRY_CLASS_DEBUG, &policy, 0, &retry);
+ if (res!=5 || !retry.expired) bad++;
+ // Success before the limit does not set expiry flag.
+ res=libswd_emu_retry_loop(libswdctx, LIBSWD_RETRY_CLASS_DEBUG, NULL, 3, &retry);
+ if (res!=3 || retry.expired) bad++;
+ // Exponential backoff doubles the delay up to maxdelay.
+ policy.attempts=6;
+ policy.delay=1;
+ policy.maxdelay=4;
+ policy.backoff=LIBSWD_RETRY_BACKOFF_EXPONENTIAL;
+ res=libswd_emu_retry_loop(libswdctx, LIBSWD_RETRY_CLASS_POWERUP, &policy, 0, &retry);
+ if (res!=6 || !retry.expired || retry.delay!=policy.maxdelay) bad++;
+ // Time budget without attempt limit.
+ policy.attempts=0;
+ policy.budget=20000;
+ policy.delay=policy.maxdelay=1000;
+ policy.backoff=LIBSWD_RETRY_BACKOFF_FIXED;
+ gettimeofday(&tstart, NULL);
+ res=libswd_emu_retry_loop(libswdctx, LIBSWD_RETRY_CLASS_POLL, &policy, 0, &retry);
+ gettimeofday(&tstop, NULL);
+ elapsed=(tstop.tv_sec-tstart.tv_sec)*1000000+(tstop.tv_usec-tstart.tv_usec);
+ if (res<2 || !retry.expired || elapsed<policy.budget || elapsed>policy.budget*50) bad++;
+ // Policy without any limit is refused.
+ policy.budget=0;
+ if (libswd_retry_policy_set(libswdctx, LIBSWD_RETRY_CLASS_POLL, &policy)!=LIBSWD_ERROR_PARAM) bad++;
+ // Unknown operation class uses ACK=WAIT policy.
+ libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_COUNT, &retry);
+ if (retry.policy!=&libswdctx->config.retry[LIBSWD_RETRY_CLASS_ACKWAIT]) bad++;
+
+ printf("%-18s: 6 retry loop checks, %d bad.\n", "retry policy", bad);
+ libswd_deinit(libswdctx);
+ return bad;
+}
+
+static void *libswd_emu_thread(void *arg){
+ libswd_emu_thread_t *run=(libswd_emu_thread_t*)arg;
+ run->res=libswd_emu_run(run->name, &run->target, run->transaction, run->count, run->seed);
+ return NULL;
+}
+
+/** Run both drivers in given number of threads at the same time.
+ * \return number of failed threads, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_emu_threads(int threads, int count){
+ libswd_emu_thread_t *runs;
+ int i, failed=0;
+
+ runs=(libswd_emu_thread_t*)calloc(threads, sizeof(libswd_emu_thread_t));
+ if (!runs) return LIBSWD_ERROR_OUTOFMEM;
+ for (i=0;i<threads;i++){
+  runs[i].transaction=i&1;
+  runs[i].count=count;
+  runs[i].seed=i*0x10204081;
+  snprintf(runs[i].name, sizeof(runs[i].name), "thread %d %s", i, runs[i].transaction?"transfer":"bitlevel");
+  if (pthread_create(&runs[i].thread, NULL, libswd_emu_thread, &runs[i])) break;
+ }
+ threads=i;
+ for (i=0;i<threads;i++){
+  pthread_join(runs[i].thread, NULL);
+  if (runs[i].res!=0){
+   printf("%s failed (%d)!\n", runs[i].name, runs[i].res);
+   failed++;
+  }
+ }
+ free(runs);
+ return failed;
+}
+
+int main(int argc, char **argv){
+ int res, count=(argc>1)?atoi(argv[1]):256, threads=(argc>2)?atoi(argv[2]):0;
+ libswd_emu_target_t *target;
+
+ if (count<1) count=1;
+ if (count>LIBSWD_EMU_MEMWORDS) count=LIBSWD_EMU_MEMWORDS;
+ target=(libswd_emu_target_t*)malloc(sizeof(libswd_emu_target_t));
+ if (!target) return EXIT_FAILURE;
+
+ res=libswd_emu_run("bit-level driver", target, 0, count, 0);
+ if (res!=0){
+  printf("Bit-level driver failed (%d)!\n", res);
+  return EXIT_FAILURE;
+ }
+ res=libswd_emu_run("transaction driver", target, 1, count, 0);
+ if (res!=0){
+  printf("Transaction driver failed (%d)!\n", res);
+  return EXIT_FAILURE;
+ }
+ free(target);
+
+ res=libswd_emu_retry();
+ if (res!=0){
+  printf("Retry policy failed (%d)!\n", res);
+  return EXIT_FAILURE;
+ }
+
+ if (threads>0){
+  res=libswd_emu_threads(threads, count);
+  if (res!=0){
+   printf("Concurrent contexts failed (%d)!\n", res);
+   return EXIT_FAILURE;
+  }
+ }
+
+ return EXIT_SUCCESS;
+}
@@ -48,6 +48,9 @@
  * \subsection doc_context SWD Context
  * The most important data type in LibSWD is libswd_ctx_t structure, a context that represents logical entity of the swd bus (transport layer between host and target) with all its parameters, configuration and command queue. Context is being created with libswd_init() function that returns pointer to allocated virgin structure, and it can be destroyed with libswd_deinit() function taking the pointer as argument. Context can be set only for one interface-target pair, but there might be many different contexts in use if necessary, so amount of devices in use is not limited. 
  *
+ * \subsection doc_threads Threads
+ * LibSWD keeps no global state, everything lives in the libswd_ctx_t and the driver structures it points to, so contexts are independent. Using each context from one thread at a time is safe, so many interface-target pairs can be driven in parallel from one process (i.e. gang programming) with one thread per context. A single context must not be shared between threads without external locking. Drivers are expected to follow the same rule and keep their scratch buffers in their own interface structure instead of static variables. Helpers that return a string (libswd_bin8_string(), libswd_bin32_string()) use a thread local buffer, valid until the next call from the same thread.
+ *
  * \subsection doc_functions Functions
  * All functions in general operates on pointer type and returns number of processed elements on success or negative value with libswd_error_code_t on failure. Functions are grouped by functionality that is denoted by function name prefix (ie. libswd_bin* are for binary operations, libswd_cmdq* deals with command queue, libswd_cmd_enqueue* deals with creating commands and attaching them to queue, libswd_bus* performs operation on the swd transport system, libswd_drv* are the interface drivers, etc). Because programs using libswd for transport can queue multiple operations and don't handle errors of each transaction apropriately, libswd_drv_transmit() function verifies the ACK and PARITY operation results directly after execution (read from target) and return error code if necessary. When error is detected and there were some pending perations enqueued for execution, they are discarded and removed from the queue (they would not be accepted by the target anyway), the queue is then again ready to accept new transactions (i.e. error handling operations).
  *
@@ -63,6 +66,8 @@
  * \section doc_drivers Drivers
  * Calling the libswd_cmdq_flush() function leads to execution of not yet executed commands from the queue (in a manner specified by the operation parameter) on the SWD bus (transport layer between interface and target, not the bus of the target itself) by libswd_drv_transmit() function that use application specific "extern" functions defined in external file (ie. liblibswd_drv_urjtag.c) to operate on a real hardware using drivers from existing application. LibSWD use only libswd_drv_{mosi,miso}_{8,32} (separate for 8-bit char and 32-bit int data cast type) and libswd_drv_{mosi,miso}_trn functions to interact with drivers, so it is possible to easily reuse low-level and high-level devices for communications, as they have all information necessary to perform exact actions - number of bits, payload, command type, shift direction and bus direction. It is even possible to send raw bytes on the bus (control command) or bitbang the bus (bitbang command) if necessary. MOSI (Master Output Slave Input) and MISO (Master Input Slave Output) was used to clearly distinguish transfer direction (from master-interface to target-slave), as opposed to ambiguous read/write statements, so after libswd_drv_mosi_trn() master should have its buffers set to output and target inputs active. Drivers, as most of the LibSWD functions, works on data pointers instead data copy and returns number of elements processed (bits in this case) or negative error code on failure.
  *
+ * Driver entry points are kept per context in the libswd_driver_t table. The "extern" functions are only its defaults picked up by libswd_init() when application defines them, while libswd_drv_register() installs a different driver (i.e. FTDI probe, simulator or bus capture) for each context of the same process. Optional packed-bit, batch (or driver staging buffer) and transaction-level entry points, along with the capability flags reported by libswd_drv_caps(), let the library choose the fastest bus access path each driver supports.
+ *
  * \section Error and Retry handling
  * LibSWD is equipped with optional automatic error handling in order to make error and retry handling easier for external applications that were meant for JTAG applications (such as OpenOCD) which first enqueue lots of operations and then flushes them into hardware loosing information on where the target reported problem with ACK!=OK. The default behavior of LibSWD for ACK!=OK response from Target is to truncate the queue right after the bad ACK (eventually executing the necessary data phase before doing that) to preserve synchronization between command queue (libswd_ctx_t->cmdq) and the Target state. This can be changed by clearing out the libswd_ctx_t.config.autofixerrors field that disables queue truncate on error, then applying the libswd_dap_retry() in the application flush mechanism for both DP and AP operations. libswd_dap_retry() will try to find the ACK!=OK on the queue that caused an error then perform operation retry to fix the situation, or fail permanently (Protocol Error Sequence, Retry Count, etc). Note that retry will be handled in a different way than it was performed on the original command queue and it will use separate command queue attached to a bad ACK command element on the queue. This approach gives ability to handle different situations accordingly, does not interfere with the original queue and does not loose information what additional operations had been performed, in perfect situation it should end up in having the original queue executed as there was no error/retry. 
  *
@@ -98,6 +103,15 @@
 #ifndef __LIBSWD_H__
 #define __LIBSWD_H__
 
+/// Storage class of the thread local buffers, see doc_threads.
+#if defined(__GNUC__)
+#define LIBSWD_THREADLOCAL __thread
+#else
+#define LIBSWD_THREADLOCAL
+#endif
+/// Length of the libswd_request_string() buffer kept in the context.
+#define LIBSWD_REQUEST_STRING_MAXLEN 100
+
 /** SWD Packets Bit Fields and Values */
 /// Request packet Start field bitnumber, always set to 1.
 #define LIBSWD_REQUEST_START_BITNUM  0
@@ -145,6 +159,8 @@
 #define LIBSWD_REQUEST_PARK_VAL      1
 /// Number of bits in request packet header.
 #define LIBSWD_REQUEST_BITLEN        8
+/// Index of the LIBSWD_REQUEST_HEADER table entry for given APnDP, RnW and register address.
+#define LIBSWD_REQUEST_INDEX(APnDP, RnW, addr) ( ((APnDP)?1:0) | (((RnW)?1:0)<<1) | ((((addr)>>2)&3)<<2) )
 
 /// Address field minimal value.
 #define LIBSWD_ADDR_MINVAL       0
@@ -448,6 +464,12 @@
 #define LIBSWD_RETRY_COUNT_DEFAULT 10
 /// Retry delay default value
 #define LIBSWD_RETRY_DELAY_DEFAULT 5
+/// Time budget of the target memory polling in microseconds.
+#define LIBSWD_RETRY_POLL_BUDGET_DEFAULT 2000000
+/// First delay of the target memory polling in microseconds.
+#define LIBSWD_RETRY_POLL_DELAY_DEFAULT 100
+/// Delay limit of the target memory polling in microseconds.
+#define LIBSWD_RETRY_POLL_MAXDELAY_DEFAULT 10000
 
 /** Payload for commands that will not change, transmitted MSBFirst */
 /// SW-DP Reset sequence.
@@ -459,6 +481,15 @@ static const char LIBSWD_CMD_SWD2JTAG[]  = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
 /// Inserts idle clocks for proper data processing.
 static const char LIBSWD_CMD_IDLE[] = {0x00};
 
+/** All 16 possible Request packet headers (Start, Parity, Stop and Park bits
+ * already set), indexed with LIBSWD_REQUEST_INDEX(APnDP, RnW, addr).
+ * Same values are produced by libswd_bitgen8_request(), transmitted LSBFirst.
+ */
+static const char LIBSWD_REQUEST_HEADER[16] = {
+ 0x81, 0xa3, 0xa5, 0x87, 0xa9, 0x8b, 0x8d, 0xaf,
+ 0xb1, 0x93, 0x95, 0xb7, 0x99, 0xbb, 0xbd, 0x9f
+};
+
 /** Status and Error Codes definitions */
 /// Error Codes definition, use this to have its name on debugger.
 typedef enum {
@@ -507,7 +538,9 @@ typedef enum {
  LIBSWD_ERROR_CLISYNTAX   =-44, ///< CLI Syntax Error.
  LIBSWD_ERROR_FILE        =-45, ///< File I/O related problem.
  LIBSWD_ERROR_UNSUPPORTED =-46, ///< Target not supported.
- LIBSWD_ERROR_MEMAPACCSIZE=-47  ///< Invalid MEM-AP access size.
+ LIBSWD_ERROR_MEMAPACCSIZE=-47, ///< Invalid MEM-AP access size.
+ LIBSWD_ERROR_STICKY      =-48, ///< Sticky error flag found set in CTRL/STAT.
+ LIBSWD_ERROR_QUEUEFULL   =-49  ///< Command queue reached config.maxcmdqlen.
 } libswd_error_code_t;
 
 /// Do we want autofix errors by default? Not at this point...
@@ -538,7 +571,28 @@ typedef enum {
 /// How many bits are there in data payload.
 #define LIBSWD_DATA_BITLEN        32
 /// How long is the command queue by default.
-#define LIBSWD_CMDQLEN_DEFAULT  1024;
+#define LIBSWD_CMDQLEN_DEFAULT  1024
+/// Is command queue length limited to config.maxcmdqlen by default.
+#define LIBSWD_CMDQRING_DEFAULT LIBSWD_FALSE
+/// Are transfer records pipelined in batches (ACK verified after the batch) by default.
+#define LIBSWD_CMDQPIPELINED_DEFAULT LIBSWD_FALSE
+/// Are CTRL/STAT sticky flags checked once per block instead of per AP access by default.
+#define LIBSWD_STICKYDEFERRED_DEFAULT LIBSWD_FALSE
+/// Are idle cycles after AP accesses tuned to the observed WAIT rate by default.
+/// Set config.apidle or restore tuned values with libswd_dap_apidle_set() to enable.
+#define LIBSWD_APIDLE_DEFAULT LIBSWD_FALSE
+/// Idle cycles granularity, one LIBSWD_CMD_IDLE control element.
+#define LIBSWD_APIDLE_STEP      8
+/// Maximal number of idle cycles inserted after an AP access.
+#define LIBSWD_APIDLE_MAX       128
+/// How many AP accesses without WAIT it takes to reduce idle cycles by one step.
+#define LIBSWD_APIDLE_WINDOW    256
+/// How many IDCODE/AP pairs remember their tuned idle cycles.
+#define LIBSWD_APIDLE_SLOTS     8
+/// How many clock cycles a pipelined batch may take by default.
+#define LIBSWD_BATCHMAXLEN_DEFAULT 32768
+/// How many command queue elements are allocated at once by the element pool.
+#define LIBSWD_CMDPOOL_SLABLEN  256
 
 /** SWD Command Codes definitions.
  * Available values: MISO>0, MOSI<0, undefined=0. To check command direction
@@ -547,6 +601,7 @@ typedef enum {
  */
 /// Command Type codes definition, use this to see names in debugger.
 typedef enum {
+ LIBSWD_CMDTYPE_MOSI_TRANSFER=-8, ///< Complete transfer record, ends in MOSI mode.
  LIBSWD_CMDTYPE_MOSI_DATA    =-7, ///< Contains MOSI data (from host).
  LIBSWD_CMDTYPE_MOSI_REQUEST =-6, ///< Contains MOSI request packet.
  LIBSWD_CMDTYPE_MOSI_TRN     =-5, ///< Bus will switch into MOSI mode.
@@ -588,6 +643,23 @@ typedef enum {
  * This organization allows better granularity for tracing bugs and makes
  * possible to compose complete bus/target operations made of simple commands.
  */
+/** Transfer record holds complete SWD transaction in a single command queue
+ * element (LIBSWD_CMDTYPE_MOSI_TRANSFER): Request, TRN, ACK, then TRN, Data
+ * and Parity for write or Data, Parity and TRN for read. It is expanded into
+ * bus operations at once by libswd_drv_transfer(). When ACK!=OK only TRN
+ * back to MOSI follows the ACK, so the bus always ends in MOSI mode.
+ * When *dest is set, valid read data is also stored there on execution.
+ */
+typedef struct {
+ int data;        ///< Data written to or read from target.
+ char request;    ///< Request header data.
+ char ack;        ///< Acknowledge response from target.
+ char parity;     ///< Parity bit for data payload.
+ char status;     ///< LIBSWD_OK or LIBSWD_ERROR_CODE of executed transfer.
+ char destlen;    ///< Number of read data bytes deposited into *dest (1..4).
+ char *dest;      ///< Caller buffer for read data, NULL if none.
+} libswd_transfer_t;
+
 typedef struct libswd_cmd_t {
  union {
   char TRNnMOSI;  ///< Holds/sets bus direction: MOSI when zero, MISO for others.
@@ -601,6 +673,7 @@ typedef struct libswd_cmd_t {
   char parity;    ///< Parity bit for data payload.
   char control;   ///< Control transfer data (one byte).
   char data8;     ///< Holds "char" data type for inspection.
+  libswd_transfer_t transfer; ///< Complete transfer record.
  };
  char bits;       ///< Payload bit count == clk pulses on the bus.
  libswd_cmdtype_t cmdtype; ///< Command type as defined by libswd_cmdtype_t. 
@@ -610,6 +683,92 @@ typedef struct libswd_cmd_t {
  struct libswd_cmd_t *next; ///< Pointer to the next command.
 } libswd_cmd_t;
 
+/** Command queue pointers kept by the context, so appending new elements,
+ * checking bus direction and starting the flush does not walk the queue.
+ * Pointers are maintained by libswd_cmd_enqueue(), libswd_cmdq_flush() and
+ * all functions that truncate the context queue.
+ */
+typedef struct {
+ libswd_cmd_t *head;     ///< First (root) element of the command queue.
+ libswd_cmd_t *tail;     ///< Last element appended to the command queue.
+ libswd_cmd_t *exectail; ///< Last element executed from the command queue.
+ libswd_cmd_t *flushed;  ///< Last element executed by the last caller flush.
+ libswd_cmd_t *consumed; ///< Elements up to this one may be retired.
+ int len;                ///< Number of elements appended after the root.
+} libswd_cmdqptr_t;
+
+/** Command queue elements are allocated in slabs of LIBSWD_CMDPOOL_SLABLEN
+ * elements. Slabs are only released when the context is destroyed.
+ */
+typedef struct libswd_cmdslab_t {
+ libswd_cmd_t cmd[LIBSWD_CMDPOOL_SLABLEN]; ///< Elements of this slab.
+ struct libswd_cmdslab_t *next;            ///< Next allocated slab.
+} libswd_cmdslab_t;
+
+/** Command queue element pool. Elements removed from the queue are put back
+ * on the free list and reused by next enqueue instead of being freed, so the
+ * heap is only touched when the number of elements in use grows.
+ */
+typedef struct {
+ libswd_cmdslab_t *slabs; ///< List of allocated slabs.
+ libswd_cmd_t *free;      ///< List of free elements, linked by their next.
+ int size;                ///< Number of elements allocated in all slabs.
+ int used;                ///< Number of elements currently in use.
+ int highwater;           ///< Highest number of elements in use so far.
+} libswd_cmdpool_t;
+
+/** Span of pending command queue elements that is being flushed.
+ * Element pointers are gathered once, so transmission does not walk the
+ * queue and can look ahead, i.e. to group transfer records into a probe
+ * block transfer or to build driver batches. Elements are transmitted and
+ * updated in place. Arrays grow on demand and are reused by the next flush.
+ * Flush made by the error handling while the span is transmitted gathers
+ * its own span, see libswd_cmdq_flush().
+ */
+typedef struct {
+ libswd_cmd_t **cmd; ///< Queue elements of the span.
+ int *data;          ///< Transfer record data handed to driver transfer_block().
+ int len;            ///< Number of elements in the span.
+ int size;           ///< Allocated length of each array.
+ char busy;          ///< Span is being transmitted.
+} libswd_cmdqspan_t;
+
+/** Operation classes, each one has its own retry policy. */
+typedef enum {
+ LIBSWD_RETRY_CLASS_ACKWAIT=0, ///< Transfer answered with ACK=WAIT.
+ LIBSWD_RETRY_CLASS_POWERUP,   ///< Waiting for DAP power up acknowledge.
+ LIBSWD_RETRY_CLASS_DEBUG,     ///< Waiting for CPU halt/run state change.
+ LIBSWD_RETRY_CLASS_POLL,      ///< Polling target memory (i.e. flash controller busy flag).
+ LIBSWD_RETRY_CLASS_COUNT      ///< Number of operation classes.
+} libswd_retry_class_t;
+
+/** Delay between retries. */
+typedef enum {
+ LIBSWD_RETRY_BACKOFF_FIXED=0,  ///< Same delay before each retry.
+ LIBSWD_RETRY_BACKOFF_EXPONENTIAL ///< Delay doubles with each retry up to maxdelay.
+} libswd_retry_backoff_t;
+
+/** Retry policy of the operation class, see libswd_retry_policy_set().
+ * Retries stop when either attempts or time budget is exhausted, zero
+ * disables the given limit (but not both).
+ */
+typedef struct {
+ int attempts;    ///< Maximal number of attempts including the first one.
+ int budget;      ///< Time budget in microseconds.
+ int delay;       ///< Delay before the first retry in microseconds.
+ int maxdelay;    ///< Delay limit of exponential backoff in microseconds.
+ char backoff;    ///< Delay between retries (libswd_retry_backoff_t).
+} libswd_retry_policy_t;
+
+/** Retry loop state, see libswd_retry_start() and libswd_retry_next(). */
+typedef struct {
+ libswd_retry_policy_t *policy; ///< Policy of the operation class.
+ int attempt;     ///< Number of attempts started.
+ int delay;       ///< Delay before the next retry in microseconds.
+ char expired;    ///< Set when policy did not allow another attempt.
+ struct timeval start; ///< Time of the first attempt.
+} libswd_retry_t;
+
 /** Context configuration structure */
 typedef struct {
  char initialized;        ///< Context must be initialized prior use.
@@ -617,6 +776,12 @@ typedef struct {
  int  maxcmdqlen;         ///< How long command queue can be.
  libswd_loglevel_t loglevel; ///< Holds Logging Level setting.
  char autofixerrors;      ///< Try to fix errors, return error code if not possible.
+ char cmdqring;           ///< Limit queue to maxcmdqlen, retire executed elements.
+ char cmdqpipelined;      ///< Pipeline transfer records in batches, needs ORUNDETECT.
+ int  batchmaxlen;        ///< Clock cycles limit of a pipelined batch.
+ char stickydeferred;     ///< Check sticky flags per block, see libswd_dap_sticky_check().
+ char apidle;             ///< Insert adaptive idle cycles after AP accesses.
+ libswd_retry_policy_t retry[LIBSWD_RETRY_CLASS_COUNT]; ///< Retry policy of each operation class.
 } libswd_context_config_t;
 
 /** Most actual Serial Wire Debug Port Registers */
@@ -634,6 +799,24 @@ typedef struct {
  int routesel;    ///< Last known ROUTESEL register value.
 } libswd_swdp_t;
 
+/** Idle cycles inserted after AP accesses of a target AP, so the access
+ * completes before the next transfer instead of being answered with WAIT.
+ * Values grow when WAIT is observed and shrink after LIBSWD_APIDLE_WINDOW
+ * accesses without WAIT. Entries are kept per IDCODE for the lifetime of
+ * the context and can be saved and restored with libswd_dap_apidle_get()
+ * and libswd_dap_apidle_set(). Index 0 is AP write, index 1 is AP read.
+ * WAIT means the AP access before it is still in progress, so it is
+ * attributed to the type of the last AP access.
+ */
+typedef struct {
+ int idcode;      ///< Target's IDCODE the entry belongs to, 0 if unused.
+ int ap;          ///< APSEL the entry belongs to.
+ int idle[2];     ///< Idle cycles inserted after the access.
+ int quiet[2];    ///< Accesses since last WAIT or reduction.
+ int waits[2];    ///< Number of WAIT responses observed.
+ int last;        ///< Type of the last access (0 write, 1 read).
+} libswd_apidle_t;
+
 /** Most actual MEM-AP (Memory Access Port) register values (cache). */
 typedef struct {
  char ack;        ///< Last known state of ACK response.
@@ -663,14 +846,149 @@ typedef struct {
  char parity;       ///< Last known parity on the bus.
 } libswd_transaction_t;
 
-/** Interface Driver structure. It holds pointer to the driver structure that
- * keeps driver information necessary to work with the physical interface.
- * Also dedicated *ctx field is available to store driver/application context.
+/** Batch of bus clock cycles passed to the interface driver at once.
+ * Bit n of each bitstream is the bit (n%8) of byte (n/8), so the LSB of the
+ * first byte is clocked out first. Cycles marked in the capture map are MISO
+ * or turnaround cycles, where host releases SWDIO and driver stores sampled
+ * value at the same bit position of the *miso bitstream. On other cycles
+ * host drives SWDIO with the *mosi bitstream bit.
+ */
+typedef struct {
+ unsigned char *mosi; ///< Packed MOSI bitstream.
+ unsigned char *miso; ///< Captured MISO bitstream.
+ unsigned char *dir;  ///< Capture map, bit set when host samples SWDIO.
+ int *pos;            ///< Bitstream position of each packed entry in batch.
+ int bits;            ///< Number of clock cycles in the batch.
+ int size;            ///< Allocated length of each bitstream in bytes.
+ int *words;          ///< Read data words of the batch for parity check.
+ char *parities;      ///< Read parity bits of the batch for parity check.
+ int possize;         ///< Allocated length of the *pos, *words and *parities arrays.
+} libswd_batch_t;
+
+/** Batch runs staged by the driver, see libswd_driver_t stage_reserve().
+ * Each run is a part of the batch with its own position in the driver
+ * receive buffer, so captured bits are read from there in place.
+ */
+typedef struct {
+ unsigned char *rx; ///< Driver receive buffer set by stage_commit().
+ int *cycle;        ///< Batch position of each staged run.
+ int *rxpos;        ///< Receive buffer bit position of each staged run.
+ int len;           ///< Number of staged runs.
+ int size;          ///< Allocated length of the *cycle and *rxpos arrays.
+} libswd_stage_t;
+
+/** Bitstream check types, see libswd_bitcheck_t. */
+typedef enum {
+ LIBSWD_BITCHECK_ACK   =1, ///< 3-bit ACK must match the recorded value.
+ LIBSWD_BITCHECK_PARITY=2, ///< 32-bit read data must match following parity bit.
+ LIBSWD_BITCHECK_DATA  =3  ///< As PARITY, read data must also match the value.
+} libswd_bitcheck_type_t;
+
+/** Single field of the recorded bitstream that is verified on replay. */
+typedef struct {
+ int pos;   ///< Bitstream position of the checked field.
+ int type;  ///< Check type (libswd_bitcheck_type_t).
+ int value; ///< Recorded field value (expected value for LIBSWD_BITCHECK_DATA).
+} libswd_bitcheck_t;
+
+/** Compiled bitstream recorded from the bus activity of a context.
+ * It holds all the clock cycles that were sent to the interface driver along
+ * with the positions of ACK responses and read data that are verified when
+ * the bitstream is replayed with libswd_bitstream_replay(), so the same bus
+ * activity can be repeated without building the command queue again.
+ */
+typedef struct {
+ libswd_batch_t batch;     ///< Recorded clock cycles, MISO holds last samples.
+ libswd_bitcheck_t *check; ///< Fields verified on replay.
+ int checklen;             ///< Number of checks.
+ int checksize;            ///< Allocated length of the *check array.
+ int datapos;              ///< Position of the last recorded MISO_DATA, or -1.
+} libswd_bitstream_t;
+
+struct libswd_ctx_t;
+
+/** Interface driver capability flags, see libswd_drv_caps(). */
+typedef enum {
+ LIBSWD_DRIVER_CAP_BITS       =1,  ///< Per-command mosi/miso/trn functions.
+ LIBSWD_DRIVER_CAP_PACKED     =2,  ///< Packed-bit mosi_packed()/miso_packed().
+ LIBSWD_DRIVER_CAP_BATCH      =4,  ///< Whole libswd_batch_t with transmit_batch().
+ LIBSWD_DRIVER_CAP_TRANSACTION=8,  ///< Probe executes whole SWD transactions.
+ LIBSWD_DRIVER_CAP_INLINETRN  =32, ///< Packed entry points switch bus direction.
+ LIBSWD_DRIVER_CAP_STAGED     =64  ///< Batch is built in the driver buffer.
+} libswd_driver_cap_t;
+
+/** Interface Driver structure, a per-context table of driver entry points.
+ * It holds pointer to the driver structure that keeps driver information
+ * necessary to work with the physical interface. Also dedicated *ctx field
+ * is available to store driver/application context.
+ * Driver is set up with libswd_drv_register(), so each context may use a
+ * different driver in the same process. On libswd_init() per-command entry
+ * points default to libswd_drv_{mosi,miso}_{8,32,trn}() "extern" functions
+ * when the application defines them, so existing drivers still work.
+ * Per-command entry points shift bit-per-char or int data and TRN cycles
+ * as described in doc_drivers.
+ * Optional transmit_batch() entry point transmits a whole libswd_batch_t in
+ * one driver call and returns number of clock cycles or LIBSWD_ERROR_CODE.
+ * When it is not set, queue is flushed with per-command driver functions.
+ * Optional stage_reserve() and stage_commit() entry points replace it with
+ * the driver owned staging buffer, so batch is built in place of the probe
+ * outgoing frame instead of libswd_batch_t bitstreams. stage_reserve() adds
+ * bits clock cycles (1..32) in one direction to the staged frame, sets
+ * *mosi and *mosipos to the byte and bit where library stores the packed
+ * MOSI data (nothing is stored for MISO cycles), and returns bit position
+ * of the cycles in the receive buffer (or LIBSWD_ERROR_CODE). Pointer is
+ * valid only until the next call. stage_commit() transmits the frame, sets
+ * *miso to the receive buffer with captured bits packed LSB-first at the
+ * reserved positions, so they are decoded from there, and returns number of
+ * clock cycles. When miso is NULL staged frame is discarded instead.
+ * Optional mosi_packed() and miso_packed() entry points replace the
+ * mosi_8/32() and miso_8/32() entry points. They shift packed bit buffers,
+ * where bit n is the bit (n%8) of byte (n/8) and is clocked n-th on the
+ * wire (LSB-first), so driver does not have to convert data bit by bit.
+ * Unused bits of the last received byte must be zero. They return number
+ * of bits shifted, or LIBSWD_ERROR_CODE on failure.
+ * Drivers that set LIBSWD_DRIVER_CAP_INLINETRN in caps switch the bus
+ * direction themselves in the same interface frame as the packed data
+ * (i.e. MPSSE GPIO set commands): mosi_packed() drives SWDIO, miso_packed()
+ * releases it. TRN cycles are then clocked as part of the surrounding
+ * miso_packed() calls and mosi_trn()/miso_trn() are not used.
+ * Optional transfer() entry point is for probes with hardware SWD engine
+ * (i.e. CMSIS-DAP). It executes one complete SWD transaction for given
+ * Request and stores the ACK, for ACK=OK it also writes or reads the *data.
+ * Probe generates and verifies data parity, returns LIBSWD_ERROR_PARITY on
+ * read parity mismatch, and does the data phase after ACK={WAIT,FAULT} when
+ * CTRL/STAT:ORUNDETECT requires it. AP reads are posted as on the wire, so
+ * data returned is the result of the previous AP read. Transfer records are
+ * then passed to the probe as a whole, without generating their bitstream.
+ * Optional transfer_block(), used along with transfer(), executes count
+ * transactions with the same Request on data array (CMSIS-DAP TransferBlock),
+ * stops at the first ACK!=OK or parity error and stores its ACK. It returns
+ * number of completed transactions (ACK=OK with less than count completed
+ * means parity error), or LIBSWD_ERROR_CODE on failure. Line resets and other raw sequences are
+ * still sent with per-command entry points (i.e. SWJ_Sequence).
+ * Capabilities of the entry points present are implied, caps holds the
+ * ones that can not be told from the entry points (libswd_driver_cap_t).
+ * Nonzero maxbatchbits limits clock cycles of a single batch.
  */
 typedef struct {
  void *device;
  void *ctx;
  void *interface;
+ int caps;          ///< Additional capabilities (libswd_driver_cap_t).
+ int maxbatchbits;  ///< Longest batch in clock cycles, 0 if not limited.
+ int (*mosi_8)(struct libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
+ int (*mosi_32)(struct libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
+ int (*miso_8)(struct libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
+ int (*miso_32)(struct libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
+ int (*mosi_trn)(struct libswd_ctx_t *libswdctx, int bits);
+ int (*miso_trn)(struct libswd_ctx_t *libswdctx, int bits);
+ int (*transmit_batch)(struct libswd_ctx_t *libswdctx, libswd_batch_t *batch);
+ int (*mosi_packed)(struct libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits);
+ int (*miso_packed)(struct libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits);
+ int (*transfer)(struct libswd_ctx_t *libswdctx, char request, int *data, char *ack);
+ int (*transfer_block)(struct libswd_ctx_t *libswdctx, char request, int *data, int count, char *ack);
+ int (*stage_reserve)(struct libswd_ctx_t *libswdctx, int bits, int miso, unsigned char **mosi, int *mosipos);
+ int (*stage_commit)(struct libswd_ctx_t *libswdctx, unsigned char **miso);
 } libswd_driver_t;
 
 /** Boolean values definition */
@@ -797,11 +1115,19 @@ typedef struct libswd_debug {
  * are required to pass libswd_ctx_t pointer structure that also remembers
  * last known state of the target's internal registers.
  */
-typedef struct {
+typedef struct libswd_ctx_t {
  libswd_cmd_t *cmdq;             ///< Command queue, stores all bus operations.
+ libswd_cmdqptr_t cmdqptr;       ///< Command queue head/tail/exectail pointers.
+ libswd_cmdpool_t cmdpool;       ///< Command queue element pool.
+ libswd_cmdqspan_t cmdqspan;     ///< Command queue span being flushed.
+ libswd_batch_t batch;           ///< Bus cycles batch for the interface driver.
+ libswd_stage_t stage;           ///< Batch runs staged in the driver buffer.
+ libswd_bitstream_t *bitstream;  ///< Bitstream being recorded, NULL if none.
  libswd_context_config_t config; ///< Target specific configuration.
  libswd_driver_t *driver;        ///< Pointer to the interface driver structure.
  libswd_membuf_t membuf;         ///< Memory related scratchpad.
+ libswd_apidle_t apidle[LIBSWD_APIDLE_SLOTS]; ///< Tuned AP idle cycles.
+ char requeststr[LIBSWD_REQUEST_STRING_MAXLEN]; ///< libswd_request_string() result.
  struct {
   libswd_swdp_t dp;              ///< Last known value of the SW-DP registers.
   libswd_memap_t memap;          ///< Last known value of the MEM-AP registers.
@@ -820,22 +1146,31 @@ typedef struct {
 
 int libswd_bin8_parity_even(char *data, char *parity);
 int libswd_bin32_parity_even(int *data, char *parity);
+int libswd_bin32_parity_verify(int *data, char *parity, int count);
 int libswd_bin8_print(char *data);
 int libswd_bin32_print(int *data);
 char *libswd_bin8_string(char *data);
 char *libswd_bin32_string(int *data);
 int libswd_bin8_bitswap(unsigned char *buffer, int bitcount);
 int libswd_bin32_bitswap(unsigned int *buffer, int bitcount);
+int libswd_bin_pack(unsigned char *packed, char *bits, int count);
+int libswd_bin_unpack(char *bits, unsigned char *packed, int count);
 
 int libswd_cmdq_init(libswd_cmd_t *cmdq);
 libswd_cmd_t* libswd_cmdq_find_head(libswd_cmd_t *cmdq);
 libswd_cmd_t* libswd_cmdq_find_tail(libswd_cmd_t *cmdq);
 libswd_cmd_t* libswd_cmdq_find_exectail(libswd_cmd_t *cmdq);
+libswd_cmd_t* libswd_cmdq_seek_exectail(libswd_ctx_t *libswdctx);
 int libswd_cmdq_append(libswd_cmd_t *cmdq, libswd_cmd_t *cmd);
-int libswd_cmdq_free(libswd_cmd_t *cmdq);
-int libswd_cmdq_free_head(libswd_cmd_t *cmdq);
-int libswd_cmdq_free_tail(libswd_cmd_t *cmdq);
+int libswd_cmdq_free(libswd_ctx_t *libswdctx, libswd_cmd_t *cmdq);
+int libswd_cmdq_free_head(libswd_ctx_t *libswdctx, libswd_cmd_t *cmdq);
+int libswd_cmdq_free_tail(libswd_ctx_t *libswdctx, libswd_cmd_t *cmdq);
+libswd_cmd_t* libswd_cmdq_pool_get(libswd_ctx_t *libswdctx);
+int libswd_cmdq_pool_put(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd);
+int libswd_cmdq_pool_free(libswd_ctx_t *libswdctx);
 int libswd_cmdq_flush(libswd_ctx_t *libswdctx, libswd_cmd_t **cmdq, libswd_operation_t operation);
+int libswd_cmdq_retire(libswd_ctx_t *libswdctx, int keep);
+int libswd_cmdq_span(libswd_ctx_t *libswdctx, libswd_cmd_t *firstcmd, libswd_cmd_t *lastcmd);
 
 int libswd_cmd_enqueue(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd);
 int libswd_cmd_enqueue_mosi_request(libswd_ctx_t *libswdctx, char *request);
@@ -859,6 +1194,9 @@ int libswd_cmd_enqueue_mosi_dap_reset(libswd_ctx_t *libswdctx);
 int libswd_cmd_enqueue_mosi_idle(libswd_ctx_t *libswdctx);
 int libswd_cmd_enqueue_mosi_jtag2swd(libswd_ctx_t *libswdctx);
 int libswd_cmd_enqueue_mosi_swd2jtag(libswd_ctx_t *libswdctx);
+int libswd_cmd_enqueue_transfer_read(libswd_ctx_t *libswdctx, char *request, int **data, char **ack, char **parity);
+int libswd_cmd_enqueue_transfer_read_buf(libswd_ctx_t *libswdctx, char *request, char *buf, int offset, int len);
+int libswd_cmd_enqueue_transfer_write(libswd_ctx_t *libswdctx, char *request, int *data, char **ack);
 
 char *libswd_cmd_string_cmdtype(libswd_cmd_t *cmd);
 
@@ -871,10 +1209,33 @@ int libswd_bus_write_data_p(libswd_ctx_t *libswdctx, libswd_operation_t operatio
 int libswd_bus_write_data_ap(libswd_ctx_t *libswdctx, libswd_operation_t operation, int *data);
 int libswd_bus_read_data_p(libswd_ctx_t *libswdctx, libswd_operation_t operation, int **data, char **parity);
 int libswd_bus_write_control(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *ctlmsg, int len);
+int libswd_bus_transfer_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *request, int **data, char **ack, char **parity);
+int libswd_bus_transfer_read_buf(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *request, char *buf, int offset, int len);
+int libswd_bus_transfer_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *request, int *data, char **ack);
 
 int libswd_bitgen8_request(libswd_ctx_t *libswdctx, char *APnDP, char *RnW, char *addr, char *request);
 
+int libswd_drv_init(libswd_ctx_t *libswdctx);
+int libswd_drv_register(libswd_ctx_t *libswdctx, const libswd_driver_t *driver);
+int libswd_drv_caps(libswd_ctx_t *libswdctx);
 int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd);
+int libswd_drv_transmit_verify(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int res);
+int libswd_drv_transmit_span(libswd_ctx_t *libswdctx, libswd_cmd_t **cmd);
+int libswd_drv_transfer(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd);
+int libswd_drv_batch_append(libswd_batch_t *batch, int data, int bits, int miso);
+int libswd_drv_batch_extract(libswd_batch_t *batch, int pos, int bits, int *data);
+int libswd_drv_transmit_batch(libswd_ctx_t *libswdctx, libswd_cmd_t **cmd);
+
+libswd_bitstream_t *libswd_bitstream_init(void);
+int libswd_bitstream_free(libswd_bitstream_t *bitstream);
+int libswd_bitstream_record(libswd_ctx_t *libswdctx, libswd_bitstream_t *bitstream);
+int libswd_bitstream_append(libswd_bitstream_t *bitstream, int data, int bits, int miso);
+int libswd_bitstream_append_check(libswd_bitstream_t *bitstream, int pos, int type, int value);
+int libswd_bitstream_append_cmd(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int payload);
+int libswd_bitstream_expect(libswd_bitstream_t *bitstream, int read, int value);
+int libswd_bitstream_replay(libswd_ctx_t *libswdctx, libswd_bitstream_t *bitstream);
+int libswd_bitstream_save(libswd_bitstream_t *bitstream, FILE *file);
+libswd_bitstream_t *libswd_bitstream_load(FILE *file);
 extern int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
 extern int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
 extern int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
@@ -896,6 +1257,10 @@ char *libswd_error_string(libswd_error_code_t error);
 int libswd_error_handle(libswd_ctx_t *libswdctx);
 int libswd_error_handle_ack(libswd_ctx_t *libswdctx);
 int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx);
+int libswd_error_handle_transfer(libswd_ctx_t *libswdctx);
+int libswd_retry_policy_set(libswd_ctx_t *libswdctx, libswd_retry_class_t opclass, libswd_retry_policy_t *policy);
+void libswd_retry_start(libswd_ctx_t *libswdctx, libswd_retry_class_t opclass, libswd_retry_t *retry);
+int libswd_retry_next(libswd_retry_t *retry);
 
 libswd_ctx_t *libswd_init(void);
 int libswd_deinit_ctx(libswd_ctx_t *libswdctx);
@@ -904,9 +1269,13 @@ int libswd_deinit(libswd_ctx_t *libswdctx);
 
 int libswd_dp_read_idcode(libswd_ctx_t *libswdctx, libswd_operation_t operation, int **idcode);
 int libswd_dp_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, int **data);
+int libswd_dp_read_buf(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, char *buf, int offset, int len);
 int libswd_dp_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, int *data);
 int libswd_ap_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, int **data);
+int libswd_ap_read_buf(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, char *buf, int offset, int len);
+int libswd_ap_read_buf_posted(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, char *buf, int offset, int len, int count);
 int libswd_ap_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, int *data);
+int libswd_ap_write_stream(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, int *data, int count);
 
 
 int libswd_dap_init(libswd_ctx_t *libswdctx, libswd_operation_t operation, int **idcode);
@@ -915,6 +1284,9 @@ int libswd_dap_reset(libswd_ctx_t *libswdctx, libswd_operation_t operation);
 int libswd_dap_select(libswd_ctx_t *libswdctx, libswd_operation_t operation);
 int libswd_dap_detect(libswd_ctx_t *libswdctx, libswd_operation_t operation, int **idcode);
 int libswd_dap_errors_handle(libswd_ctx_t *libswdctx, libswd_operation_t operation, int *abort, int *ctrlstat);
+int libswd_dap_sticky_check(libswd_ctx_t *libswdctx, int *ctrlstat);
+int libswd_dap_apidle_get(libswd_ctx_t *libswdctx, int idcode, int ap, int rnw);
+int libswd_dap_apidle_set(libswd_ctx_t *libswdctx, int idcode, int ap, int rnw, int cycles);
 
 int libswd_memap_init(libswd_ctx_t *libswdctx, libswd_operation_t operation);
 int libswd_memap_setup(libswd_ctx_t *libswdctx, libswd_operation_t operation, int csw, int tar);
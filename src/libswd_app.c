@@ -269,6 +269,7 @@ int libswdapp_handle_command_flash(libswdapp_context_t *libswdappctx, char *comm
 {
  if (!libswdappctx) return LIBSWD_ERROR_NULLCONTEXT;
  int i, j, retval, *idcode, flashdrvidx=0, dbgdhcsr, data, *datap, count, addr, addrstart;
+ libswd_retry_t retry;
  char buf[4], *cmd, *filename;
  libswd_ctx_t *libswdctx=(libswd_ctx_t*)libswdappctx->libswdctx;
  libswdapp_flash_stm32f1_memmap_t flash_memmap;
@@ -404,13 +405,12 @@ int libswdapp_handle_command_flash(libswdapp_context_t *libswdappctx, char *comm
   if (retval<0) goto libswdapp_handle_command_flash_error;
   // Perform Mass-Erase operation.
   //Wait for BSY flag clearance.
-  for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+  for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_POLL, &retry); libswd_retry_next(&retry);)
   {
    retval=libswd_memap_read_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, flash_memmap.FLASH_SR_ADDR, 1, &data);
    if (!(data&LIBSWDAPP_FLASH_STM32F1_FLASH_SR_BSY)) break;
-   usleep(100);
   }
-  if (!i)
+  if (retry.expired)
   {
    retval=LIBSWD_ERROR_MAXRETRY;
    goto libswdapp_handle_command_flash_error; 
@@ -425,13 +425,12 @@ int libswdapp_handle_command_flash(libswdapp_context_t *libswdappctx, char *comm
   retval=libswd_memap_write_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, flash_memmap.FLASH_CR_ADDR, 1, &data);
   if (retval<0) goto libswdapp_handle_command_flash_error;
   //Wait for BSY flag clearance.
-  for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+  for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_POLL, &retry); libswd_retry_next(&retry);)
   {
    retval=libswd_memap_read_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, flash_memmap.FLASH_SR_ADDR, 1, &data);
    if (!(data&LIBSWDAPP_FLASH_STM32F1_FLASH_SR_BSY)) break;
-   usleep(100);
   }
-  if (!i)
+  if (retry.expired)
   {
    retval=LIBSWD_ERROR_MAXRETRY;
    goto libswdapp_handle_command_flash_error; 
@@ -525,13 +524,12 @@ libswdapp_handle_command_flash_file_load_ok:
    // Perform Mass-Erase operation.
    libswd_log(libswdctx, LIBSWD_LOGLEVEL_NORMAL, "FLASH: Performing Flash Mass-Erase...\n");
    //Wait for BSY flag clearance.
-   for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_POLL, &retry); libswd_retry_next(&retry);)
    {
     retval=libswd_memap_read_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, flash_memmap.FLASH_SR_ADDR, 1, &data);
     if (!(data&LIBSWDAPP_FLASH_STM32F1_FLASH_SR_BSY)) break;
-    usleep(LIBSWD_RETRY_DELAY_DEFAULT);
    }
-   if (!i)
+   if (retry.expired)
    {
     retval=LIBSWD_ERROR_MAXRETRY;
     goto libswdapp_handle_command_flash_error; 
@@ -546,13 +544,12 @@ libswdapp_handle_command_flash_file_load_ok:
    retval=libswd_memap_write_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, flash_memmap.FLASH_CR_ADDR, 1, &data);
    if (retval<0) goto libswdapp_handle_command_flash_error;
    //Wait for BSY flag clearance.
-   for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_POLL, &retry); libswd_retry_next(&retry);)
    {
     retval=libswd_memap_read_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, flash_memmap.FLASH_SR_ADDR, 1, &data);
     if (!(data&LIBSWDAPP_FLASH_STM32F1_FLASH_SR_BSY)) break;
-    usleep(100);
    }
-   if (!i)
+   if (retry.expired)
    {
     retval=LIBSWD_ERROR_MAXRETRY;
     goto libswdapp_handle_command_flash_error; 
@@ -771,6 +768,7 @@ int libswdapp_handle_command_interface_init(libswdapp_context_t *libswdappctx, c
  int retval, i, interface_number;
  char *param, buf[8];
  libswd_ctx_t *libswdctx=(libswd_ctx_t*)libswdappctx->libswdctx;
+ libswd_driver_t driver;
 
  // Verify the working context.
  if (!libswdappctx)
@@ -829,6 +827,10 @@ int libswdapp_handle_command_interface_init(libswdapp_context_t *libswdappctx, c
  libswdappctx->interface->bitbang=NULL;
  libswdappctx->interface->transfer_bits=NULL;
  libswdappctx->interface->transfer_bytes=NULL;
+ libswdappctx->interface->transfer_packed=NULL;
+ libswdappctx->interface->transmit_batch=NULL;
+ libswdappctx->interface->stage_reserve=NULL;
+ libswdappctx->interface->stage_commit=NULL;
  libswdappctx->interface->latency=0;
  libswdappctx->interface->maxfrequency=0;
  libswdappctx->interface->frequency=-1;
@@ -844,6 +846,10 @@ int libswdapp_handle_command_interface_init(libswdapp_context_t *libswdappctx, c
  libswdappctx->interface->bitbang        = libswdapp_interface_configs[interface_number].bitbang;
  libswdappctx->interface->transfer_bits  = libswdapp_interface_configs[interface_number].transfer_bits;
  libswdappctx->interface->transfer_bytes = libswdapp_interface_configs[interface_number].transfer_bytes;
+ libswdappctx->interface->transfer_packed= libswdapp_interface_configs[interface_number].transfer_packed;
+ libswdappctx->interface->transmit_batch = libswdapp_interface_configs[interface_number].transmit_batch;
+ libswdappctx->interface->stage_reserve  = libswdapp_interface_configs[interface_number].stage_reserve;
+ libswdappctx->interface->stage_commit   = libswdapp_interface_configs[interface_number].stage_commit;
  libswdappctx->interface->vid            = libswdapp_interface_configs[interface_number].vid;
  libswdappctx->interface->pid            = libswdapp_interface_configs[interface_number].pid;
  libswdappctx->interface->latency        = libswdapp_interface_configs[interface_number].latency;
@@ -867,6 +873,41 @@ int libswdapp_handle_command_interface_init(libswdapp_context_t *libswdappctx, c
  }
 
  libswdappctx->interface->initialized=1; 
+ // Register LibSWD driver with entry points the interface supports.
+ if (libswdctx==NULL) return retval;
+ memset(&driver, 0, sizeof(driver));
+ driver.ctx=libswdappctx;
+ driver.interface=libswdappctx->interface;
+ driver.mosi_8=libswd_drv_mosi_8;
+ driver.mosi_32=libswd_drv_mosi_32;
+ driver.miso_8=libswd_drv_miso_8;
+ driver.miso_32=libswd_drv_miso_32;
+ driver.mosi_trn=libswd_drv_mosi_trn;
+ driver.miso_trn=libswd_drv_miso_trn;
+ // Use packed-bit driver functions when interface supports them.
+ // They switch "RnW" within their own frames, so TRN is encoded inline.
+ if (libswdappctx->interface->transfer_packed)
+ {
+  driver.mosi_packed=libswdapp_drv_mosi_packed;
+  driver.miso_packed=libswdapp_drv_miso_packed;
+  driver.caps|=LIBSWD_DRIVER_CAP_INLINETRN;
+ }
+ // Whole transfers are sent as single interface frames when supported.
+ // Pipelined batch response (at most a byte per clock) must fit a USB chunk.
+ if (libswdappctx->interface->transmit_batch)
+ {
+  driver.transmit_batch=libswdapp_drv_transmit_batch;
+  driver.maxbatchbits=libswdappctx->interface->chunksize;
+ }
+ // Batch is then built straight in the interface frame buffer.
+ if (libswdappctx->interface->stage_reserve && libswdappctx->interface->stage_commit)
+ {
+  driver.stage_reserve=libswdapp_drv_stage_reserve;
+  driver.stage_commit=libswdapp_drv_stage_commit;
+  driver.maxbatchbits=libswdappctx->interface->chunksize;
+ }
+ i=libswd_drv_register(libswdctx, &driver);
+ if (i<0) return i;
  return retval;
 }
 
@@ -1233,8 +1274,8 @@ int libswdapp_interface_ftdi_bitbang(libswdapp_context_t *libswdappctx, unsigned
  */
 int libswdapp_interface_ftdi_transfer_bits(libswdapp_context_t *libswdappctx, int bits, char *mosidata, char *misodata, int nLSBfirst)
 {
- static unsigned char buf[65539], databuf;
- int i, retval, bit=0, byte=0, bytes=0, retry;
+ unsigned char *buf;
+ int retval, bit=0, bytes=0, retry;
  int bytes_written, bytes_read;
  struct ftdi_context *ftdictx=(struct ftdi_context*)libswdappctx->interface->ctx;
 
@@ -1244,6 +1285,8 @@ int libswdapp_interface_ftdi_transfer_bits(libswdapp_context_t *libswdappctx, in
              "ERROR: Cannot transfer more than 65536 bits at once!\n");
   return LIBSWD_ERROR_DRIVER;
  }
+ buf=libswdapp_interface_buf(libswdappctx->interface, 65539);
+ if (buf==NULL) return LIBSWD_ERROR_OUTOFMEM;
 
  if (bits>=8)
  {
@@ -1255,12 +1298,7 @@ int libswdapp_interface_ftdi_transfer_bits(libswdapp_context_t *libswdappctx, in
   buf[2] = (char)((bytes>>8)&0x0ff);
   bytes++;
   // Fill in the data buffer.
-  for (byte=0;byte*8<bits;byte++)
-  {
-   databuf = 0;
-   for (i=0;i<8;i++) databuf|=mosidata[byte*8+i]?(1<<i):0;
-   buf[byte+3]=databuf;
-  }
+  libswd_bin_pack(buf+3, mosidata, bytes*8);
   bytes_written = ftdi_write_data(ftdictx, buf, bytes+3);
   if (bytes_written<0 || bytes_written!=(bytes+3))
   {
@@ -1284,9 +1322,7 @@ int libswdapp_interface_ftdi_transfer_bits(libswdapp_context_t *libswdappctx, in
    return LIBSWD_ERROR_DRIVER;
   }
   // Explode read bytes into bit array.
-  for (byte=0;byte*8<bits;byte++)
-   for (bit=0;bit<8;bit++)
-    misodata[byte*8+bit]=buf[byte]&(1<<bit)?1:0;
+  libswd_bin_unpack(misodata, buf, bytes*8);
  }
 
  // Now send remaining bits that cannot be packed as bytes.
@@ -1341,7 +1377,7 @@ int libswdapp_interface_ftdi_transfer_bits(libswdapp_context_t *libswdappctx, in
  */
 int libswdapp_interface_ftdi_transfer_bytes(libswdapp_context_t *libswdappctx, int bytes, char *mosidata, char *misodata, int nLSBfirst)
 {
- static unsigned char buf[65539], databuf;
+ unsigned char *buf;
  int i, retval, byte=0, retry;
  int bytes_written, bytes_read;
  struct ftdi_context *ftdictx=(struct ftdi_context*)libswdappctx->interface->ctx;
@@ -1352,6 +1388,8 @@ int libswdapp_interface_ftdi_transfer_bytes(libswdapp_context_t *libswdappctx, i
              "ERROR: Cannot transfer more than 65536 bits at once!\n");
   return LIBSWD_ERROR_DRIVER;
  }
+ buf=libswdapp_interface_buf(libswdappctx->interface, 65539);
+ if (buf==NULL) return LIBSWD_ERROR_OUTOFMEM;
 
  bytes--;		                  // MPSSE starts counting bytes from 0.
  buf[0] = (nLSBfirst)?0x31:0x39; // Clock Bytes In and Out MSb or LSb first.
@@ -1386,12 +1424,425 @@ int libswdapp_interface_ftdi_transfer_bytes(libswdapp_context_t *libswdappctx, i
  return byte;
 }
 
+/** Append MPSSE Set Data Bits commands that drive bitmask pins to value,
+ * only when cached port state differs. Cache is updated as in bitbang().
+ * \param *interface is the interface to work on.
+ * \param *buf points to the MPSSE command buffer end.
+ * \param bitmask selects pins to drive.
+ * \param value is the new pins value.
+ * \return number of bytes appended to the buffer.
+ */
+static int libswdapp_interface_ftdi_gpio_append(libswdapp_interface_t *interface, unsigned char *buf, unsigned int bitmask, unsigned int value)
+{
+ int len=0;
+ unsigned int gpioval, gpiodir;
+ gpioval = (interface->gpioval & ~bitmask) | (value & bitmask);
+ gpiodir = interface->gpiodir | bitmask;
+ if ((bitmask&0x00ff) && ((gpioval^interface->gpioval)|(gpiodir^interface->gpiodir))&0x00ff)
+ {
+  buf[len++] = 0x80;  // Set Data Bits LowByte.
+  buf[len++] = gpioval&0x00ff;
+  buf[len++] = gpiodir&0x00ff;
+ }
+ if ((bitmask&0xff00) && ((gpioval^interface->gpioval)|(gpiodir^interface->gpiodir))&0xff00)
+ {
+  buf[len++] = 0x82;  // Set Data Bits HighByte.
+  buf[len++] = (gpioval>>8)&0x00ff;
+  buf[len++] = (gpiodir>>8)&0x00ff;
+ }
+ interface->gpioval=gpioval;
+ interface->gpiodir=gpiodir;
+ return len;
+}
+
+/** Transfer packed bits in/out LSB-first, where bit n is the bit (n%8) of
+ * byte (n/8). Whole bytes are passed to the MPSSE as they are, remaining bits
+ * are appended as single bit commands, so one USB write and one USB read
+ * are performed for each call without any bit-per-byte array conversion.
+ * \param *libswdappctx is the application context to work on.
+ * \param bits is the number of bits to transfer.
+ * When rnw is not negative "RnW" signal is set to rnw in the same frame
+ * before clocking, so bus direction switch (TRN) costs no extra USB write.
+ * \param *mosidata pointer to packed data to be send.
+ * \param *misodata pointer to packed data to be received.
+ * \param rnw "RnW" signal value to set first, negative to leave it untouched.
+ * \return number of bits sent on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswdapp_interface_ftdi_transfer_packed(libswdapp_context_t *libswdappctx, int bits, unsigned char *mosidata, unsigned char *misodata, int rnw)
+{
+ unsigned char *buf;
+ int bit, len=0, bytes=bits/8, retry;
+ int bytes_written, bytes_read;
+ struct ftdi_context *ftdictx=(struct ftdi_context*)libswdappctx->interface->ctx;
+ libswdapp_interface_signal_t *sig;
+
+ if (bits>65535)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: Cannot transfer more than 65536 bits at once!\n");
+  return LIBSWD_ERROR_DRIVER;
+ }
+ buf=libswdapp_interface_buf(libswdappctx->interface, 65539+30);
+ if (buf==NULL) return LIBSWD_ERROR_OUTOFMEM;
+
+ if (rnw>=0)
+ {
+  if (!(sig=libswdapp_interface_signal_find(libswdappctx, "RnW")))
+  {
+   libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+              "ERROR: libswdapp_interface_transfer_packed(): Mandatory Interface Signal 'RnW' not defined!\n" );
+   return LIBSWD_ERROR_DRIVER;
+  }
+  len+=libswdapp_interface_ftdi_gpio_append(libswdappctx->interface, buf+len, sig->mask, rnw?sig->mask:0);
+ }
+
+ if (bytes)
+ {
+  buf[len++] = 0x39;                   // Clock Bytes In and Out LSb first.
+  buf[len++] = (bytes-1)&0x0ff;        // MPSSE starts counting bytes from 0.
+  buf[len++] = ((bytes-1)>>8)&0x0ff;
+  memcpy(buf+len, mosidata, bytes);
+  len+=bytes;
+ }
+ for (bit=bytes*8;bit<bits;bit++)
+ {
+  buf[len++] = 0x3b;                   // Clock Bits In and Out LSb first.
+  buf[len++] = 0;                      // One bit per element.
+  buf[len++] = (mosidata[bit/8]&(1<<(bit%8)))?0xff:0;
+ }
+ bytes_written = ftdi_write_data(ftdictx, buf, len);
+ if (bytes_written<0 || bytes_written!=len)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_transfer_packed(): ft2232_write() returns %d not %d!\n",
+             bytes_written, len );
+  return LIBSWD_ERROR_DRIVER;
+ }
+ // This retry is necessary because sometimes FTDI Chip returns 0 bytes.
+ len=bytes+(bits-bytes*8);
+ for (retry=0;retry<LIBSWD_RETRY_COUNT_DEFAULT;retry++)
+ {
+  bytes_read=ftdi_read_data(ftdictx, buf, len);
+  if (bytes_read>0) break;
+ }
+ if (bytes_read<0 || bytes_read!=len)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_transfer_packed(): ft2232_read() returns %d instead %d!\n",
+             bytes_read, len );
+  return LIBSWD_ERROR_DRIVER;
+ }
+ memcpy(misodata, buf, bytes);
+ // FTDI MPSSE returns shift register value, our bit is MSb.
+ if (bits>bytes*8) misodata[bytes]=0;
+ for (bit=bytes*8;bit<bits;bit++)
+  if (buf[bytes+bit-bytes*8]&0x80) misodata[bit/8]|=1<<(bit%8);
+ return bits;
+}
+
+/** Get the interface transfer buffer of at least size bytes, (re)allocated
+ * on demand. Buffer belongs to the interface and not to the function, so
+ * each context (and its thread) works on its own copy. It is freed by the
+ * interface deinit.
+ * \param *interface is the interface to work on.
+ * \param size is the minimal buffer size in bytes.
+ * \return pointer to the buffer, or NULL on allocation failure.
+ */
+unsigned char *libswdapp_interface_buf(libswdapp_interface_t *interface, unsigned int size)
+{
+ unsigned char *buf;
+ if (size<=interface->bufsize) return interface->buf;
+ buf=(unsigned char*)realloc(interface->buf, size);
+ if (buf==NULL) return NULL;
+ interface->buf=buf;
+ interface->bufsize=size;
+ return buf;
+}
+
+/** Transmit the whole batch of clock cycles (see libswd_batch_t) as a single
+ * MPSSE frame, so a complete SWD transfer (Request, TRN, ACK, Data, Parity,
+ * TRN) costs one USB write and one USB read. Cycles with the same direction
+ * are clocked with byte and bit commands, "RnW" signal is switched with GPIO
+ * commands in between, and Send Immediate flushes the response.
+ * \param *libswdappctx is the application context to work on.
+ * \param *batch is the batch to transmit, sampled bits are stored in its miso.
+ * \return number of clock cycles transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswdapp_interface_ftdi_transmit_batch(libswdapp_context_t *libswdappctx, libswd_batch_t *batch)
+{
+ unsigned char *buf, databuf;
+ int i, n, bit, run, bytes, len=0, rlen=0, got, retry, size, dir, pos;
+ int bytes_written, bytes_read;
+ libswdapp_interface_t *interface=libswdappctx->interface;
+ libswdapp_interface_signal_t *sig;
+ struct ftdi_context *ftdictx=(struct ftdi_context*)interface->ctx;
+
+ if (!(sig=libswdapp_interface_signal_find(libswdappctx, "RnW")))
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_transmit_batch(): Mandatory Interface Signal 'RnW' not defined!\n" );
+  return LIBSWD_ERROR_DRIVER;
+ }
+ if (batch->bits==0) return 0;
+
+ // Worst case is a GPIO switch and a bit command for every cycle.
+ size=batch->bits*9+1;
+ buf=libswdapp_interface_buf(interface, size);
+ if (buf==NULL) return LIBSWD_ERROR_OUTOFMEM;
+
+ // Build the frame, each run of cycles in the same direction at once.
+ for (pos=0;pos<batch->bits;pos+=run)
+ {
+  dir=(batch->dir[pos>>3]>>(pos&7))&1;
+  for (run=1;pos+run<batch->bits && run<65536*8;run++)
+   if (((batch->dir[(pos+run)>>3]>>((pos+run)&7))&1)!=dir) break;
+  // Host releases SWDIO buffer for MISO and TRN cycles.
+  len+=libswdapp_interface_ftdi_gpio_append(interface, buf+len, sig->mask, dir?sig->mask:0);
+  bytes=run/8;
+  if (bytes)
+  {
+   buf[len++] = 0x39;                // Clock Bytes In and Out LSb first.
+   buf[len++] = (bytes-1)&0x0ff;     // MPSSE starts counting bytes from 0.
+   buf[len++] = ((bytes-1)>>8)&0x0ff;
+  }
+  for (i=0;i<=bytes;i++)
+  {
+   bit=(i<bytes)?8:run-bytes*8;
+   if (bit==0) break;
+   databuf=0;
+   if (!dir)
+   {
+    for (n=0;n<bit;n++)
+     if (batch->mosi[(pos+i*8+n)>>3]&(1<<((pos+i*8+n)&7))) databuf|=1<<n;
+   }
+   if (i==bytes)
+   {
+    buf[len++] = 0x3b;               // Clock Bits In and Out LSb first.
+    buf[len++] = bit-1;              // MPSSE starts counting bits from 0.
+   }
+   buf[len++] = databuf;
+  }
+  rlen+=bytes+((run-bytes*8)?1:0);
+ }
+ buf[len++] = 0x87;                  // Send Immediate.
+
+ bytes_written = ftdi_write_data(ftdictx, buf, len);
+ if (bytes_written<0 || bytes_written!=len)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_transmit_batch(): ft2232_write() returns %d not %d!\n",
+             bytes_written, len );
+  return LIBSWD_ERROR_DRIVER;
+ }
+ // Response may come in pieces, sometimes FTDI Chip returns 0 bytes.
+ for (got=0,retry=0;got<rlen && retry<LIBSWD_RETRY_COUNT_DEFAULT;retry++)
+ {
+  bytes_read=ftdi_read_data(ftdictx, buf+got, rlen-got);
+  if (bytes_read<0) break;
+  if (bytes_read>0) retry=0;
+  got+=bytes_read;
+ }
+ if (got!=rlen)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_transmit_batch(): ft2232_read() returns %d instead %d!\n",
+             got, rlen );
+  return LIBSWD_ERROR_DRIVER;
+ }
+
+ // Scatter the response back, bit commands return data on MSb side.
+ for (pos=0,len=0;pos<batch->bits;pos+=run)
+ {
+  dir=(batch->dir[pos>>3]>>(pos&7))&1;
+  for (run=1;pos+run<batch->bits && run<65536*8;run++)
+   if (((batch->dir[(pos+run)>>3]>>((pos+run)&7))&1)!=dir) break;
+  bytes=run/8;
+  for (i=0;i*8<run;i++,len++)
+  {
+   bit=(i<bytes)?8:run-bytes*8;
+   databuf=(i<bytes)?buf[len]:buf[len]>>(8-bit);
+   if (!dir) continue;
+   for (n=0;n<bit;n++)
+   {
+    if (databuf&(1<<n)) batch->miso[(pos+i*8+n)>>3]|=1<<((pos+i*8+n)&7);
+    else batch->miso[(pos+i*8+n)>>3]&=~(1<<((pos+i*8+n)&7));
+   }
+  }
+ }
+ return batch->bits;
+}
+
+/** Close the open run of the staged MPSSE frame, see
+ * libswdapp_interface_ftdi_stage_reserve(). Full bytes of the run are clocked
+ * with the byte command, remaining bits with the bit command that returns
+ * them on MSb side, so its response byte is remembered to be aligned later.
+ * \param *interface is the interface to work on.
+ * \return LIBSWD_OK on success, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswdapp_interface_ftdi_stage_close(libswdapp_interface_t *interface)
+{
+ unsigned char *buf=interface->buf;
+ unsigned int *fix, hdr=interface->stage.hdr;
+ int bytes=interface->stage.bits/8, bits=interface->stage.bits%8, size;
+
+ if (interface->stage.bits==0) return LIBSWD_OK;
+ if (bits && interface->stage.fixlen>=interface->stage.fixsize)
+ {
+  size=(interface->stage.fixsize)?interface->stage.fixsize*2:64;
+  fix=(unsigned int*)realloc(interface->stage.fix, size*sizeof(unsigned int));
+  if (fix==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  interface->stage.fix=fix;
+  interface->stage.fixsize=size;
+ }
+ if (bytes)
+ {
+  buf[hdr]   = 0x39;                   // Clock Bytes In and Out LSb first.
+  buf[hdr+1] = (bytes-1)&0x0ff;        // MPSSE starts counting bytes from 0.
+  buf[hdr+2] = ((bytes-1)>>8)&0x0ff;
+  hdr+=3+bytes;
+ }
+ if (bits)
+ {
+  // Remaining bits were staged after the bytes, move them behind the command.
+  buf[hdr+2] = buf[(bytes)?hdr:hdr+3];
+  buf[hdr]   = 0x3b;                   // Clock Bits In and Out LSb first.
+  buf[hdr+1] = bits-1;                 // MPSSE starts counting bits from 0.
+  hdr+=3;
+  interface->stage.fix[interface->stage.fixlen++]=((interface->stage.rxlen+bytes)<<3)|bits;
+ }
+ interface->stage.len=hdr;
+ interface->stage.rxlen+=bytes+((bits)?1:0);
+ interface->stage.bits=0;
+ return LIBSWD_OK;
+}
+
+/** Reserve clock cycles at the end of the staged MPSSE frame, see
+ * libswd_driver_t stage_reserve(). Library stores MOSI data right into the
+ * byte command of the frame buffer, consecutive reservations in the same
+ * direction share one run, "RnW" is switched with GPIO commands in between.
+ * \param *libswdappctx is the application context to work on.
+ * \param bits is the number of clock cycles to reserve (1..32).
+ * \param miso is non-zero when host releases SWDIO for these cycles.
+ * \param **mosi is set to the frame byte that holds the first cycle data.
+ * \param *mosipos is set to the bit of that byte.
+ * \return response bit position of the cycles, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswdapp_interface_ftdi_stage_reserve(libswdapp_context_t *libswdappctx, int bits, int miso, unsigned char **mosi, int *mosipos)
+{
+ unsigned char *buf;
+ int res, rxpos;
+ libswdapp_interface_t *interface=libswdappctx->interface;
+ libswdapp_interface_signal_t *sig;
+
+ if (bits<1 || bits>32) return LIBSWD_ERROR_PARAM;
+ miso=(miso)?1:0;
+ if (interface->stage.cycles==0)
+ {
+  if (!(sig=libswdapp_interface_signal_find(libswdappctx, "RnW")))
+  {
+   libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+              "ERROR: libswdapp_interface_stage_reserve(): Mandatory Interface Signal 'RnW' not defined!\n" );
+   return LIBSWD_ERROR_DRIVER;
+  }
+  interface->stage.mask=sig->mask;
+  interface->stage.gpioval=interface->gpioval;
+  interface->stage.gpiodir=interface->gpiodir;
+ }
+ // Run ends on direction change or when byte command counter is full.
+ if (interface->stage.bits && (miso!=interface->stage.dir || interface->stage.bits+bits>65536*8))
+ {
+  res=libswdapp_interface_ftdi_stage_close(interface);
+  if (res<0) return res;
+ }
+ // Worst case is a GPIO switch, both command headers and Send Immediate.
+ buf=libswdapp_interface_buf(interface, interface->stage.len+6+5+(interface->stage.bits+bits)/8+2);
+ if (buf==NULL) return LIBSWD_ERROR_OUTOFMEM;
+ if (interface->stage.bits==0)
+ {
+  interface->stage.len+=libswdapp_interface_ftdi_gpio_append(interface, buf+interface->stage.len, interface->stage.mask, miso?interface->stage.mask:0);
+  interface->stage.hdr=interface->stage.len;
+  interface->stage.dir=miso;
+ }
+ *mosi=buf+interface->stage.hdr+3+interface->stage.bits/8;
+ *mosipos=interface->stage.bits%8;
+ rxpos=interface->stage.rxlen*8+interface->stage.bits;
+ interface->stage.bits+=bits;
+ interface->stage.cycles+=bits;
+ return rxpos;
+}
+
+/** Transmit the staged MPSSE frame, see libswd_driver_t stage_commit().
+ * Response is read into the frame buffer and bytes of the bit commands are
+ * aligned to LSb, so library decodes captured bits from there in place.
+ * \param *libswdappctx is the application context to work on.
+ * \param **miso is set to the response, NULL discards the staged frame.
+ * \return number of clock cycles transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswdapp_interface_ftdi_stage_commit(libswdapp_context_t *libswdappctx, unsigned char **miso)
+{
+ unsigned char *buf;
+ int i, len, rlen, got, retry, res;
+ int bytes_written, bytes_read;
+ libswdapp_interface_t *interface=libswdappctx->interface;
+ struct ftdi_context *ftdictx=(struct ftdi_context*)interface->ctx;
+
+ res=libswdapp_interface_ftdi_stage_close(interface);
+ if (res>=0) res=interface->stage.cycles;
+ buf=interface->buf;
+ len=interface->stage.len;
+ rlen=interface->stage.rxlen;
+ interface->stage.len=0;
+ interface->stage.rxlen=0;
+ interface->stage.cycles=0;
+ if (miso==NULL || res<=0)
+ {
+  // Nothing was sent, port state is the one before the frame.
+  interface->gpioval=interface->stage.gpioval;
+  interface->gpiodir=interface->stage.gpiodir;
+  interface->stage.bits=0;
+  interface->stage.fixlen=0;
+  return res;
+ }
+ buf[len++] = 0x87;                  // Send Immediate.
+
+ bytes_written = ftdi_write_data(ftdictx, buf, len);
+ if (bytes_written<0 || bytes_written!=len)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_stage_commit(): ft2232_write() returns %d not %d!\n",
+             bytes_written, len );
+  interface->stage.fixlen=0;
+  return LIBSWD_ERROR_DRIVER;
+ }
+ // Response may come in pieces, sometimes FTDI Chip returns 0 bytes.
+ for (got=0,retry=0;got<rlen && retry<LIBSWD_RETRY_COUNT_DEFAULT;retry++)
+ {
+  bytes_read=ftdi_read_data(ftdictx, buf+got, rlen-got);
+  if (bytes_read<0) break;
+  if (bytes_read>0) retry=0;
+  got+=bytes_read;
+ }
+ if (got!=rlen)
+ {
+  libswd_log(libswdappctx->libswdctx, LIBSWD_LOGLEVEL_ERROR,
+             "ERROR: libswdapp_interface_stage_commit(): ft2232_read() returns %d instead %d!\n",
+             got, rlen );
+  interface->stage.fixlen=0;
+  return LIBSWD_ERROR_DRIVER;
+ }
+ // Bit commands return data on MSb side.
+ for (i=0;i<interface->stage.fixlen;i++)
+  buf[interface->stage.fix[i]>>3]>>=8-(interface->stage.fix[i]&7);
+ interface->stage.fixlen=0;
+ *miso=buf;
+ return res;
+}
+
 int libswdapp_interface_ftdi_init(libswdapp_context_t *libswdappctx)
 {
  int retval;
  int ftdi_channel=INTERFACE_ANY;
  unsigned char latency_timer;
- static unsigned int port_direction, port_value;
  libswd_ctx_t *libswdctx=(libswd_ctx_t*)libswdappctx->libswdctx;
  struct ftdi_context *ftdictx=(struct ftdi_context*)libswdappctx->interface->ctx;
 
@@ -1598,6 +2049,11 @@ int libswdapp_interface_ftdi_deinit(libswdapp_context_t *libswdappctx)
  struct ftdi_context *ftdictx=(struct ftdi_context*)libswdappctx->interface->ctx;
  libswdappctx->interface->bitbang(libswdappctx, dir, 1, &val); 
  ftdi_deinit(ftdictx);
+ free(libswdappctx->interface->buf);
+ libswdappctx->interface->buf=NULL;
+ libswdappctx->interface->bufsize=0;
+ free(libswdappctx->interface->stage.fix);
+ memset(&libswdappctx->interface->stage, 0, sizeof(libswdapp_interface_stage_t));
  return LIBSWD_OK;
 } 
 
@@ -1629,10 +2085,10 @@ int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
  if (bits<0 || bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[8], mosidata[8];
+ unsigned int i;
+ signed int res;
  libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+ char *mosidata=interface->mosidata, *misodata=interface->misodata;
 
  // Split output data into char array.
  for (i=0;i<8;i++)
@@ -1666,10 +2122,10 @@ int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static unsigned int i;
- static signed int res;
- static char misodata[32], mosidata[32];
+ unsigned int i;
+ signed int res;
  libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+ char *mosidata=interface->mosidata, *misodata=interface->misodata;
 
  // UrJTAG drivers shift data LSB-First.
  for (i=0;i<32;i++)
@@ -1696,10 +2152,10 @@ int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, in
  if (bits<0 || bits>8) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static int i;
- static signed int res;
- static char misodata[8], mosidata[8];
+ int i;
+ signed int res;
  libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+ char *mosidata=interface->mosidata, *misodata=interface->misodata;
 
  res=interface->transfer_bits(libswdctx->driver->ctx,bits,mosidata,misodata,LIBSWD_DIR_LSBFIRST);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -1732,10 +2188,10 @@ int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
  if (nLSBfirst!=0 && nLSBfirst!=1) return LIBSWD_ERROR_PARAM;
 
- static int i;
- static signed int res;
- static char misodata[32], mosidata[32];
+ int i;
+ signed int res;
  libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+ char *mosidata=interface->mosidata, *misodata=interface->misodata;
 
  res = interface->transfer_bits(libswdctx->driver->ctx, bits, mosidata, misodata, LIBSWD_DIR_LSBFIRST);
  if (res<0) return LIBSWD_ERROR_DRIVER;
@@ -1750,6 +2206,111 @@ int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, in
  return res;
 }
 
+/**
+ * Driver code to write packed bits, see libswd_driver_t mosi_packed().
+ * MOSI (Master Output Slave Input) is a SWD Write Operation.
+ * Output buffers are enabled ("RnW" low) in the same interface frame.
+ *
+ * \param *libswdctx swd context to work on.
+ * \param *cmd point to the actual command being sent.
+ * \param *data points to the packed LSB-first data.
+ * \param bits tells how many bits to send.
+ * \return data count transferred, or negative LIBSWD_ERROR code on failure.
+ */
+int libswdapp_drv_mosi_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits)
+{
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ int res;
+ libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+
+ if (bits<0 || bits>(int)sizeof(interface->misodata)*8) return LIBSWD_ERROR_PARAM;
+ res=interface->transfer_packed(libswdctx->driver->ctx, bits, data, (unsigned char*)interface->misodata, 0);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ return res;
+}
+
+/**
+ * Driver code to read packed bits, see libswd_driver_t miso_packed().
+ * MISO (Master Input Slave Output) is a SWD Read Operation.
+ * Output buffers are released ("RnW" high) in the same interface frame,
+ * so TRN cycles are clocked here as well.
+ *
+ * \param *libswdctx swd context to work on.
+ * \param *cmd point to the actual command being sent.
+ * \param *data points to the packed LSB-first data buffer.
+ * \param bits tells how many bits to receive.
+ * \return data count transferred, or negative LIBSWD_ERROR code on failure.
+ */
+int libswdapp_drv_miso_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits)
+{
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0) return LIBSWD_ERROR_PARAM;
+
+ int res;
+ libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+
+ // Target drives the line, output data does not matter.
+ memset(data, 0, (bits+7)/8);
+ res=interface->transfer_packed(libswdctx->driver->ctx, bits, data, data, 1);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ return res;
+}
+
+/**
+ * Driver code to transmit a batch of clock cycles, see libswd_driver_t
+ * transmit_batch(). Interface sends the batch as a single frame.
+ *
+ * \param *libswdctx swd context to work on.
+ * \param *batch points to the batch to transmit.
+ * \return number of clock cycles transmitted, or negative LIBSWD_ERROR code on failure.
+ */
+int libswdapp_drv_transmit_batch(libswd_ctx_t *libswdctx, libswd_batch_t *batch)
+{
+ if (batch==NULL) return LIBSWD_ERROR_NULLPOINTER;
+
+ int res;
+ libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+
+ res=interface->transmit_batch(libswdctx->driver->ctx, batch);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ return res;
+}
+
+/**
+ * Driver code to stage clock cycles, see libswd_driver_t stage_reserve().
+ * Library stores MOSI data straight into the interface frame buffer.
+ *
+ * \param *libswdctx swd context to work on.
+ * \param bits tells how many clock cycles to reserve.
+ * \param miso is non-zero when SWDIO is released for these cycles.
+ * \param **mosi is set to the frame byte for the first cycle data.
+ * \param *mosipos is set to the bit of that byte.
+ * \return receive buffer bit position, or negative LIBSWD_ERROR code on failure.
+ */
+int libswdapp_drv_stage_reserve(libswd_ctx_t *libswdctx, int bits, int miso, unsigned char **mosi, int *mosipos)
+{
+ if (mosi==NULL || mosipos==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+ return interface->stage_reserve(libswdctx->driver->ctx, bits, miso, mosi, mosipos);
+}
+
+/**
+ * Driver code to send the staged frame, see libswd_driver_t stage_commit().
+ *
+ * \param *libswdctx swd context to work on.
+ * \param **miso is set to the receive buffer, NULL discards the frame.
+ * \return number of clock cycles transmitted, or negative LIBSWD_ERROR code on failure.
+ */
+int libswdapp_drv_stage_commit(libswd_ctx_t *libswdctx, unsigned char **miso)
+{
+ int res;
+ libswdapp_interface_t *interface=(libswdapp_interface_t*)libswdctx->driver->interface;
+
+ res=interface->stage_commit(libswdctx->driver->ctx, miso);
+ if (res<0) return LIBSWD_ERROR_DRIVER;
+ return res;
+}
+
 /**
  * This function sets interface buffers to MOSI direction.
  * MOSI (Master Output Slave Input) is a SWD Write operation.
@@ -1780,9 +2341,9 @@ int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits)
   return LIBSWD_ERROR_DRIVER;
  }
 
- static int res;
- static unsigned int val = 0;
- static char buf[LIBSWD_TURNROUND_MAX_VAL];
+ int res;
+ unsigned int val = 0;
+ char buf[LIBSWD_TURNROUND_MAX_VAL]={0};
  // Use driver method to set low (write) signal named RnW.
  res = interface->bitbang(libswdctx->driver->ctx, sig->mask, 0, &val);
  if (res < 0) return LIBSWD_ERROR_DRIVER;
@@ -1825,9 +2386,9 @@ int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits)
   return LIBSWD_ERROR_DRIVER;
  }
 
- static int res;
- static unsigned int val = 1;
- static char buf[LIBSWD_TURNROUND_MAX_VAL];
+ int res;
+ unsigned int val = 1;
+ char buf[LIBSWD_TURNROUND_MAX_VAL]={0};
 
  // Use driver method to set high (read) signal named RnW.
  res = interface->bitbang(libswdctx->driver->ctx, sig->mask, 1, &val);
@@ -1895,6 +2456,26 @@ static int libswdapp_interface_aftdi_transfer_bytes(libswdapp_context_t *libswda
  return LIBSWD_ERROR_UNSUPPORTED;
 }
 
+static int libswdapp_interface_aftdi_transfer_packed(libswdapp_context_t *libswdappctx, int bits, unsigned char *mosidata, unsigned char *misodata, int rnw)
+{
+ return LIBSWD_ERROR_UNSUPPORTED;
+}
+
+static int libswdapp_interface_aftdi_transmit_batch(libswdapp_context_t *libswdappctx, libswd_batch_t *batch)
+{
+ return LIBSWD_ERROR_UNSUPPORTED;
+}
+
+static int libswdapp_interface_aftdi_stage_reserve(libswdapp_context_t *libswdappctx, int bits, int miso, unsigned char **mosi, int *mosipos)
+{
+ return LIBSWD_ERROR_UNSUPPORTED;
+}
+
+static int libswdapp_interface_aftdi_stage_commit(libswdapp_context_t *libswdappctx, unsigned char **miso)
+{
+ return LIBSWD_ERROR_UNSUPPORTED;
+}
+
 
 
 /** @} */
@@ -58,6 +58,20 @@ typedef struct libswdapp_interface_signal {
 	struct libswdapp_interface_signal *next; /// Next signal on the list.
 } libswdapp_interface_signal_t;
 
+/** MPSSE frame staged by the library, see libswdapp_interface_ftdi_stage_reserve(). */
+typedef struct libswdapp_interface_stage {
+ unsigned int len;     /// Frame length in bytes, up to the open run.
+ unsigned int hdr;     /// Command header offset of the open run.
+ unsigned int rxlen;   /// Response length in bytes, up to the open run.
+ int bits;             /// Clock cycles in the open run, 0 if none.
+ int dir;              /// Open run direction, 1 when "RnW" releases SWDIO.
+ int cycles;           /// Clock cycles staged in the frame.
+ unsigned int mask;    /// "RnW" signal mask.
+ unsigned int gpioval, gpiodir; /// Cached port state before the frame.
+ unsigned int *fix;    /// Response offset<<3|bits of each bit command.
+ int fixlen, fixsize;  /// Used and allocated length of *fix.
+} libswdapp_interface_stage_t;
+
 typedef struct libswdapp_context {
  libswd_ctx_t *libswdctx;
  struct libswdapp_interface *interface; 
@@ -78,6 +92,10 @@ typedef struct libswdapp_interface {
  int (*bitbang)(libswdapp_context_t *libswdappctx, unsigned int bitmask, int GETnSET, unsigned int *value);
  int (*transfer_bits)(libswdapp_context_t *libswdappctx, int bits, char *mosidata, char *misodata, int nLSBfirst);
  int (*transfer_bytes)(libswdapp_context_t *libswdappctx, int bytes, char *mosidata, char *misodata, int nLSBfirst);
+ int (*transfer_packed)(libswdapp_context_t *libswdappctx, int bits, unsigned char *mosidata, unsigned char *misodata, int rnw);
+ int (*transmit_batch)(libswdapp_context_t *libswdappctx, libswd_batch_t *batch);
+ int (*stage_reserve)(libswdapp_context_t *libswdappctx, int bits, int miso, unsigned char **mosi, int *mosipos);
+ int (*stage_commit)(libswdapp_context_t *libswdappctx, unsigned char **miso);
  char *sigsetupstr;
  // Below are CACHED values changed only by the interface functions.
 
@@ -88,6 +106,11 @@ typedef struct libswdapp_interface {
  unsigned int chunksize;
  char initialized;
  unsigned int gpioval, gpiodir;
+ // Below are driver scratch buffers, one set per interface (and context).
+ unsigned char *buf; /// Transfer buffer, see libswdapp_interface_buf().
+ unsigned int bufsize; /// Allocated size of the transfer buffer.
+ char mosidata[32], misodata[32]; /// Bit arrays of the MOSI/MISO drivers.
+ libswdapp_interface_stage_t stage; /// Frame staged in the transfer buffer.
 } libswdapp_interface_t;
 
 typedef struct libswdapp_interface_config {
@@ -100,6 +123,10 @@ typedef struct libswdapp_interface_config {
  int (*bitbang)(libswdapp_context_t *libswdappctx, unsigned int bitmask, int GETnSET, unsigned int *value);
  int (*transfer_bits)(libswdapp_context_t *libswdappctx, int bits, char *mosidata, char *misodata, int nLSBfirst);
  int (*transfer_bytes)(libswdapp_context_t *libswdappctx, int bytes, char *mosidata, char *misodata, int nLSBfirst);
+ int (*transfer_packed)(libswdapp_context_t *libswdappctx, int bits, unsigned char *mosidata, unsigned char *misodata, int rnw);
+ int (*transmit_batch)(libswdapp_context_t *libswdappctx, libswd_batch_t *batch);
+ int (*stage_reserve)(libswdapp_context_t *libswdappctx, int bits, int miso, unsigned char **mosi, int *mosipos);
+ int (*stage_commit)(libswdapp_context_t *libswdappctx, unsigned char **miso);
  int vid, pid;
  unsigned char latency;
  int frequency, maxfrequency;
@@ -128,11 +155,17 @@ int libswdapp_handle_command_signal(libswdapp_context_t *libswdappctx, char *cmd
 int libswdapp_handle_command_interface_init(libswdapp_context_t *libswdappctx, char *cmd);
 int libswdapp_handle_command_flash_usage(void);
 int libswdapp_handle_command_flash(libswdapp_context_t *libswdappctx, char *command);
+unsigned char *libswdapp_interface_buf(libswdapp_interface_t *interface, unsigned int size);
 
 int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
 int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
 int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
 int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
+int libswdapp_drv_mosi_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits);
+int libswdapp_drv_miso_packed(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, unsigned char *data, int bits);
+int libswdapp_drv_transmit_batch(libswd_ctx_t *libswdctx, libswd_batch_t *batch);
+int libswdapp_drv_stage_reserve(libswd_ctx_t *libswdctx, int bits, int miso, unsigned char **mosi, int *mosipos);
+int libswdapp_drv_stage_commit(libswd_ctx_t *libswdctx, unsigned char **miso);
 int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int clks);
 int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int clks);
 
@@ -143,6 +176,10 @@ static int libswdapp_interface_ftdi_set_freq(libswdapp_context_t *libswdappctx,
 static int libswdapp_interface_ftdi_bitbang(libswdapp_context_t *libswdappctx, unsigned int bitmask, int GETnSET, unsigned int *value);
 static int libswdapp_interface_ftdi_transfer_bits(libswdapp_context_t *libswdappctx, int bits, char *mosidata, char *misodata, int nLSBfirst);
 static int libswdapp_interface_ftdi_transfer_bytes(libswdapp_context_t *libswdappctx, int bytes, char *mosidata, char *misodata, int nLSBfirst);
+static int libswdapp_interface_ftdi_transfer_packed(libswdapp_context_t *libswdappctx, int bits, unsigned char *mosidata, unsigned char *misodata, int rnw);
+static int libswdapp_interface_ftdi_transmit_batch(libswdapp_context_t *libswdappctx, libswd_batch_t *batch);
+static int libswdapp_interface_ftdi_stage_reserve(libswdapp_context_t *libswdappctx, int bits, int miso, unsigned char **mosi, int *mosipos);
+static int libswdapp_interface_ftdi_stage_commit(libswdapp_context_t *libswdappctx, unsigned char **miso);
 
 static int libswdapp_interface_aftdi_init(libswdapp_context_t *libswdappctx);
 static int libswdapp_interface_aftdi_deinit(libswdapp_context_t *libswdappctx);
@@ -151,6 +188,10 @@ static int libswdapp_interface_aftdi_set_freq(libswdapp_context_t *libswdappctx,
 static int libswdapp_interface_aftdi_bitbang(libswdapp_context_t *libswdappctx, unsigned int bitmask, int GETnSET, unsigned int *value);
 static int libswdapp_interface_aftdi_transfer_bits(libswdapp_context_t *libswdappctx, int bits, char *mosidata, char *misodata, int nLSBfirst);
 static int libswdapp_interface_aftdi_transfer_bytes(libswdapp_context_t *libswdappctx, int bytes, char *mosidata, char *misodata, int nLSBfirst);
+static int libswdapp_interface_aftdi_transfer_packed(libswdapp_context_t *libswdappctx, int bits, unsigned char *mosidata, unsigned char *misodata, int rnw);
+static int libswdapp_interface_aftdi_transmit_batch(libswdapp_context_t *libswdappctx, libswd_batch_t *batch);
+static int libswdapp_interface_aftdi_stage_reserve(libswdapp_context_t *libswdappctx, int bits, int miso, unsigned char **mosi, int *mosipos);
+static int libswdapp_interface_aftdi_stage_commit(libswdapp_context_t *libswdappctx, unsigned char **miso);
 
 int libswd_log(libswd_ctx_t *libswdctx, libswd_loglevel_t loglevel, char *msg, ...);
 
@@ -164,6 +205,10 @@ static const libswdapp_interface_config_t libswdapp_interface_configs[] = {
   .bitbang        = libswdapp_interface_ftdi_bitbang,
   .transfer_bits  = libswdapp_interface_ftdi_transfer_bits,
   .transfer_bytes = libswdapp_interface_ftdi_transfer_bytes, 
+  .transfer_packed= libswdapp_interface_ftdi_transfer_packed,
+  .transmit_batch = libswdapp_interface_ftdi_transmit_batch,
+  .stage_reserve  = libswdapp_interface_ftdi_stage_reserve,
+  .stage_commit   = libswdapp_interface_ftdi_stage_commit,
   .vid            = 0x0403,
   .pid            = 0xbbe2, 
   .latency        = 1,
@@ -181,6 +226,10 @@ static const libswdapp_interface_config_t libswdapp_interface_configs[] = {
   .bitbang        = libswdapp_interface_aftdi_bitbang,
   .transfer_bits  = libswdapp_interface_aftdi_transfer_bits,
   .transfer_bytes = libswdapp_interface_aftdi_transfer_bytes, 
+  .transfer_packed= libswdapp_interface_aftdi_transfer_packed,
+  .transmit_batch = libswdapp_interface_aftdi_transmit_batch,
+  .stage_reserve  = libswdapp_interface_aftdi_stage_reserve,
+  .stage_commit   = libswdapp_interface_aftdi_stage_commit,
   .vid            = 0x0403,
   .pid            = 0xbbe2, 
   .latency        = 1,
@@ -35,12 +35,28 @@
 /** \file libswd_bin.c */
 
 #include <libswd.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBSWD_BIN_X86
+#include <immintrin.h>
+#endif
 
 /*******************************************************************************
  * \defgroup libswd_bin Binary operations helper functions.
  * @{
  ******************************************************************************/
 
+/** Even parity of the low 32 bits folded down to a nibble, then looked up in
+ * 0x6996 (parity of each 4-bit value), so it takes the same time for any data.
+ */
+static inline int libswd_bin_parity_fold(unsigned int test){
+ test^=test>>16;
+ test^=test>>8;
+ test^=test>>4;
+ return (0x6996>>(test&0x0f))&1;
+}
+
 /**
  * Data parity calculator, calculates even parity on char type.
  * \param *data source data pointer.
@@ -48,11 +64,7 @@
  * \return negative value on error, 0 or 1 as parity result.
  */
 int libswd_bin8_parity_even(char *data, char *parity){
- char i;
- unsigned char test=*data;
- *parity=0;
- for (i=0;i<=8;i++) *parity ^= ((test>>i)&1);
- if (*parity<0 || *parity>1) return LIBSWD_ERROR_PARITY;
+ *parity=libswd_bin_parity_fold((unsigned char)*data);
  return (int)*parity;
 }
 
@@ -63,11 +75,7 @@ int libswd_bin8_parity_even(char *data, char *parity){
  * \return negative value on error, 0 or 1 as parity result.
  */
 int libswd_bin32_parity_even(int *data, char *parity){
- int i;
- unsigned int test=*data;
- *parity=0;
- for (i=0;i<32;i++) *parity ^= ((test>>i)&1); 
- if (*parity<0 || *parity>1) return LIBSWD_ERROR_PARITY;
+ *parity=libswd_bin_parity_fold((unsigned int)*data);
  return (int)*parity;
 }
 
@@ -96,10 +104,10 @@ int libswd_bin32_print(int *data){
 /**
  * Generates string containing binary data of a char value.
  * \param *data source data pointer.
- * \return pointer to the resulting string.
+ * \return pointer to the resulting string (thread local, overwritten by the next call).
  */
 char *libswd_bin8_string(char *data){
- static char string[9]; string[8]=0;
+ static LIBSWD_THREADLOCAL char string[9]; string[8]=0;
  unsigned char i, bits=*data;
  for (i=0;i<8;i++) string[7-i]=(bits&(1<<i))?'1':'0'; 
  return string;
@@ -108,10 +116,10 @@ char *libswd_bin8_string(char *data){
 /**
  * Generates string containing binary data of an integer value.
  * \param *data source data pointer.
- * \return pointer to the resulting string.
+ * \return pointer to the resulting string (thread local, overwritten by the next call).
  */
 char *libswd_bin32_string(int *data){
- static char string[33]; string[32]=0;
+ static LIBSWD_THREADLOCAL char string[33]; string[32]=0;
  unsigned int i, bits=*data;
  for (i=0;i<32;i++) string[31-i]=(bits&(1<<i))?'1':'0';
  return string;
@@ -167,4 +175,250 @@ int libswd_bin32_bitswap(unsigned int *buffer, int bitcount){
  return bit;
 }
 
+/*******************************************************************************
+ * Bit-per-char <-> packed conversion and batched parity kernels. Packed
+ * buffers are LSB-first, bit n of the stream lives in bit (n%8) of byte (n/8).
+ * Unused bits of the last packed byte are cleared. Best kernel is selected at
+ * first use.
+ ******************************************************************************/
+
+typedef int (*libswd_bin_pack_kernel_t)(unsigned char *packed, char *bits, int count);
+typedef int (*libswd_bin_unpack_kernel_t)(char *bits, unsigned char *packed, int count);
+typedef int (*libswd_bin_verify_kernel_t)(int *data, char *parity, int count);
+
+/** Portable packer, starts at bit position from (must be multiple of 8). */
+static int libswd_bin_pack_generic(unsigned char *packed, char *bits, int from, int count){
+ int i, bit;
+ unsigned char byte;
+ for (i=from;i<count;i+=8){
+  byte=0;
+  for (bit=0;bit<8 && i+bit<count;bit++) byte|=(bits[i+bit]!=0)<<bit;
+  packed[i>>3]=byte;
+ }
+ return count;
+}
+
+/** Portable unpacker, starts at bit position from (must be multiple of 8). */
+static int libswd_bin_unpack_generic(char *bits, unsigned char *packed, int from, int count){
+ int i, bit;
+ unsigned char byte;
+ for (i=from;i<count;i+=8){
+  byte=packed[i>>3];
+  for (bit=0;bit<8 && i+bit<count;bit++) bits[i+bit]=(byte>>bit)&1;
+ }
+ return count;
+}
+
+/** Portable parity verifier, starts at element from. */
+static int libswd_bin_verify_generic(int *data, char *parity, int from, int count){
+ int i;
+ for (i=from;i<count;i++)
+  if (libswd_bin_parity_fold((unsigned int)data[i])!=parity[i]) break;
+ return i;
+}
+
+static int libswd_bin_verify_portable(int *data, char *parity, int count){
+ return libswd_bin_verify_generic(data, parity, 0, count);
+}
+
+static int libswd_bin_pack_portable(unsigned char *packed, char *bits, int count){
+ return libswd_bin_pack_generic(packed, bits, 0, count);
+}
+
+static int libswd_bin_unpack_portable(char *bits, unsigned char *packed, int count){
+ return libswd_bin_unpack_generic(bits, packed, 0, count);
+}
+
+#ifdef LIBSWD_BIN_X86
+/** SSE2 packer: compare 16 chars against zero and collect them with movemask. */
+__attribute__((target("sse2")))
+static int libswd_bin_pack_sse2(unsigned char *packed, char *bits, int count){
+ int i, mask;
+ __m128i zero=_mm_setzero_si128();
+ for (i=0;i+16<=count;i+=16){
+  mask=~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(bits+i)), zero));
+  packed[(i>>3)+0]=mask;
+  packed[(i>>3)+1]=mask>>8;
+ }
+ return libswd_bin_pack_generic(packed, bits, i, count);
+}
+
+/** SSE2 unpacker: replicate 2 bytes across 8 lanes each and test one bit per lane. */
+__attribute__((target("sse2")))
+static int libswd_bin_unpack_sse2(char *bits, unsigned char *packed, int count){
+ int i;
+ __m128i x, bitmask=_mm_set1_epi64x(0x8040201008040201LL), one=_mm_set1_epi8(1);
+ for (i=0;i+16<=count;i+=16){
+  x=_mm_cvtsi32_si128(packed[i>>3]|(packed[(i>>3)+1]<<8));
+  x=_mm_unpacklo_epi8(x, x);
+  x=_mm_unpacklo_epi16(x, x);
+  x=_mm_unpacklo_epi32(x, x);
+  x=_mm_cmpeq_epi8(_mm_and_si128(x, bitmask), bitmask);
+  _mm_storeu_si128((__m128i*)(bits+i), _mm_and_si128(x, one));
+ }
+ return libswd_bin_unpack_generic(bits, packed, i, count);
+}
+
+/** SSE2 parity verifier: fold 4 words at once and compare with 4 parity chars. */
+__attribute__((target("sse2")))
+static int libswd_bin_verify_sse2(int *data, char *parity, int count){
+ int i, p;
+ __m128i x, y, zero=_mm_setzero_si128(), one=_mm_set1_epi32(1);
+ for (i=0;i+4<=count;i+=4){
+  x=_mm_loadu_si128((__m128i*)(data+i));
+  x=_mm_xor_si128(x, _mm_srli_epi32(x, 16));
+  x=_mm_xor_si128(x, _mm_srli_epi32(x, 8));
+  x=_mm_xor_si128(x, _mm_srli_epi32(x, 4));
+  x=_mm_xor_si128(x, _mm_srli_epi32(x, 2));
+  x=_mm_xor_si128(x, _mm_srli_epi32(x, 1));
+  x=_mm_and_si128(x, one);
+  memcpy(&p, parity+i, 4);
+  y=_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(p), zero), zero);
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(x, y))!=0xffff) break;
+ }
+ return libswd_bin_verify_generic(data, parity, i, count);
+}
+
+/** AVX2 packer: 32 chars per movemask. */
+__attribute__((target("avx2")))
+static int libswd_bin_pack_avx2(unsigned char *packed, char *bits, int count){
+ int i;
+ unsigned int mask;
+ __m256i zero=_mm256_setzero_si256();
+ for (i=0;i+32<=count;i+=32){
+  mask=~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(bits+i)), zero));
+  memcpy(packed+(i>>3), &mask, 4);
+ }
+ return libswd_bin_pack_generic(packed, bits, i, count);
+}
+
+/** AVX2 unpacker: pshufb spreads 4 packed bytes into 32 lanes, then one bit per lane is tested. */
+__attribute__((target("avx2")))
+static int libswd_bin_unpack_avx2(char *bits, unsigned char *packed, int count){
+ int i, word;
+ __m256i x, bitmask=_mm256_set1_epi64x(0x8040201008040201LL), one=_mm256_set1_epi8(1);
+ __m256i spread=_mm256_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,
+                                 2,2,2,2,2,2,2,2,3,3,3,3,3,3,3,3);
+ for (i=0;i+32<=count;i+=32){
+  memcpy(&word, packed+(i>>3), 4);
+  x=_mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+  x=_mm256_cmpeq_epi8(_mm256_and_si256(x, bitmask), bitmask);
+  _mm256_storeu_si256((__m256i*)(bits+i), _mm256_and_si256(x, one));
+ }
+ return libswd_bin_unpack_generic(bits, packed, i, count);
+}
+
+/** AVX2 parity verifier: 8 words per pass. */
+__attribute__((target("avx2")))
+static int libswd_bin_verify_avx2(int *data, char *parity, int count){
+ int i;
+ __m256i x, y, one=_mm256_set1_epi32(1);
+ for (i=0;i+8<=count;i+=8){
+  x=_mm256_loadu_si256((__m256i*)(data+i));
+  x=_mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+  x=_mm256_xor_si256(x, _mm256_srli_epi32(x, 8));
+  x=_mm256_xor_si256(x, _mm256_srli_epi32(x, 4));
+  x=_mm256_xor_si256(x, _mm256_srli_epi32(x, 2));
+  x=_mm256_xor_si256(x, _mm256_srli_epi32(x, 1));
+  x=_mm256_and_si256(x, one);
+  y=_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(parity+i)));
+  if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(x, y))!=-1) break;
+ }
+ return libswd_bin_verify_generic(data, parity, i, count);
+}
+#endif
+
+static int libswd_bin_pack_select(unsigned char *packed, char *bits, int count);
+static int libswd_bin_unpack_select(char *bits, unsigned char *packed, int count);
+static int libswd_bin_verify_select(int *data, char *parity, int count);
+static libswd_bin_pack_kernel_t libswd_bin_pack_kernel=libswd_bin_pack_select;
+static libswd_bin_unpack_kernel_t libswd_bin_unpack_kernel=libswd_bin_unpack_select;
+static libswd_bin_verify_kernel_t libswd_bin_verify_kernel=libswd_bin_verify_select;
+
+/** Pick the best kernels for the running CPU. GCC runs it at load time, so
+ * threads never race on the kernel pointers, otherwise it runs on first use.
+ */
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void libswd_bin_kernel_select(void){
+ libswd_bin_pack_kernel_t pack=libswd_bin_pack_portable;
+ libswd_bin_unpack_kernel_t unpack=libswd_bin_unpack_portable;
+ libswd_bin_verify_kernel_t verify=libswd_bin_verify_portable;
+#ifdef LIBSWD_BIN_X86
+ __builtin_cpu_init();
+ if (__builtin_cpu_supports("avx2")){
+  pack=libswd_bin_pack_avx2;
+  unpack=libswd_bin_unpack_avx2;
+  verify=libswd_bin_verify_avx2;
+ } else if (__builtin_cpu_supports("sse2")){
+  pack=libswd_bin_pack_sse2;
+  unpack=libswd_bin_unpack_sse2;
+  verify=libswd_bin_verify_sse2;
+ }
+#endif
+ libswd_bin_pack_kernel=pack;
+ libswd_bin_unpack_kernel=unpack;
+ libswd_bin_verify_kernel=verify;
+}
+
+static int libswd_bin_pack_select(unsigned char *packed, char *bits, int count){
+ libswd_bin_kernel_select();
+ return libswd_bin_pack_kernel(packed, bits, count);
+}
+
+static int libswd_bin_unpack_select(char *bits, unsigned char *packed, int count){
+ libswd_bin_kernel_select();
+ return libswd_bin_unpack_kernel(bits, packed, count);
+}
+
+static int libswd_bin_verify_select(int *data, char *parity, int count){
+ libswd_bin_kernel_select();
+ return libswd_bin_verify_kernel(data, parity, count);
+}
+
+/**
+ * Pack bit-per-char array into LSB-first packed bytes (nonzero char is 1).
+ * Uses SSE2/AVX2 kernel when running CPU supports it, portable loop otherwise.
+ * \param *packed destination buffer of at least (count+7)/8 bytes.
+ * \param *bits source array of count chars, one bit each.
+ * \param count number of bits to pack.
+ * \return number of bits packed (positive) or error code (negative).
+ */
+int libswd_bin_pack(unsigned char *packed, char *bits, int count){
+ if (packed==NULL || bits==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (count<0) return LIBSWD_ERROR_PARAM;
+ return libswd_bin_pack_kernel(packed, bits, count);
+}
+
+/**
+ * Unpack LSB-first packed bytes into bit-per-char array of 0/1 values.
+ * Uses SSE2/AVX2 kernel when running CPU supports it, portable loop otherwise.
+ * \param *bits destination array of at least count chars.
+ * \param *packed source buffer of (count+7)/8 bytes.
+ * \param count number of bits to unpack.
+ * \return number of bits unpacked (positive) or error code (negative).
+ */
+int libswd_bin_unpack(char *bits, unsigned char *packed, int count){
+ if (packed==NULL || bits==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (count<0) return LIBSWD_ERROR_PARAM;
+ return libswd_bin_unpack_kernel(bits, packed, count);
+}
+
+/**
+ * Batched parity verifier, checks even parity of count data words against
+ * their parity bits at once (i.e. all words read in a batch), using SSE2/AVX2
+ * kernel when running CPU supports it.
+ * \param *data array of count data words.
+ * \param *parity array of count parity bits (0 or 1).
+ * \param count number of words to verify.
+ * \return index of the first word with parity mismatch, count if all words
+ * are fine, or error code (negative).
+ */
+int libswd_bin32_parity_verify(int *data, char *parity, int count){
+ if (data==NULL || parity==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (count<0) return LIBSWD_ERROR_PARAM;
+ return libswd_bin_verify_kernel(data, parity, count);
+}
+
 /** @} */
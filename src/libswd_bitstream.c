@@ -0,0 +1,442 @@
+/*
+ * Serial Wire Debug Open Library.
+ * Library Body File.
+ *
+ * Copyright (C) 2010-2013, Tomasz Boleslaw CEDRO (http://www.tomek.cedro.info)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the Tomasz Boleslaw CEDRO nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.*
+ *
+ * Written by Tomasz Boleslaw CEDRO <cederom@tlen.pl>, 2010-2013;
+ *
+ */
+
+
+/** \file libswd_bitstream.c */
+
+#include <libswd.h>
+
+/*******************************************************************************
+ * \defgroup libswd_bitstream Compiled bitstream recording and replay.
+ * Bus activity of a context can be recorded into a bitstream (see
+ * libswd_bitstream_t) and replayed later with a single interface driver
+ * batch call. Replay only verifies recorded ACK responses, read data parity
+ * and selected read data values, so host does not need to build, flush and
+ * verify the command queue again for identical operations. Replay requires
+ * the driver transmit_batch() entry point (see libswd_driver_t).
+ * @{
+ ******************************************************************************/
+
+/** Create new empty bitstream.
+ * \return pointer to the new bitstream, or NULL on failure.
+ */
+libswd_bitstream_t *libswd_bitstream_init(void){
+ libswd_bitstream_t *bitstream;
+ bitstream=(libswd_bitstream_t *)calloc(1,sizeof(libswd_bitstream_t));
+ if (bitstream==NULL) return NULL;
+ bitstream->datapos=-1;
+ return bitstream;
+}
+
+/** Free bitstream and its memory.
+ * Make sure it is not being recorded by any context.
+ * \param *bitstream bitstream to free.
+ * \return LIBSWD_OK on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_free(libswd_bitstream_t *bitstream){
+ if (bitstream==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ free(bitstream->batch.mosi);
+ free(bitstream->batch.miso);
+ free(bitstream->batch.dir);
+ free(bitstream->batch.pos);
+ free(bitstream->check);
+ free(bitstream);
+ return LIBSWD_OK;
+}
+
+/** Leave bus in MOSI direction, so recorded bitstream starts and ends with
+ * host driving SWDIO and can be replayed at any point of the session.
+ * \param *libswdctx swd context pointer.
+ * \return number of elements executed, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_bitstream_setdir_mosi(libswd_ctx_t *libswdctx){
+ int res;
+ res=libswd_bus_setdir_mosi(libswdctx);
+ if (res<1) return res;
+ return libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, LIBSWD_OPERATION_EXECUTE);
+}
+
+/** Start or stop recording bus activity of the context into a bitstream.
+ * All clock cycles sent to the interface driver are appended to the
+ * bitstream after they were executed, including the error handling.
+ * Bus is turned to MOSI before recording starts and before it stops.
+ * \param *libswdctx swd context pointer.
+ * \param *bitstream bitstream to record into, NULL stops recording.
+ * \return LIBSWD_OK on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_record(libswd_ctx_t *libswdctx, libswd_bitstream_t *bitstream){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ int res;
+ if (libswdctx->bitstream){
+  res=libswd_bitstream_setdir_mosi(libswdctx);
+  if (res<0) return res;
+  libswdctx->bitstream=NULL;
+ }
+ if (bitstream){
+  res=libswd_bitstream_setdir_mosi(libswdctx);
+  if (res<0) return res;
+  libswdctx->bitstream=bitstream;
+ }
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG,
+   "LIBSWD_D: libswd_bitstream_record(libswdctx=@%p, bitstream=@%p): recording %s.\n",
+   (void*)libswdctx, (void*)bitstream, bitstream?"started":"stopped" );
+ return LIBSWD_OK;
+}
+
+/** Append clock cycles to the bitstream, LSB first.
+ * \param *bitstream bitstream to append cycles to.
+ * \param data clocked out (MOSI) or sampled (MISO) payload.
+ * \param bits number of clock cycles to append (0..32).
+ * \param miso non-zero when host samples SWDIO during these cycles.
+ * \return number of clock cycles appended, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_append(libswd_bitstream_t *bitstream, int data, int bits, int miso){
+ if (bitstream==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ int i, res, pos=bitstream->batch.bits;
+ res=libswd_drv_batch_append(&bitstream->batch, data, bits, miso);
+ if (res<0) return res;
+ for (i=0;i<bits;i++,pos++){
+  if (miso && (data>>i)&1) {
+   bitstream->batch.miso[pos>>3]|=1<<(pos&7);
+  } else bitstream->batch.miso[pos>>3]&=~(1<<(pos&7));
+ }
+ return res;
+}
+
+/** Append a field check to the bitstream, see libswd_bitcheck_t.
+ * \param *bitstream bitstream to append check to.
+ * \param pos bitstream position of the checked field.
+ * \param type check type (libswd_bitcheck_type_t).
+ * \param value recorded (or expected) field value.
+ * \return number of checks appended (1), or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_append_check(libswd_bitstream_t *bitstream, int pos, int type, int value){
+ if (bitstream==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (type<LIBSWD_BITCHECK_ACK || type>LIBSWD_BITCHECK_DATA) return LIBSWD_ERROR_PARAM;
+ int size;
+ void *ptr;
+ if (bitstream->checklen==bitstream->checksize){
+  size=(bitstream->checksize)?bitstream->checksize*2:LIBSWD_CMDPOOL_SLABLEN;
+  ptr=realloc(bitstream->check, size*sizeof(libswd_bitcheck_t));
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  bitstream->check=(libswd_bitcheck_t*)ptr;
+  bitstream->checksize=size;
+ }
+ bitstream->check[bitstream->checklen].pos=pos;
+ bitstream->check[bitstream->checklen].type=type;
+ bitstream->check[bitstream->checklen].value=value;
+ bitstream->checklen++;
+ return 1;
+}
+
+/** Append executed command to the bitstream being recorded by the context.
+ * Called by the libswd_drv* functions for each executed queue element.
+ * ACK responses and read data followed by parity are also added as checks.
+ * \param *libswdctx swd context pointer.
+ * \param *cmd executed command.
+ * \param payload command payload image (libswd_cmd_t union data32).
+ * \return number of clock cycles appended, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_append_cmd(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int payload){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ libswd_bitstream_t *bitstream=libswdctx->bitstream;
+ if (bitstream==NULL) return 0;
+
+ int res, data, pos=bitstream->batch.bits;
+ char *data8=(char*)&payload, trnlen=libswdctx->config.trnlen;
+ libswd_transfer_t *transfer=&cmd->transfer;
+
+ switch (cmd->cmdtype){
+  case LIBSWD_CMDTYPE_MOSI_CONTROL:
+  case LIBSWD_CMDTYPE_MOSI_REQUEST:
+  case LIBSWD_CMDTYPE_MOSI_BITBANG:
+  case LIBSWD_CMDTYPE_MOSI_PARITY:
+   return libswd_bitstream_append(bitstream, *data8, cmd->bits, 0);
+  case LIBSWD_CMDTYPE_MOSI_DATA:
+   return libswd_bitstream_append(bitstream, payload, LIBSWD_DATA_BITLEN, 0);
+  case LIBSWD_CMDTYPE_MOSI_TRN:
+  case LIBSWD_CMDTYPE_MISO_TRN:
+   return libswd_bitstream_append(bitstream, 0, cmd->bits, 1);
+  case LIBSWD_CMDTYPE_MISO_ACK:
+   res=libswd_bitstream_append(bitstream, *data8, LIBSWD_ACK_BITLEN, 1);
+   if (res<0) return res;
+   res=libswd_bitstream_append_check(bitstream, pos, LIBSWD_BITCHECK_ACK, *data8);
+   if (res<0) return res;
+   return LIBSWD_ACK_BITLEN;
+  case LIBSWD_CMDTYPE_MISO_BITBANG:
+   return libswd_bitstream_append(bitstream, *data8, 1, 1);
+  case LIBSWD_CMDTYPE_MISO_DATA:
+   res=libswd_bitstream_append(bitstream, payload, LIBSWD_DATA_BITLEN, 1);
+   if (res<0) return res;
+   bitstream->datapos=pos;
+   return res;
+  case LIBSWD_CMDTYPE_MISO_PARITY:
+   res=libswd_bitstream_append(bitstream, *data8, 1, 1);
+   if (res<0) return res;
+   // Parity is checked only if it directly follows the data.
+   if (bitstream->datapos>=0 && bitstream->datapos==pos-LIBSWD_DATA_BITLEN){
+    libswd_drv_batch_extract(&bitstream->batch, bitstream->datapos, LIBSWD_DATA_BITLEN, &data);
+    res=libswd_bitstream_append_check(bitstream, bitstream->datapos, LIBSWD_BITCHECK_PARITY, data);
+    if (res<0) return res;
+   }
+   bitstream->datapos=-1;
+   return 1;
+  case LIBSWD_CMDTYPE_MOSI_TRANSFER:
+   // Request, TRN, ACK.
+   res=libswd_bitstream_append(bitstream, transfer->request, LIBSWD_REQUEST_BITLEN, 0);
+   if (res<0) return res;
+   res=libswd_bitstream_append(bitstream, 0, trnlen, 1);
+   if (res<0) return res;
+   res=libswd_bitstream_append_check(bitstream, bitstream->batch.bits, LIBSWD_BITCHECK_ACK, transfer->ack);
+   if (res<0) return res;
+   res=libswd_bitstream_append(bitstream, transfer->ack, LIBSWD_ACK_BITLEN, 1);
+   if (res<0) return res;
+   if (transfer->ack!=LIBSWD_ACK_OK_VAL){
+    // TRN.
+    res=libswd_bitstream_append(bitstream, 0, trnlen, 1);
+   } else if (transfer->request&LIBSWD_REQUEST_RnW){
+    // Data, Parity, TRN.
+    res=libswd_bitstream_append_check(bitstream, bitstream->batch.bits, LIBSWD_BITCHECK_PARITY, transfer->data);
+    if (res<0) return res;
+    res=libswd_bitstream_append(bitstream, transfer->data, LIBSWD_DATA_BITLEN, 1);
+    if (res<0) return res;
+    res=libswd_bitstream_append(bitstream, transfer->parity, 1, 1);
+    if (res<0) return res;
+    res=libswd_bitstream_append(bitstream, 0, trnlen, 1);
+   } else {
+    // TRN, Data, Parity.
+    res=libswd_bitstream_append(bitstream, 0, trnlen, 1);
+    if (res<0) return res;
+    res=libswd_bitstream_append(bitstream, transfer->data, LIBSWD_DATA_BITLEN, 0);
+    if (res<0) return res;
+    res=libswd_bitstream_append(bitstream, transfer->parity, 1, 0);
+   }
+   if (res<0) return res;
+   return bitstream->batch.bits-pos;
+  case LIBSWD_CMDTYPE_UNDEFINED:
+   return 0;
+  default:
+   return LIBSWD_ERROR_BADCMDTYPE;
+ }
+}
+
+/** Select read data that must match expected value on replay.
+ * Read data checks are counted in the recorded order, starting from zero.
+ * \param *bitstream recorded bitstream.
+ * \param read index of the recorded read data.
+ * \param value expected read data value.
+ * \return LIBSWD_OK on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_expect(libswd_bitstream_t *bitstream, int read, int value){
+ if (bitstream==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (read<0) return LIBSWD_ERROR_PARAM;
+ int i;
+ for (i=0;i<bitstream->checklen;i++){
+  if (bitstream->check[i].type==LIBSWD_BITCHECK_ACK) continue;
+  if (read--) continue;
+  bitstream->check[i].type=LIBSWD_BITCHECK_DATA;
+  bitstream->check[i].value=value;
+  return LIBSWD_OK;
+ }
+ return LIBSWD_ERROR_RANGE;
+}
+
+/** Verify checks of the replayed bitstream. Read data words are gathered into
+ * *words and *parities (checklen elements each) and their parity is verified
+ * in a single libswd_bin32_parity_verify() pass, then the first failing check
+ * in bitstream order is reported.
+ */
+static int libswd_bitstream_verify(libswd_ctx_t *libswdctx, libswd_bitstream_t *bitstream, int *words, char *parities){
+ int i, n, res, data, parity, bad;
+ libswd_bitcheck_t *check;
+
+ for (i=0,n=0;i<bitstream->checklen;i++){
+  check=&bitstream->check[i];
+  if (check->type==LIBSWD_BITCHECK_ACK) continue;
+  res=libswd_drv_batch_extract(&bitstream->batch, check->pos, LIBSWD_DATA_BITLEN, &words[n]);
+  if (res<0) return res;
+  res=libswd_drv_batch_extract(&bitstream->batch, check->pos+LIBSWD_DATA_BITLEN, 1, &parity);
+  if (res<0) return res;
+  parities[n++]=parity;
+ }
+ bad=(n)?libswd_bin32_parity_verify(words, parities, n):0;
+ if (bad<0) return bad;
+
+ for (i=0,n=0;i<bitstream->checklen;i++){
+  check=&bitstream->check[i];
+  if (check->type==LIBSWD_BITCHECK_ACK){
+   res=libswd_drv_batch_extract(&bitstream->batch, check->pos, LIBSWD_ACK_BITLEN, &data);
+   if (res<0) return res;
+   if (data==(check->value&7)) continue;
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
+     "LIBSWD_W: libswd_bitstream_replay(libswdctx=@%p, bitstream=@%p): check %d: ACK=%d at bit %d, expected %d!\n",
+     (void*)libswdctx, (void*)bitstream, i, data, check->pos, check->value&7 );
+   return LIBSWD_ERROR_ACKMISMATCH;
+  }
+  data=words[n];
+  if (n++==bad){
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
+     "LIBSWD_W: libswd_bitstream_replay(libswdctx=@%p, bitstream=@%p): check %d: parity error at bit %d!\n",
+     (void*)libswdctx, (void*)bitstream, i, check->pos );
+   return LIBSWD_ERROR_PARITY;
+  }
+  if (check->type==LIBSWD_BITCHECK_DATA && data!=check->value){
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
+     "LIBSWD_W: libswd_bitstream_replay(libswdctx=@%p, bitstream=@%p): check %d: data 0x%08X at bit %d, expected 0x%08X!\n",
+     (void*)libswdctx, (void*)bitstream, i, data, check->pos, check->value );
+   return LIBSWD_ERROR_RESULT;
+  }
+ }
+ return LIBSWD_OK;
+}
+
+/** Replay recorded bitstream with a single interface driver batch call,
+ * then verify ACK responses, read data parity and expected read data.
+ * Sampled MISO bits are stored in the bitstream and can be read with
+ * libswd_drv_batch_extract(). As the whole bitstream is clocked out at once,
+ * on verification failure target should be reinitialized (i.e. with
+ * libswd_dap_init()) before other operations.
+ * \param *libswdctx swd context pointer.
+ * \param *bitstream recorded bitstream.
+ * \return number of clock cycles replayed, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_replay(libswd_ctx_t *libswdctx, libswd_bitstream_t *bitstream){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (bitstream==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (libswdctx->driver==NULL || libswdctx->driver->transmit_batch==NULL)
+  return LIBSWD_ERROR_DRIVER;
+ if (libswdctx->bitstream==bitstream) return LIBSWD_ERROR_PARAM;
+
+ int res, *words;
+ char *parities;
+
+ if (bitstream->batch.bits==0) return 0;
+ res=libswdctx->driver->transmit_batch(libswdctx, &bitstream->batch);
+ if (res<0) return res;
+ if (bitstream->checklen==0) return bitstream->batch.bits;
+
+ words=(int*)malloc(bitstream->checklen*sizeof(int));
+ parities=(char*)malloc(bitstream->checklen);
+ if (words==NULL || parities==NULL){
+  res=LIBSWD_ERROR_OUTOFMEM;
+ } else res=libswd_bitstream_verify(libswdctx, bitstream, words, parities);
+ free(words);
+ free(parities);
+ if (res<0) return res;
+ return bitstream->batch.bits;
+}
+
+/** Bitstream file identification string. */
+static const char LIBSWD_BITSTREAM_MAGIC[8] = {'L','I','B','S','W','D','B','1'};
+
+static int libswd_bitstream_put32(FILE *file, int value){
+ unsigned char buf[4]={value, value>>8, value>>16, value>>24};
+ return (fwrite(buf, 1, 4, file)==4)?4:LIBSWD_ERROR_FILE;
+}
+
+static int libswd_bitstream_get32(FILE *file, int *value){
+ unsigned char buf[4];
+ if (fread(buf, 1, 4, file)!=4) return LIBSWD_ERROR_FILE;
+ *value=buf[0]|(buf[1]<<8)|(buf[2]<<16)|((unsigned)buf[3]<<24);
+ return 4;
+}
+
+/** Save bitstream into a file, so it can be replayed by other programs.
+ * Integers are stored little-endian, bitstreams byte by byte.
+ * \param *bitstream bitstream to save.
+ * \param *file file opened for binary write.
+ * \return LIBSWD_OK on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bitstream_save(libswd_bitstream_t *bitstream, FILE *file){
+ if (bitstream==NULL || file==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ int i, bytes=(bitstream->batch.bits+7)/8;
+ if (fwrite(LIBSWD_BITSTREAM_MAGIC, 1, 8, file)!=8) return LIBSWD_ERROR_FILE;
+ if (libswd_bitstream_put32(file, bitstream->batch.bits)<0) return LIBSWD_ERROR_FILE;
+ if (libswd_bitstream_put32(file, bitstream->checklen)<0) return LIBSWD_ERROR_FILE;
+ if (bytes){
+  if (fwrite(bitstream->batch.mosi, 1, bytes, file)!=(size_t)bytes) return LIBSWD_ERROR_FILE;
+  if (fwrite(bitstream->batch.dir, 1, bytes, file)!=(size_t)bytes) return LIBSWD_ERROR_FILE;
+ }
+ for (i=0;i<bitstream->checklen;i++){
+  if (libswd_bitstream_put32(file, bitstream->check[i].pos)<0) return LIBSWD_ERROR_FILE;
+  if (libswd_bitstream_put32(file, bitstream->check[i].type)<0) return LIBSWD_ERROR_FILE;
+  if (libswd_bitstream_put32(file, bitstream->check[i].value)<0) return LIBSWD_ERROR_FILE;
+ }
+ return LIBSWD_OK;
+}
+
+/** Load bitstream saved with libswd_bitstream_save().
+ * \param *file file opened for binary read.
+ * \return pointer to the new bitstream, or NULL on failure.
+ */
+libswd_bitstream_t *libswd_bitstream_load(FILE *file){
+ if (file==NULL) return NULL;
+ int i, bits, checklen, bytes, pos, type, value;
+ char magic[8];
+ libswd_bitstream_t *bitstream;
+ if (fread(magic, 1, 8, file)!=8) return NULL;
+ if (memcmp(magic, LIBSWD_BITSTREAM_MAGIC, 8)) return NULL;
+ if (libswd_bitstream_get32(file, &bits)<0 || bits<0) return NULL;
+ if (libswd_bitstream_get32(file, &checklen)<0 || checklen<0) return NULL;
+ bitstream=libswd_bitstream_init();
+ if (bitstream==NULL) return NULL;
+ bytes=(bits+7)/8;
+ if (bytes){
+  bitstream->batch.mosi=(unsigned char*)malloc(bytes);
+  bitstream->batch.miso=(unsigned char*)calloc(bytes, 1);
+  bitstream->batch.dir=(unsigned char*)malloc(bytes);
+  bitstream->batch.size=bytes;
+  if (bitstream->batch.mosi==NULL || bitstream->batch.miso==NULL || bitstream->batch.dir==NULL)
+   goto libswd_bitstream_load_error;
+  if (fread(bitstream->batch.mosi, 1, bytes, file)!=(size_t)bytes) goto libswd_bitstream_load_error;
+  if (fread(bitstream->batch.dir, 1, bytes, file)!=(size_t)bytes) goto libswd_bitstream_load_error;
+ }
+ bitstream->batch.bits=bits;
+ for (i=0;i<checklen;i++){
+  if (libswd_bitstream_get32(file, &pos)<0) goto libswd_bitstream_load_error;
+  if (libswd_bitstream_get32(file, &type)<0) goto libswd_bitstream_load_error;
+  if (libswd_bitstream_get32(file, &value)<0) goto libswd_bitstream_load_error;
+  if (pos<0 || pos+((type==LIBSWD_BITCHECK_ACK)?LIBSWD_ACK_BITLEN:LIBSWD_DATA_BITLEN+1)>bits)
+   goto libswd_bitstream_load_error;
+  if (libswd_bitstream_append_check(bitstream, pos, type, value)<0) goto libswd_bitstream_load_error;
+ }
+ return bitstream;
+
+libswd_bitstream_load_error:
+ libswd_bitstream_free(bitstream);
+ return NULL;
+}
+
+/** @} */
@@ -58,7 +58,7 @@
 int libswd_bus_setdir_mosi(libswd_ctx_t *libswdctx){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res, cmdcnt=0;
- libswd_cmd_t *cmdqtail=libswd_cmdq_find_tail(libswdctx->cmdq);
+ libswd_cmd_t *cmdqtail=libswdctx->cmdqptr.tail;
  if (cmdqtail==NULL) return LIBSWD_ERROR_QUEUE;
  if ( cmdqtail->prev==NULL || (cmdqtail->cmdtype*LIBSWD_CMDTYPE_MOSI<0) ) {
   res=libswd_cmd_enqueue_mosi_trn(libswdctx);
@@ -75,7 +75,7 @@ int libswd_bus_setdir_mosi(libswd_ctx_t *libswdctx){
 int libswd_bus_setdir_miso(libswd_ctx_t *libswdctx){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res, cmdcnt=0;
- libswd_cmd_t *cmdqtail=libswd_cmdq_find_tail(libswdctx->cmdq);
+ libswd_cmd_t *cmdqtail=libswdctx->cmdqptr.tail;
  if (cmdqtail==NULL) return LIBSWD_ERROR_QUEUE;
  if (cmdqtail->prev==NULL || (cmdqtail->cmdtype*LIBSWD_CMDTYPE_MISO<0) ) {
   res=libswd_cmd_enqueue_miso_trn(libswdctx);
@@ -182,7 +182,7 @@ int libswd_bus_read_ack(libswd_ctx_t *libswdctx, libswd_operation_t operation, c
  libswd_cmd_t *tmpcmdq, *cmdqtail;
 
  /* ACK can only show after REQ_MOSI,TRN_MISO sequence. */
- cmdqtail=libswd_cmdq_find_tail(libswdctx->cmdq);
+ cmdqtail=libswdctx->cmdqptr.tail;
  if (cmdqtail==NULL) return LIBSWD_ERROR_QUEUE;
  if (cmdqtail->prev==NULL) return LIBSWD_ERROR_ACKORDER;
  /* Check if there is REQ->TRN sequence at the command queue tail. */
@@ -385,4 +385,105 @@ int libswd_bus_write_control(libswd_ctx_t *libswdctx, libswd_operation_t operati
  return LIBSWD_OK;
 }
 
+/** Perform complete read transaction using single transfer record.
+ * Bus is put into MOSI state first if necessary. Record is expanded into
+ * Request, TRN, ACK, Data, Parity and TRN on execution, see libswd_transfer_t.
+ * \param *libswdctx swd context pointer.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param *request request packet raw data (RnW must be set).
+ * \param **data will point to the data read from target (can be NULL).
+ * \param **ack will point to the ack response from target (can be NULL).
+ * \param **parity will point to the data parity from target (can be NULL).
+ * \return number of commands processed, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bus_transfer_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *request, int **data, char **ack, char **parity){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (request==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+
+ int res, qcmdcnt=0, tcmdcnt=0;
+
+ res=libswd_bus_setdir_mosi(libswdctx);
+ if (res<0) return res;
+ qcmdcnt+=res;
+
+ res=libswd_cmd_enqueue_transfer_read(libswdctx, request, data, ack, parity);
+ if (res<1) return res;
+ qcmdcnt+=res;
+
+ if (operation==LIBSWD_OPERATION_ENQUEUE) return qcmdcnt;
+ res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, operation);
+ if (res<0) return res;
+ tcmdcnt+=res;
+ return qcmdcnt+tcmdcnt;
+}
+
+/** Perform complete read transaction that deposits read data directly into
+ * the caller buffer, see libswd_cmd_enqueue_transfer_read_buf().
+ * Bus is put into MOSI state first if necessary.
+ * \param *libswdctx swd context pointer.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param *request request packet raw data (RnW must be set).
+ * \param *buf caller buffer for read data.
+ * \param offset byte offset of the read data in the buffer.
+ * \param len number of low-order data bytes to store (1..4).
+ * \return number of commands processed, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bus_transfer_read_buf(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *request, char *buf, int offset, int len){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (request==NULL || buf==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+
+ int res, qcmdcnt=0, tcmdcnt=0;
+
+ res=libswd_bus_setdir_mosi(libswdctx);
+ if (res<0) return res;
+ qcmdcnt+=res;
+
+ res=libswd_cmd_enqueue_transfer_read_buf(libswdctx, request, buf, offset, len);
+ if (res<1) return res;
+ qcmdcnt+=res;
+
+ if (operation==LIBSWD_OPERATION_ENQUEUE) return qcmdcnt;
+ res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, operation);
+ if (res<0) return res;
+ tcmdcnt+=res;
+ return qcmdcnt+tcmdcnt;
+}
+
+/** Perform complete write transaction using single transfer record.
+ * Bus is put into MOSI state first if necessary. Record is expanded into
+ * Request, TRN, ACK, TRN, Data and Parity on execution, see libswd_transfer_t.
+ * \param *libswdctx swd context pointer.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param *request request packet raw data (RnW must be clear).
+ * \param *data pointer to the data to be written.
+ * \param **ack will point to the ack response from target (can be NULL).
+ * \return number of commands processed, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_bus_transfer_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char *request, int *data, char **ack){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (request==NULL || data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+
+ int res, qcmdcnt=0, tcmdcnt=0;
+
+ res=libswd_bus_setdir_mosi(libswdctx);
+ if (res<0) return res;
+ qcmdcnt+=res;
+
+ res=libswd_cmd_enqueue_transfer_write(libswdctx, request, data, ack);
+ if (res<1) return res;
+ qcmdcnt+=res;
+
+ if (operation==LIBSWD_OPERATION_ENQUEUE) return qcmdcnt;
+ res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, operation);
+ if (res<0) return res;
+ tcmdcnt+=res;
+ return qcmdcnt+tcmdcnt;
+}
+
 /** @} */
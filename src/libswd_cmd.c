@@ -50,6 +50,16 @@
 
 /** Append selected command to a context's command queue (libswdctx->cmdq).
  * This function does not update the libswdctx->cmdq pointer (its updated on flush).
+ * Element is linked directly after libswdctx->cmdqptr.tail, so no queue walk
+ * is necessary, then it becomes the new queue tail.
+ * When libswdctx->config.cmdqring is set the queue never holds more than
+ * config.maxcmdqlen elements. When it is full, oldest consumed elements are
+ * retired first so that half of config.maxcmdqlen is left, see
+ * libswd_cmdq_retire(). Results of the caller's last flush and elements
+ * not yet flushed are never retired, so pointers returned by queue
+ * operations stay valid until the caller flushes the queue again. If that
+ * does not make room LIBSWD_ERROR_QUEUEFULL is returned, caller has to
+ * flush the queue before more elements can be appended.
  * \param *libswdctx swd context pointer containing the command queue.
  * \param *cmd command to be appended to the context's command queue.
  * \return number of elements appended or LIBSWD_ERROR_CODE on failure.
@@ -57,7 +67,19 @@
 int libswd_cmd_enqueue(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
  if (libswdctx==NULL || cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
  int res;
- res=libswd_cmdq_append(libswdctx->cmdq, cmd);
+ if (libswdctx->config.cmdqring && libswdctx->cmdqptr.len>=libswdctx->config.maxcmdqlen){
+  res=libswd_cmdq_retire(libswdctx, libswdctx->config.maxcmdqlen/2);
+  if (res<0) return res;
+  if (libswdctx->cmdqptr.len>=libswdctx->config.maxcmdqlen){
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_cmd_enqueue(libswdctx=@%p, cmd=@%p): ring queue is full, flush it first.\n", (void*)libswdctx, (void*)cmd);
+   return LIBSWD_ERROR_QUEUEFULL;
+  }
+ }
+ res=libswd_cmdq_append(libswdctx->cmdqptr.tail, cmd);
+ if (res>0){
+  libswdctx->cmdqptr.tail=cmd;
+  libswdctx->cmdqptr.len++;
+ }
  return res;
 }
 
@@ -72,13 +94,13 @@ int libswd_cmd_enqueue_mosi_request(libswd_ctx_t *libswdctx, char *request){
  if (request==NULL) return LIBSWD_ERROR_NULLPOINTER;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  cmd->request=*request;
  cmd->bits=LIBSWD_REQUEST_BITLEN;
  cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_REQUEST;
  res=libswd_cmd_enqueue(libswdctx, cmd);
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 } 
 
@@ -90,13 +112,13 @@ int libswd_cmd_enqueue_mosi_trn(libswd_ctx_t *libswdctx){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res;
   libswd_cmd_t *cmd;
-  cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+  cmd=libswd_cmdq_pool_get(libswdctx);
   if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
   cmd->TRNnMOSI=0;
   cmd->bits=libswdctx->config.trnlen;
   cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_TRN;
   res=libswd_cmd_enqueue(libswdctx, cmd);
-  if (res<1) free(cmd);
+  if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
   return res;
 }
 
@@ -108,13 +130,13 @@ int libswd_cmd_enqueue_miso_trn(libswd_ctx_t *libswdctx){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  cmd->TRNnMOSI=1;
  cmd->bits=libswdctx->config.trnlen;
  cmd->cmdtype=LIBSWD_CMDTYPE_MISO_TRN;
  res=libswd_cmd_enqueue(libswdctx, cmd);
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 }
 
@@ -132,10 +154,11 @@ int libswd_cmd_enqueue_miso_nbit(libswd_ctx_t *libswdctx, char **data, int count
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (count<=0) return LIBSWD_ERROR_PARAM;
  int res, res2;
- libswd_cmd_t *cmd, *oldcmdq=libswdctx->cmdq;
+ libswd_cmd_t *cmd, *oldcmdq=libswdctx->cmdqptr.tail;
+ libswd_cmd_t *oldexectail=libswdctx->cmdqptr.exectail;
  int i,cmdcnt=0;
  for (i=0;i<count;i++){
-  cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+  cmd=libswd_cmdq_pool_get(libswdctx);
   if (cmd==NULL) {
    res=LIBSWD_ERROR_OUTOFMEM;
    break;
@@ -144,13 +167,20 @@ int libswd_cmd_enqueue_miso_nbit(libswd_ctx_t *libswdctx, char **data, int count
   if (data!=NULL) *data=&cmd->misobit;
   cmd->cmdtype=LIBSWD_CMDTYPE_MISO_BITBANG;
   res=libswd_cmd_enqueue(libswdctx, cmd);
-  if (res<1) break;
+  if (res<1) {
+   libswd_cmdq_pool_put(libswdctx, cmd);
+   break;
+  }
   cmdcnt+=res;
  }
  //If there was problem enqueueing elements, rollback changes on queue.
  if (res<1) {
-  res2=libswd_cmdq_free_tail(oldcmdq);
+  // Elements executed by automatic flush in ring mode cannot be taken back.
+  if (libswdctx->cmdqptr.exectail!=oldexectail) oldcmdq=libswdctx->cmdqptr.exectail;
+  res2=libswd_cmdq_free_tail(libswdctx, oldcmdq);
   if (res2<0) return res2;
+  libswdctx->cmdqptr.tail=oldcmdq;
+  libswdctx->cmdqptr.len-=res2;
   return res;
  } else return cmdcnt;
 }
@@ -170,10 +200,11 @@ int libswd_cmd_enqueue_mosi_nbit(libswd_ctx_t *libswdctx, char *data, int count)
  if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
  if (count<=0) return LIBSWD_ERROR_PARAM;
  int res, res2, cmdcnt=0;
- libswd_cmd_t *cmd, *oldcmdq=libswdctx->cmdq;
+ libswd_cmd_t *cmd, *oldcmdq=libswdctx->cmdqptr.tail;
+ libswd_cmd_t *oldexectail=libswdctx->cmdqptr.exectail;
 int i;
  for (i=0;i<count;i++){
-  cmd=(libswd_cmd_t *)calloc(1, sizeof(libswd_cmd_t));
+  cmd=libswd_cmdq_pool_get(libswdctx);
   if (cmd==NULL) {
    res=LIBSWD_ERROR_OUTOFMEM;
    break;
@@ -182,14 +213,20 @@ int i;
   cmd->bits=1;
   cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_BITBANG;
   res=libswd_cmd_enqueue(libswdctx, cmd);
-  if (res<1) break;
+  if (res<1) {
+   libswd_cmdq_pool_put(libswdctx, cmd);
+   break;
+  }
   cmdcnt+=res;
  }
  //If there was problem enqueueing elements, rollback changes on queue.
  if (res<1){
-  res2=libswd_cmdq_free_tail(oldcmdq);
+  // Elements executed by automatic flush in ring mode cannot be taken back.
+  if (libswdctx->cmdqptr.exectail!=oldexectail) oldcmdq=libswdctx->cmdqptr.exectail;
+  res2=libswd_cmdq_free_tail(libswdctx, oldcmdq);
   if (res2<0) return res2;
-  libswdctx->cmdq=oldcmdq;
+  libswdctx->cmdqptr.tail=oldcmdq;
+  libswdctx->cmdqptr.len-=res2;
   return res;
  } else return cmdcnt;
 }
@@ -204,13 +241,13 @@ int libswd_cmd_enqueue_mosi_parity(libswd_ctx_t *libswdctx, char *parity){
  if (*parity!=0 && *parity!=1) return LIBSWD_ERROR_PARAM;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  cmd->parity=*parity;
  cmd->bits=1;
  cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_PARITY;
  res=libswd_cmd_enqueue(libswdctx, cmd);
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 }
 
@@ -223,13 +260,13 @@ int libswd_cmd_enqueue_miso_parity(libswd_ctx_t *libswdctx, char **parity){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  if (parity!=NULL) *parity=&cmd->parity;
  cmd->bits=1;
  cmd->cmdtype=LIBSWD_CMDTYPE_MISO_PARITY;
  res=libswd_cmd_enqueue(libswdctx, cmd);
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 }
 
@@ -242,13 +279,13 @@ int libswd_cmd_enqueue_miso_data(libswd_ctx_t *libswdctx, int **data){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  if (data!=NULL) *data=&cmd->misodata;
  cmd->bits=32;
  cmd->cmdtype=LIBSWD_CMDTYPE_MISO_DATA;
  res=libswd_cmd_enqueue(libswdctx, cmd); // should be 1 on success
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 }
 
@@ -299,13 +336,13 @@ int libswd_cmd_enqueue_mosi_data(libswd_ctx_t *libswdctx, int *data){
  if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  cmd->mosidata=*data;
  cmd->bits=32;
  cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_DATA;
  res=libswd_cmd_enqueue(libswdctx, cmd); // should be 1 or 2 on success
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 }
 
@@ -397,13 +434,13 @@ int libswd_cmd_enqueue_miso_ack(libswd_ctx_t *libswdctx, char **ack){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  int res;
  libswd_cmd_t *cmd;
- cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ cmd=libswd_cmdq_pool_get(libswdctx);
  if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
  if (ack!=NULL) *ack=&cmd->ack;
  cmd->bits=LIBSWD_ACK_BITLEN;
  cmd->cmdtype=LIBSWD_CMDTYPE_MISO_ACK;
  res=libswd_cmd_enqueue(libswdctx, cmd); //should be 1 on success
- if (res<1) free(cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
  return res;
 }
 
@@ -420,9 +457,10 @@ int libswd_cmd_enqueue_mosi_control(libswd_ctx_t *libswdctx, char *ctlmsg, int l
  if (ctlmsg==NULL) return LIBSWD_ERROR_NULLPOINTER;
  if (len<=0) return LIBSWD_ERROR_PARAM;
  int elm, res, res2, cmdcnt=0;
- libswd_cmd_t *cmd=NULL, *oldcmdq=libswdctx->cmdq;
+ libswd_cmd_t *cmd=NULL, *oldcmdq=libswdctx->cmdqptr.tail;
+ libswd_cmd_t *oldexectail=libswdctx->cmdqptr.exectail;
  for (elm=0;elm<len;elm++){
-  cmd=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+  cmd=libswd_cmdq_pool_get(libswdctx);
   if (cmd==NULL){
    res=LIBSWD_ERROR_OUTOFMEM;
    break;
@@ -431,14 +469,20 @@ int libswd_cmd_enqueue_mosi_control(libswd_ctx_t *libswdctx, char *ctlmsg, int l
   cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_CONTROL;
   cmd->bits=sizeof(ctlmsg[elm])*LIBSWD_DATA_BYTESIZE;
   res=libswd_cmd_enqueue(libswdctx, cmd); 
-  if (res<1) break;
+  if (res<1) {
+   libswd_cmdq_pool_put(libswdctx, cmd);
+   break;
+  }
   cmdcnt=+res;
  }
  //If there was problem enqueueing elements, rollback changes on queue.
  if (res<1){
-  res2=libswd_cmdq_free_tail(oldcmdq);
+  // Elements executed by automatic flush in ring mode cannot be taken back.
+  if (libswdctx->cmdqptr.exectail!=oldexectail) oldcmdq=libswdctx->cmdqptr.exectail;
+  res2=libswd_cmdq_free_tail(libswdctx, oldcmdq);
   if (res2<0) return res2;
-  libswdctx->cmdq=oldcmdq;
+  libswdctx->cmdqptr.tail=oldcmdq;
+  libswdctx->cmdqptr.len-=res2;
   return res;
  } return cmdcnt;
 }
@@ -475,6 +519,89 @@ int libswd_cmd_enqueue_mosi_swd2jtag(libswd_ctx_t *libswdctx){
  return libswd_cmd_enqueue_mosi_control(libswdctx, (char *)LIBSWD_CMD_SWD2JTAG, sizeof(LIBSWD_CMD_SWD2JTAG));
 }
 
+/** Append command queue with read transfer record (see libswd_transfer_t).
+ * Single element holds the whole read transaction, including turnarounds.
+ * \param *libswdctx swd context pointer.
+ * \param *request pointer to the 8-bit request payload (RnW must be set).
+ * \param **data will point to the data read from target (can be NULL).
+ * \param **ack will point to the ack response from target (can be NULL).
+ * \param **parity will point to the data parity from target (can be NULL).
+ * \return number of elements appended (1), or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmd_enqueue_transfer_read(libswd_ctx_t *libswdctx, char *request, int **data, char **ack, char **parity){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (request==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (!(*request&LIBSWD_REQUEST_RnW)) return LIBSWD_ERROR_RnW;
+ int res;
+ libswd_cmd_t *cmd;
+ cmd=libswd_cmdq_pool_get(libswdctx);
+ if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
+ cmd->transfer.request=*request;
+ if (data!=NULL) *data=&cmd->transfer.data;
+ if (ack!=NULL) *ack=&cmd->transfer.ack;
+ if (parity!=NULL) *parity=&cmd->transfer.parity;
+ cmd->bits=LIBSWD_REQUEST_BITLEN+LIBSWD_ACK_BITLEN+LIBSWD_DATA_BITLEN+1+2*libswdctx->config.trnlen;
+ cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_TRANSFER;
+ res=libswd_cmd_enqueue(libswdctx, cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
+ return res;
+}
+
+/** Append command queue with read transfer record that deposits its data
+ * into the caller buffer on execution (see libswd_transfer_t). Buffer must
+ * stay valid until the element is executed, but not after that, so results
+ * of enqueued reads remain safe when the queue is freed.
+ * \param *libswdctx swd context pointer.
+ * \param *request pointer to the 8-bit request payload (RnW must be set).
+ * \param *buf caller buffer for read data.
+ * \param offset byte offset of the read data in the buffer.
+ * \param len number of low-order data bytes to store (1..4).
+ * \return number of elements appended (1), or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmd_enqueue_transfer_read_buf(libswd_ctx_t *libswdctx, char *request, char *buf, int offset, int len){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (request==NULL || buf==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (offset<0 || len<1 || len>4) return LIBSWD_ERROR_PARAM;
+ int res;
+ res=libswd_cmd_enqueue_transfer_read(libswdctx, request, NULL, NULL, NULL);
+ if (res<1) return res;
+ libswdctx->cmdqptr.tail->transfer.dest=buf+offset;
+ libswdctx->cmdqptr.tail->transfer.destlen=len;
+ return res;
+}
+
+/** Append command queue with write transfer record (see libswd_transfer_t).
+ * Single element holds the whole write transaction, including turnarounds.
+ * Data parity is calculated automatically.
+ * \param *libswdctx swd context pointer.
+ * \param *request pointer to the 8-bit request payload (RnW must be clear).
+ * \param *data pointer to the data to be written.
+ * \param **ack will point to the ack response from target (can be NULL).
+ * \return number of elements appended (1), or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmd_enqueue_transfer_write(libswd_ctx_t *libswdctx, char *request, int *data, char **ack){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (request==NULL || data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (*request&LIBSWD_REQUEST_RnW) return LIBSWD_ERROR_RnW;
+ int res;
+ libswd_cmd_t *cmd;
+ cmd=libswd_cmdq_pool_get(libswdctx);
+ if (cmd==NULL) return LIBSWD_ERROR_OUTOFMEM;
+ cmd->transfer.request=*request;
+ cmd->transfer.data=*data;
+ res=libswd_bin32_parity_even(data, &cmd->transfer.parity);
+ if (res<0) {
+  libswd_cmdq_pool_put(libswdctx, cmd);
+  return res;
+ }
+ if (ack!=NULL) *ack=&cmd->transfer.ack;
+ cmd->bits=LIBSWD_REQUEST_BITLEN+LIBSWD_ACK_BITLEN+LIBSWD_DATA_BITLEN+1+2*libswdctx->config.trnlen;
+ cmd->cmdtype=LIBSWD_CMDTYPE_MOSI_TRANSFER;
+ res=libswd_cmd_enqueue(libswdctx, cmd);
+ if (res<1) libswd_cmdq_pool_put(libswdctx, cmd);
+ return res;
+}
+
 /** Return human readable command type string of *cmd.
  * \param *cmd command the name is to be printed.
  * \return string containing human readable command name, or NULL on failure.
@@ -482,6 +609,7 @@ int libswd_cmd_enqueue_mosi_swd2jtag(libswd_ctx_t *libswdctx){
 char *libswd_cmd_string_cmdtype(libswd_cmd_t *cmd){
  if (cmd==NULL) return NULL;
  switch (cmd->cmdtype){
+  case LIBSWD_CMDTYPE_MOSI_TRANSFER:return "MOSI_TRANSFER";
   case LIBSWD_CMDTYPE_MOSI_DATA:    return "MOSI_DATA";
   case LIBSWD_CMDTYPE_MOSI_REQUEST: return "MOSI_REQUEST";
   case LIBSWD_CMDTYPE_MOSI_TRN:     return "MOSI_TRN";
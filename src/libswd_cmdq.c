@@ -94,6 +94,23 @@ libswd_cmd_t* libswd_cmdq_find_exectail(libswd_cmd_t *cmdq){
  return NULL;
 }
 
+/** Find last executed element on the context command queue.
+ * Search starts at the libswdctx->cmdqptr.exectail cursor instead of the
+ * queue head and only skips elements executed after cursor was last updated,
+ * so it does not depend on the queue history length. Cursor is updated.
+ * \param *libswdctx swd context pointer.
+ * \return libswd_cmd_t* pointer to the last executed element or NULL on error.
+ */
+libswd_cmd_t* libswd_cmdq_seek_exectail(libswd_ctx_t *libswdctx){
+ if (libswdctx==NULL) return NULL;
+ libswd_cmd_t *cmd=libswdctx->cmdqptr.exectail;
+ if (cmd==NULL) cmd=libswdctx->cmdqptr.head;
+ if (cmd==NULL) return NULL;
+ while (cmd->next && cmd->next->done) cmd=cmd->next;
+ libswdctx->cmdqptr.exectail=cmd;
+ return cmd;
+}
+
 /** Append element pointed by *cmd at the end of the quque pointed by *cmdq.
  * After this operation queue will be pointed by appended element (ie. last
  * element added becomes actual quque pointer to show what was added recently).
@@ -116,18 +133,87 @@ int libswd_cmdq_append(libswd_cmd_t *cmdq, libswd_cmd_t *cmd){
  return 1;
 }
 
+/** Get new zeroed command queue element from the context element pool.
+ * When there is no free element left, new slab of LIBSWD_CMDPOOL_SLABLEN
+ * elements is allocated and put on the free list.
+ * \param *libswdctx swd context pointer.
+ * \return libswd_cmd_t* pointer to the element, NULL on failure.
+ */
+libswd_cmd_t* libswd_cmdq_pool_get(libswd_ctx_t *libswdctx){
+ if (libswdctx==NULL) return NULL;
+ int i;
+ libswd_cmd_t *cmd;
+ libswd_cmdslab_t *slab;
+ if (libswdctx->cmdpool.free==NULL){
+  slab=(libswd_cmdslab_t *)malloc(sizeof(libswd_cmdslab_t));
+  if (slab==NULL) return NULL;
+  for (i=0;i<LIBSWD_CMDPOOL_SLABLEN-1;i++) slab->cmd[i].next=&slab->cmd[i+1];
+  slab->cmd[LIBSWD_CMDPOOL_SLABLEN-1].next=NULL;
+  slab->next=libswdctx->cmdpool.slabs;
+  libswdctx->cmdpool.slabs=slab;
+  libswdctx->cmdpool.free=&slab->cmd[0];
+  libswdctx->cmdpool.size+=LIBSWD_CMDPOOL_SLABLEN;
+ }
+ cmd=libswdctx->cmdpool.free;
+ libswdctx->cmdpool.free=cmd->next;
+ memset(cmd, 0, sizeof(libswd_cmd_t));
+ libswdctx->cmdpool.used++;
+ if (libswdctx->cmdpool.used>libswdctx->cmdpool.highwater)
+  libswdctx->cmdpool.highwater=libswdctx->cmdpool.used;
+ return cmd;
+}
+
+/** Put command queue element back into the context element pool.
+ * Element must not be linked to any queue anymore.
+ * Error handling queue attached to the element is recycled as well.
+ * \param *libswdctx swd context pointer.
+ * \param *cmd pointer to the element to be recycled.
+ * \return LIBSWD_OK on success, LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmdq_pool_put(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (cmd->errors) libswd_cmdq_free(libswdctx, cmd->errors);
+ cmd->prev=NULL;
+ cmd->next=libswdctx->cmdpool.free;
+ libswdctx->cmdpool.free=cmd;
+ libswdctx->cmdpool.used--;
+ return LIBSWD_OK;
+}
+
+/** Release all slabs of the context element pool.
+ * All elements taken from the pool become invalid, so this should only be
+ * called when the context is destroyed.
+ * \param *libswdctx swd context pointer.
+ * \return number of elements released, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmdq_pool_free(libswd_ctx_t *libswdctx){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ int cmdcnt=libswdctx->cmdpool.size;
+ libswd_cmdslab_t *slab, *nextslab;
+ for (slab=libswdctx->cmdpool.slabs;slab!=NULL;slab=nextslab){
+  nextslab=slab->next;
+  free(slab);
+ }
+ memset(&libswdctx->cmdpool, 0, sizeof(libswd_cmdpool_t));
+ return cmdcnt;
+}
+
 /** Free queue pointed by *cmdq element.
+ * Elements are put back into the context element pool.
+ * \param *libswdctx swd context pointer.
  * \param *cmdq pointer to any element on command queue
  * \return number of elements destroyed, LIBSWD_ERROR_CODE on failure
  */
-int libswd_cmdq_free(libswd_cmd_t *cmdq){
+int libswd_cmdq_free(libswd_ctx_t *libswdctx, libswd_cmd_t *cmdq){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (cmdq==NULL) return LIBSWD_ERROR_NULLQUEUE;
  int cmdcnt=0;
  libswd_cmd_t *cmd, *nextcmd;
  cmd=libswd_cmdq_find_head(cmdq);
  while (cmd!=NULL) {
   nextcmd=cmd->next;
-  free(cmd);
+  libswd_cmdq_pool_put(libswdctx, cmd);
   cmd=nextcmd;
   cmdcnt++;
  }
@@ -135,17 +221,20 @@ int libswd_cmdq_free(libswd_cmd_t *cmdq){
 }
 
 /** Free queue head up to *cmdq element.
+ * Elements are put back into the context element pool.
+ * \param *libswdctx swd context pointer.
  * \param *cmdq pointer to the element that becomes new queue root.
  * \return number of elements destroyed, or LIBSWD_ERROR_CODE on failure.
  */
-int libswd_cmdq_free_head(libswd_cmd_t *cmdq){
+int libswd_cmdq_free_head(libswd_ctx_t *libswdctx, libswd_cmd_t *cmdq){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (cmdq==NULL) return LIBSWD_ERROR_NULLQUEUE;
  int cmdcnt=0;
  libswd_cmd_t *cmdqroot, *nextcmd;
  cmdqroot=libswd_cmdq_find_head(cmdq);
  while(cmdqroot!=cmdq){
   nextcmd=cmdqroot->next;
-  free(cmdqroot);
+  libswd_cmdq_pool_put(libswdctx, cmdqroot);
   cmdqroot=nextcmd;
   cmdcnt++;
  }
@@ -154,25 +243,102 @@ int libswd_cmdq_free_head(libswd_cmd_t *cmdq){
 }
 
 /** Free queue tail starting after *cmdq element.
+ * Elements are put back into the context element pool.
+ * \param *libswdctx swd context pointer.
  * \param *cmdq pointer to the last element on the new queue.
  * \return number of elements destroyed, or LIBSWD_ERROR_CODE on failure.
  */
-int libswd_cmdq_free_tail(libswd_cmd_t *cmdq){
+int libswd_cmdq_free_tail(libswd_ctx_t *libswdctx, libswd_cmd_t *cmdq){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (cmdq==NULL) return LIBSWD_ERROR_NULLQUEUE;
  int cmdcnt=0;
- libswd_cmd_t *cmdqend;
- if (cmdq->next==NULL) return 0;
- cmdqend=libswd_cmdq_find_tail(cmdq->next);
- if (cmdqend==NULL) return LIBSWD_ERROR_QUEUE; 
- while(cmdqend!=cmdq){
-  cmdqend=cmdqend->prev;
-  free(cmdqend->next);
+ libswd_cmd_t *cmd, *nextcmd;
+ for (cmd=cmdq->next;cmd!=NULL;cmd=nextcmd){
+  nextcmd=cmd->next;
+  libswd_cmdq_pool_put(libswdctx, cmd);
   cmdcnt++;
  }
  cmdq->next=NULL;
  return cmdcnt;
 }
 
+/** Gather not yet executed elements from *firstcmd up to *lastcmd into the
+ * context command queue span (libswdctx->cmdqspan).
+ * Arrays are enlarged when necessary and reused by next call.
+ * \param *libswdctx swd context pointer.
+ * \param *firstcmd first element of the span.
+ * \param *lastcmd last element of the span.
+ * \return number of elements gathered, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmdq_span(libswd_ctx_t *libswdctx, libswd_cmd_t *firstcmd, libswd_cmd_t *lastcmd){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (firstcmd==NULL || lastcmd==NULL) return LIBSWD_ERROR_NULLQUEUE;
+ int i=0, size;
+ void *ptr;
+ libswd_cmd_t *cmd;
+ libswd_cmdqspan_t *cmdqspan=&libswdctx->cmdqspan;
+ for (cmd=firstcmd;cmd!=NULL;cmd=cmd->next){
+  if (!cmd->done){
+   if (i==cmdqspan->size){
+    size=(cmdqspan->size)?cmdqspan->size*2:LIBSWD_CMDPOOL_SLABLEN;
+    ptr=realloc(cmdqspan->cmd, size*sizeof(libswd_cmd_t*));
+    if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+    cmdqspan->cmd=(libswd_cmd_t**)ptr;
+    ptr=realloc(cmdqspan->data, size*sizeof(int));
+    if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+    cmdqspan->data=(int*)ptr;
+    cmdqspan->size=size;
+   }
+   cmdqspan->cmd[i++]=cmd;
+  }
+  if (cmd==lastcmd) break;
+ }
+ cmdqspan->len=i;
+ return i;
+}
+
+/** Transmit pending elements of the context queue from **firstcmd up to
+ * *lastcmd in spans, see libswd_cmdq_span(). Error handling may flush the
+ * queue while a span is transmitted (i.e. data phase after ACK={WAIT,FAULT}),
+ * such nested flush gathers its own span and leaves the outer one intact.
+ * \param *libswdctx swd context pointer.
+ * \param **firstcmd first element to transmit, set to NULL when everything
+ * up to *lastcmd was transmitted, otherwise to the element to continue from.
+ * \param *lastcmd last element to transmit.
+ * \param caps interface driver capabilities, see libswd_drv_caps().
+ * \param transaction is set when probe executes whole transfer records.
+ * \return number of elements transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_cmdq_flush_span(libswd_ctx_t *libswdctx, libswd_cmd_t **firstcmd, libswd_cmd_t *lastcmd, int caps, int transaction){
+ int res, cmdcnt=0, spanlen;
+ libswd_cmd_t *cmd;
+ libswd_cmdqspan_t outerspan=libswdctx->cmdqspan;
+ if (outerspan.busy) memset(&libswdctx->cmdqspan, 0, sizeof(libswd_cmdqspan_t));
+ libswdctx->cmdqspan.busy=1;
+ while (1){
+  res=libswd_cmdq_span(libswdctx, *firstcmd, lastcmd);
+  if (res<0) break;
+  spanlen=res;
+  if ((caps&LIBSWD_DRIVER_CAP_BATCH) && !transaction){
+   res=libswd_drv_transmit_batch(libswdctx, &cmd);
+  } else res=libswd_drv_transmit_span(libswdctx, &cmd);
+  if (res<0) break;
+  cmdcnt+=res;
+  if (res==spanlen){
+   *firstcmd=NULL;
+   break;
+  }
+  *firstcmd=cmd;
+  if (res==0 || (caps&(LIBSWD_DRIVER_CAP_BITS|LIBSWD_DRIVER_CAP_PACKED))) break;
+ }
+ if (outerspan.busy){
+  free(libswdctx->cmdqspan.cmd);
+  free(libswdctx->cmdqspan.data);
+  libswdctx->cmdqspan=outerspan;
+ } else libswdctx->cmdqspan.busy=0;
+ return (res<0)?res:cmdcnt;
+}
+
 /** Flush command queue contents into interface driver and update **cmdq.
  * Operation is specified by LIBSWD_OPERATION and can be used to select
  * how to flush the queue, ie. head-only, tail-only, one, all, etc.
@@ -180,6 +346,17 @@ int libswd_cmdq_free_tail(libswd_cmd_t *cmdq){
  * queues (i.e. error handling) so the parameter is **cmdq not libswdctx itself.
  * This is the only place where **cmdq is updated to the last executed element.
  * Double pointer is used because we update pointer element not its data.
+ * When the context's own queue (&libswdctx->cmdq) is flushed, head, tail and
+ * last executed element are taken from libswdctx->cmdqptr instead of walking
+ * the queue, and libswdctx->cmdqptr.exectail is updated along with **cmdq.
+ * Elements executed up to the previous flush of the context queue become
+ * consumed and may be retired by libswd_cmdq_retire().
+ * When interface driver provides the batch entry point, pending elements of
+ * the context queue are gathered with libswd_cmdq_span() and sent with
+ * libswd_drv_transmit_batch(). Path is chosen with libswd_drv_caps(), drivers
+ * that only provide batch entry point get the whole context queue in batches.
+ * Drivers that execute whole SWD transactions get the span transmitted with
+ * libswd_drv_transmit_span(), so runs of transfer records become blocks.
  * \param *cmdq pointer to queue to be flushed.
  * \param operation tells how to flush the queue.
  * \return number of commands transmitted, or LIBSWD_ERROR_CODE on failure.
@@ -187,33 +364,49 @@ int libswd_cmdq_free_tail(libswd_cmd_t *cmdq){
  */
 int libswd_cmdq_flush(libswd_ctx_t *libswdctx, libswd_cmd_t **cmdq, libswd_operation_t operation){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
- if (*cmdq==NULL||cmdq==NULL) return LIBSWD_ERROR_NULLQUEUE;
+ if (cmdq==NULL||*cmdq==NULL) return LIBSWD_ERROR_NULLQUEUE;
  if (operation<LIBSWD_OPERATION_FIRST || operation>LIBSWD_OPERATION_LAST)
   return LIBSWD_ERROR_BADOPCODE;
 
- int res, cmdcnt=0;
- libswd_cmd_t *cmd, *firstcmd, *lastcmd;
+ int res, cmdcnt=0, ctxcmdq=(cmdq==&libswdctx->cmdq), transaction;
+ int caps=libswd_drv_caps(libswdctx);
+ libswd_cmd_t *cmd, *firstcmd, *lastcmd, *cmdqhead, *cmdqtail;
+ if (caps<0) return caps;
+ transaction=(caps&LIBSWD_DRIVER_CAP_TRANSACTION) && (caps&(LIBSWD_DRIVER_CAP_BITS|LIBSWD_DRIVER_CAP_PACKED));
+
+ if (ctxcmdq){
+  libswdctx->cmdqptr.consumed=libswdctx->cmdqptr.flushed;
+  cmdqhead=libswdctx->cmdqptr.head;
+  cmdqtail=libswdctx->cmdqptr.tail;
+ } else {
+  cmdqhead=libswd_cmdq_find_head(*cmdq);
+  cmdqtail=libswd_cmdq_find_tail(*cmdq);
+ }
 
  switch (operation){
   case LIBSWD_OPERATION_TRANSMIT_HEAD:
-   firstcmd=libswd_cmdq_find_head(*cmdq);
+   firstcmd=cmdqhead;
    lastcmd=*cmdq;
    break;
   case LIBSWD_OPERATION_TRANSMIT_TAIL:
    firstcmd=*cmdq;
-   lastcmd=libswd_cmdq_find_tail(*cmdq);
+   lastcmd=cmdqtail;
    break;
   case LIBSWD_OPERATION_EXECUTE:
+   // Everything up to the last executed element is already done.
+   firstcmd=(ctxcmdq)?libswd_cmdq_seek_exectail(libswdctx):cmdqhead;
+   lastcmd=cmdqtail;
+   break;
   case LIBSWD_OPERATION_TRANSMIT_ALL:
-   firstcmd=libswd_cmdq_find_head(*cmdq);
-   lastcmd=libswd_cmdq_find_tail(*cmdq);
+   firstcmd=cmdqhead;
+   lastcmd=cmdqtail;
    break;
   case LIBSWD_OPERATION_TRANSMIT_ONE:
    firstcmd=*cmdq;
    lastcmd=*cmdq;
    break;
   case LIBSWD_OPERATION_TRANSMIT_LAST:
-   firstcmd=libswd_cmdq_find_tail(*cmdq);
+   firstcmd=cmdqtail;
    lastcmd=firstcmd;
    break;
   default:
@@ -223,15 +416,34 @@ int libswd_cmdq_flush(libswd_ctx_t *libswdctx, libswd_cmd_t **cmdq, libswd_opera
  if (firstcmd==NULL) return LIBSWD_ERROR_QUEUEROOT;
  if (lastcmd==NULL) return LIBSWD_ERROR_QUEUETAIL;
 
- if (firstcmd==lastcmd){
+ if (firstcmd==lastcmd && (caps&(LIBSWD_DRIVER_CAP_BITS|LIBSWD_DRIVER_CAP_PACKED))){
   if (!firstcmd->done) {
    res=libswd_drv_transmit(libswdctx, firstcmd);
    if (res<0) return res;
    *cmdq=firstcmd;
+   if (ctxcmdq) libswdctx->cmdqptr.exectail=firstcmd;
   }
+  if (ctxcmdq) libswdctx->cmdqptr.flushed=libswdctx->cmdqptr.exectail;
   return 1;
  }
 
+ // Transmit span of the pending elements, see libswd_cmdq_flush_span().
+ // Driver batch entry point is preferred, see libswd_batch_t, unless the
+ // probe executes whole transactions (blocks of transfer records).
+ // Elements left by the error handling are transmitted one by one below,
+ // or gathered again when driver has no per-command entry points.
+ if (ctxcmdq && (transaction || (caps&LIBSWD_DRIVER_CAP_BATCH))){
+  res=libswd_cmdq_flush_span(libswdctx, &firstcmd, lastcmd, caps, transaction);
+  if (res<0) return res;
+  cmdcnt+=res;
+  if (firstcmd==NULL){
+   *cmdq=lastcmd;
+   libswdctx->cmdqptr.exectail=lastcmd;
+   libswdctx->cmdqptr.flushed=lastcmd;
+   return cmdcnt;
+  }
+ }
+
  for (cmd=firstcmd;;cmd=cmd->next){
   if (cmd->done){
    if (cmd->next){
@@ -244,6 +456,41 @@ int libswd_cmdq_flush(libswd_ctx_t *libswdctx, libswd_cmd_t **cmdq, libswd_opera
   if (cmd==lastcmd) break;
  } 
  *cmdq=cmd;
+ if (ctxcmdq){
+  libswdctx->cmdqptr.exectail=cmd;
+  libswdctx->cmdqptr.flushed=cmd;
+ }
+ return cmdcnt;
+}
+
+/** Retire consumed elements from the head of the context command queue.
+ * Oldest elements are put back into the element pool until no more than
+ * keep elements are left on the queue. Only elements before
+ * libswdctx->cmdqptr.consumed, that were executed before the caller's
+ * last flush, are retired. Queue root, the last executed element and
+ * elements not yet executed are never retired. Pointers to the results
+ * of retired elements become invalid.
+ * \param *libswdctx swd context pointer.
+ * \param keep number of elements that may be left on the queue.
+ * \return number of elements retired, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_cmdq_retire(libswd_ctx_t *libswdctx, int keep){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (keep<0) return LIBSWD_ERROR_PARAM;
+ int cmdcnt=0;
+ libswd_cmd_t *cmdqhead, *cmd;
+ cmdqhead=libswdctx->cmdqptr.head;
+ if (cmdqhead==NULL) return LIBSWD_ERROR_NULLQUEUE;
+ while (libswdctx->cmdqptr.len>keep && libswdctx->cmdqptr.consumed!=cmdqhead){
+  cmd=cmdqhead->next;
+  if (cmd==NULL || cmd->next==NULL || !cmd->done) break;
+  if (cmd==libswdctx->cmdqptr.exectail || cmd==libswdctx->cmdqptr.consumed) break;
+  cmdqhead->next=cmd->next;
+  cmd->next->prev=cmdqhead;
+  libswd_cmdq_pool_put(libswdctx, cmd);
+  libswdctx->cmdqptr.len--;
+  cmdcnt++;
+ }
  return cmdcnt;
 }
 
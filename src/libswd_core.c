@@ -49,6 +49,7 @@
  */
 libswd_ctx_t *libswd_init(void){
  libswd_ctx_t *libswdctx;
+ int i;
  libswdctx=(libswd_ctx_t *)calloc(1,sizeof(libswd_ctx_t));
  if (libswdctx==NULL) return NULL;
  libswdctx->driver=(libswd_driver_t *)calloc(1,sizeof(libswd_driver_t));
@@ -56,16 +57,28 @@ libswd_ctx_t *libswd_init(void){
   free(libswdctx);
   return NULL;
  }
- libswdctx->cmdq=(libswd_cmd_t *)calloc(1,sizeof(libswd_cmd_t));
+ libswd_drv_init(libswdctx);
+ libswdctx->cmdq=libswd_cmdq_pool_get(libswdctx);
  if (libswdctx->cmdq==NULL) {
   libswd_deinit_ctx(libswdctx);
   return NULL;
  }
+ libswdctx->cmdqptr.head=libswdctx->cmdq;
+ libswdctx->cmdqptr.tail=libswdctx->cmdq;
+ libswdctx->cmdqptr.exectail=libswdctx->cmdq;
+ libswdctx->cmdqptr.flushed=libswdctx->cmdq;
+ libswdctx->cmdqptr.consumed=libswdctx->cmdq;
  libswdctx->config.initialized=LIBSWD_TRUE;
  libswdctx->config.trnlen=LIBSWD_TURNROUND_DEFAULT_VAL;
  libswdctx->config.maxcmdqlen=LIBSWD_CMDQLEN_DEFAULT;
  libswdctx->config.loglevel=LIBSWD_LOGLEVEL_DEFAULT;
  libswdctx->config.autofixerrors=LIBSWD_AUTOFIX_DEFAULT;
+ libswdctx->config.cmdqring=LIBSWD_CMDQRING_DEFAULT;
+ libswdctx->config.cmdqpipelined=LIBSWD_CMDQPIPELINED_DEFAULT;
+ libswdctx->config.batchmaxlen=LIBSWD_BATCHMAXLEN_DEFAULT;
+ libswdctx->config.stickydeferred=LIBSWD_STICKYDEFERRED_DEFAULT;
+ libswdctx->config.apidle=LIBSWD_APIDLE_DEFAULT;
+ for (i=0;i<LIBSWD_RETRY_CLASS_COUNT;i++) libswd_retry_policy_set(libswdctx, i, NULL);
  libswd_log(libswdctx, LIBSWD_LOGLEVEL_NORMAL, "LIBSWD_N: Using " PACKAGE_STRING " (http://libswd.sf.net)\nLIBSWD_N: (c) Tomasz Boleslaw CEDRO (http://www.tomek.cedro.info)\n");
  return libswdctx;
 }
@@ -82,14 +95,36 @@ int libswd_deinit_ctx(libswd_ctx_t *libswdctx){
 }
 
 /** De-initialize command queue and free its memory on selected swd context.
+ * This also releases the command queue element pool.
  * \param *libswdctx swd context pointer.
  * \return number of commands freed, or LIBSWD_ERROR_CODE on failure.
  */ 
 int libswd_deinit_cmdq(libswd_ctx_t *libswdctx){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLPOINTER;
  int res;
- res=libswd_cmdq_free(libswdctx->cmdq);
+ res=libswd_cmdq_free(libswdctx, libswdctx->cmdqptr.head);
  if (res<0) return res;
+ libswd_cmdq_pool_free(libswdctx);
+ libswdctx->cmdq=NULL;
+ libswdctx->cmdqptr.head=NULL;
+ libswdctx->cmdqptr.tail=NULL;
+ libswdctx->cmdqptr.exectail=NULL;
+ libswdctx->cmdqptr.flushed=NULL;
+ libswdctx->cmdqptr.consumed=NULL;
+ libswdctx->cmdqptr.len=0;
+ free(libswdctx->cmdqspan.cmd);
+ free(libswdctx->cmdqspan.data);
+ memset(&libswdctx->cmdqspan, 0, sizeof(libswd_cmdqspan_t));
+ free(libswdctx->batch.mosi);
+ free(libswdctx->batch.miso);
+ free(libswdctx->batch.dir);
+ free(libswdctx->batch.pos);
+ free(libswdctx->batch.words);
+ free(libswdctx->batch.parities);
+ memset(&libswdctx->batch, 0, sizeof(libswd_batch_t));
+ free(libswdctx->stage.cycle);
+ free(libswdctx->stage.rxpos);
+ memset(&libswdctx->stage, 0, sizeof(libswd_stage_t));
  return res;
 }
 
@@ -93,7 +93,8 @@ int libswd_dap_setup(libswd_ctx_t *libswdctx, libswd_operation_t operation, int
             "LIBSWD_D: libswd_dap_setup(*libswdctx=@%p, operation=%s, *abort=0x%X@%p, *ctrlstat=0x%X@%p) entring function...\n",
             (void*)libswdctx, libswd_operation_string(operation), abort?*abort:0, (void*)abort, ctrlstat?*ctrlstat:0, (void*)ctrlstat );
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
- int i, res;
+ int res;
+ libswd_retry_t retry;
  if (abort)
  {
   res=libswd_dp_write(libswdctx, operation, LIBSWD_DP_ABORT_ADDR, abort);
@@ -107,19 +108,18 @@ int libswd_dap_setup(libswd_ctx_t *libswdctx, libswd_operation_t operation, int
   res=libswd_dp_write(libswdctx, operation, LIBSWD_DP_CTRLSTAT_ADDR, ctrlstat);
   if (res<0) goto libswd_dap_setup_error; 
   // Wait for System and Debug Unit powerup.
-  for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+  for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_POWERUP, &retry); libswd_retry_next(&retry);)
   {
    res=libswd_dp_read(libswdctx, operation, LIBSWD_DP_CTRLSTAT_ADDR, &ctrlstat);
    if (res<0) goto libswd_dap_setup_error;
    if (*ctrlstat&(LIBSWD_DP_CTRLSTAT_CDBGPWRUPACK|LIBSWD_DP_CTRLSTAT_CSYSPWRUPACK)) break;
-   usleep(LIBSWD_RETRY_DELAY_DEFAULT);
   }
   libswdctx->log.dp.ctrlstat=*ctrlstat;
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
              "LIBSWD_I: libswd_dap_setup(): DP CTRL/STAT=0x%08X\n",
              libswdctx->log.dp.ctrlstat );
   // Return error if CDBGPWRUPACK and CSYSPWRUPACK flags are not set in CTRL/STAT.
-  if (!i)
+  if (retry.expired)
   {
    libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
               "LIBSWD_W: libswd_dap_setup(): CDBGPWRUPACK/CSYSPWRUPACK not set in DP CTRL/STAT!\n",
@@ -216,6 +216,8 @@ int libswd_dap_select(libswd_ctx_t *libswdctx, libswd_operation_t operation){
  * This function is helpful for clearing sticky errors.
  * ABORT register flags are additionally bitmasked by a function parameter,
  * so called can control which bits can be set (0xFFFFFFFF allows all).
+ * Probes that execute whole SWD transactions get transfer records instead,
+ * CTRL/STAT is then stored into *ctrlstat on execution.
  * \param *libswdctx swd context pointer.
  * \param operation operation type.
  * \param *ctrlstat will hold the CTRL/STAT register value.
@@ -231,33 +233,226 @@ int libswd_dap_errors_handle(libswd_ctx_t *libswdctx, libswd_operation_t operati
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (operation!=LIBSWD_OPERATION_EXECUTE && operation!=LIBSWD_OPERATION_ENQUEUE) return LIBSWD_ERROR_BADOPCODE;
 
- int res, abortreg;
- char APnDP=0, R=1, W=0, ctrlstat_addr=LIBSWD_DP_CTRLSTAT_ADDR, abort_addr=LIBSWD_DP_ABORT_ADDR, *ack, *parity, cparity;
+ int res, abortreg, transaction;
+ char request, *ack, *parity;
+ res=libswd_drv_caps(libswdctx);
+ if (res<0) return res;
+ transaction=res&LIBSWD_DRIVER_CAP_TRANSACTION;
  if (abort) {
   *abort=*abort&(LIBSWD_DP_ABORT_STKCMPCLR|LIBSWD_DP_ABORT_STKERRCLR|LIBSWD_DP_ABORT_WDERRCLR|LIBSWD_DP_ABORT_ORUNERRCLR); 
-  res=libswd_bus_write_request(libswdctx, operation, &APnDP, &W, &abort_addr);
-  if (res<0) return res;
-  res=libswd_bus_read_ack(libswdctx, operation, &ack);
-  if (res<0) return res;
-  res=libswd_bus_write_data_ap(libswdctx, operation, abort);
-  if (res<0) return res;
+  request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(0, 0, LIBSWD_DP_ABORT_ADDR)];
+  if (transaction){
+   res=libswd_bus_transfer_write(libswdctx, operation, &request, abort, NULL);
+   if (res<0) return res;
+  } else {
+   res=libswd_bus_write_request_raw(libswdctx, operation, &request);
+   if (res<0) return res;
+   res=libswd_bus_read_ack(libswdctx, operation, &ack);
+   if (res<0) return res;
+   res=libswd_bus_write_data_ap(libswdctx, operation, abort);
+   if (res<0) return res;
+  }
  }
  if (ctrlstat){
-  res=libswd_bus_write_request(libswdctx, operation, &APnDP, &R, &ctrlstat_addr); 
+  request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(0, 1, LIBSWD_DP_CTRLSTAT_ADDR)];
+  if (transaction){
+   res=libswd_bus_transfer_read_buf(libswdctx, operation, &request, (char*)ctrlstat, 0, 4);
+   if (res<0) return res;
+   if (operation==LIBSWD_OPERATION_EXECUTE) libswdctx->log.dp.ctrlstat=*ctrlstat;
+   return LIBSWD_OK;
+  }
+  res=libswd_bus_write_request_raw(libswdctx, operation, &request);
   if (res<0) return res;
   res=libswd_bus_read_ack(libswdctx, operation, &ack);
   if (res<0) return res;
+  // Data parity is verified by the driver on execution.
   res=libswd_bus_read_data_p(libswdctx, operation, &ctrlstat, &parity);
   if (res<0) return res;
-  res=libswd_bin32_parity_even(ctrlstat, &cparity);
-  if (res<0) return res;
-  if (*parity!=cparity) return LIBSWD_ERROR_PARITY;
   libswdctx->log.dp.ctrlstat=*ctrlstat;
  }
  return LIBSWD_OK;
 }
 
 
+/** Check CTRL/STAT sticky error flags once for a whole block of operations.
+ * With libswdctx->config.stickydeferred set AP reads do not clear the sticky
+ * flags after each access, block transfers (i.e. libswd_memap_read_int()) or
+ * application after a queue flush call this function instead, so the failure
+ * is attributed to the whole block. STICKYERR, STICKYORUN, WDATAERR and
+ * STICKYCMP found set are cleared with ABORT write.
+ * \param *libswdctx swd context pointer.
+ * \param *ctrlstat will hold the CTRL/STAT register value (can be NULL).
+ * \return LIBSWD_OK if no sticky flag was set, LIBSWD_ERROR_STICKY if flags were cleared, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_dap_sticky_check(libswd_ctx_t *libswdctx, int *ctrlstat){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+
+ int res, value, abort=0;
+
+ res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, NULL, &value);
+ if (res<0) return res;
+ value=libswdctx->log.dp.ctrlstat;
+ if (ctrlstat) *ctrlstat=value;
+ if (value&LIBSWD_DP_CTRLSTAT_STICKYERR) abort|=LIBSWD_DP_ABORT_STKERRCLR;
+ if (value&LIBSWD_DP_CTRLSTAT_STICKYORUN) abort|=LIBSWD_DP_ABORT_ORUNERRCLR;
+ if (value&LIBSWD_DP_CTRLSTAT_WDATAERR) abort|=LIBSWD_DP_ABORT_WDERRCLR;
+ if (value&LIBSWD_DP_CTRLSTAT_STICKYCMP) abort|=LIBSWD_DP_ABORT_STKCMPCLR;
+ if (!abort) return LIBSWD_OK;
+
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
+            "LIBSWD_W: libswd_dap_sticky_check(libswdctx=@%p): CTRL/STAT=0x%08X has sticky error flags set, block failed.\n",
+            (void*)libswdctx, value);
+ res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, NULL);
+ if (res<0) return res;
+ return LIBSWD_ERROR_STICKY;
+}
+
+
+/** Find the idle cycles entry of the IDCODE/AP pair.
+ * When create is set and the pair is not yet known a free entry is taken,
+ * or the least recently created one is dropped if all are taken.
+ * \param *libswdctx swd context pointer.
+ * \param idcode is the target IDCODE.
+ * \param ap is the AP number (APSEL).
+ * \param create allows creating a new entry.
+ * \return entry pointer or NULL if not found.
+ */
+static libswd_apidle_t *libswd_dap_apidle_entry(libswd_ctx_t *libswdctx, int idcode, int ap, int create){
+ int i;
+ for (i=0;i<LIBSWD_APIDLE_SLOTS;i++){
+  if (libswdctx->apidle[i].idcode==0) break;
+  if (libswdctx->apidle[i].idcode==idcode && libswdctx->apidle[i].ap==ap) return &libswdctx->apidle[i];
+ }
+ if (!create) return NULL;
+ // Newest entry goes first, the oldest one falls off the end.
+ if (i==LIBSWD_APIDLE_SLOTS) i--;
+ memmove(&libswdctx->apidle[1], &libswdctx->apidle[0], i*sizeof(libswd_apidle_t));
+ i=0;
+ memset(&libswdctx->apidle[i], 0, sizeof(libswd_apidle_t));
+ libswdctx->apidle[i].idcode=idcode;
+ libswdctx->apidle[i].ap=ap;
+ return &libswdctx->apidle[i];
+}
+
+/** Entry of the currently selected AP, created on first use.
+ * \param *libswdctx swd context pointer.
+ * \return entry pointer or NULL if IDCODE is not yet known.
+ */
+static libswd_apidle_t *libswd_dap_apidle_current(libswd_ctx_t *libswdctx){
+ if (!libswdctx->log.dp.idcode) return NULL;
+ return libswd_dap_apidle_entry(libswdctx, libswdctx->log.dp.idcode,
+  (libswdctx->log.dp.select&LIBSWD_DP_SELECT_APSEL)>>LIBSWD_DP_SELECT_APSEL_BITNUM, 1);
+}
+
+/** Enqueue idle cycles tuned for the selected AP after its access.
+ * \param *libswdctx swd context pointer.
+ * \param rnw is 1 after AP read, 0 after AP write.
+ * \return number of elements enqueued or LIBSWD_ERROR code on failure.
+ */
+static int libswd_dap_apidle_enqueue(libswd_ctx_t *libswdctx, int rnw){
+ int i, res, cmdcnt=0;
+ libswd_apidle_t *entry;
+ if (!libswdctx->config.apidle) return 0;
+ entry=libswd_dap_apidle_current(libswdctx);
+ if (entry==NULL) return 0;
+ entry->last=rnw;
+ for (i=0;i<entry->idle[rnw];i+=LIBSWD_APIDLE_STEP){
+  res=libswd_cmd_enqueue_mosi_idle(libswdctx);
+  if (res<0) return res;
+  cmdcnt+=res;
+ }
+ return cmdcnt;
+}
+
+/** Tune idle cycles of the selected AP with the outcome of its accesses.
+ * WAIT doubles the idle cycles after the last access type so the retry
+ * path stays the rare case, every LIBSWD_APIDLE_WINDOW accesses without
+ * WAIT remove one step again. Only AP accesses are tuned, WAIT on DP
+ * accesses does not change the idle cycles.
+ * \param *libswdctx swd context pointer.
+ * \param accesses is the number of accesses completed without WAIT.
+ * \param wait is set when a transfer was answered with WAIT.
+ */
+static void libswd_dap_apidle_update(libswd_ctx_t *libswdctx, int accesses, int wait){
+ libswd_apidle_t *entry;
+ if (!libswdctx->config.apidle) return;
+ entry=libswd_dap_apidle_current(libswdctx);
+ if (entry==NULL) return;
+ int *idle=&entry->idle[entry->last];
+ entry->quiet[entry->last]+=accesses;
+ if (wait){
+  entry->waits[entry->last]++;
+  entry->quiet[entry->last]=0;
+  if (*idle>=LIBSWD_APIDLE_MAX) return;
+  *idle=*idle?*idle*2:LIBSWD_APIDLE_STEP;
+  if (*idle>LIBSWD_APIDLE_MAX) *idle=LIBSWD_APIDLE_MAX;
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG,
+             "LIBSWD_D: libswd_dap_apidle_update(libswdctx=@%p): IDCODE=0x%08X AP=%d %s idle cycles increased to %d.\n",
+             (void*)libswdctx, entry->idcode, entry->ap, entry->last?"read":"write", *idle);
+ } else if (entry->quiet[entry->last]>=LIBSWD_APIDLE_WINDOW && *idle){
+  entry->quiet[entry->last]=0;
+  *idle-=LIBSWD_APIDLE_STEP;
+ }
+}
+
+/** Number of AP accesses of a stream that may be enqueued before a flush.
+ * Ring command queue (see libswd_cmd_enqueue()) only retires elements that
+ * were executed before the previous flush, so a stream takes at most a
+ * quarter of config.maxcmdqlen, each access counted with its idle cycles.
+ * \param *libswdctx swd context pointer.
+ * \param rnw is 1 for AP reads, 0 for AP writes.
+ * \param count is the number of accesses in the stream.
+ * \return number of accesses to enqueue at once (1..count).
+ */
+static int libswd_dap_ring_chunk(libswd_ctx_t *libswdctx, int rnw, int count){
+ int chunk, elements=1;
+ libswd_apidle_t *entry;
+ if (!libswdctx->config.cmdqring) return count;
+ if (libswdctx->config.apidle){
+  entry=libswd_dap_apidle_current(libswdctx);
+  if (entry) elements+=(entry->idle[rnw]+LIBSWD_APIDLE_STEP-1)/LIBSWD_APIDLE_STEP;
+ }
+ chunk=libswdctx->config.maxcmdqlen/4/elements;
+ if (chunk<1) chunk=1;
+ return (chunk<count)?chunk:count;
+}
+
+/** Get idle cycles tuned for the AP of the target with given IDCODE.
+ * Application can save the values to restore them on the next session.
+ * \param *libswdctx swd context pointer.
+ * \param idcode is the target IDCODE.
+ * \param ap is the AP number (APSEL).
+ * \param rnw is 1 for AP reads, 0 for AP writes.
+ * \return number of idle cycles (0 if not tuned) or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_dap_apidle_get(libswd_ctx_t *libswdctx, int idcode, int ap, int rnw){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (rnw!=0 && rnw!=1) return LIBSWD_ERROR_PARAM;
+ libswd_apidle_t *entry=libswd_dap_apidle_entry(libswdctx, idcode, ap, 0);
+ return entry?entry->idle[rnw]:0;
+}
+
+/** Set idle cycles for the AP of the target with given IDCODE.
+ * Value is rounded up to LIBSWD_APIDLE_STEP and used as the tuning start.
+ * Idle cycles tuning (libswdctx->config.apidle) is enabled as well.
+ * \param *libswdctx swd context pointer.
+ * \param idcode is the target IDCODE.
+ * \param ap is the AP number (APSEL).
+ * \param rnw is 1 for AP reads, 0 for AP writes.
+ * \param cycles is the number of idle cycles (0..LIBSWD_APIDLE_MAX).
+ * \return LIBSWD_OK on success or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_dap_apidle_set(libswd_ctx_t *libswdctx, int idcode, int ap, int rnw, int cycles){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (idcode==0 || (rnw!=0 && rnw!=1) || cycles<0 || cycles>LIBSWD_APIDLE_MAX) return LIBSWD_ERROR_PARAM;
+ libswd_apidle_t *entry=libswd_dap_apidle_entry(libswdctx, idcode, ap, 1);
+ entry->idle[rnw]=(cycles+LIBSWD_APIDLE_STEP-1)/LIBSWD_APIDLE_STEP*LIBSWD_APIDLE_STEP;
+ entry->quiet[rnw]=0;
+ libswdctx->config.apidle=LIBSWD_TRUE;
+ return LIBSWD_OK;
+}
+
+
 /** Macro: Read out IDCODE register and return its value on function return.
  * \param *libswdctx swd context pointer.
  * \param operation operation type.
@@ -271,12 +466,30 @@ int libswd_dp_read_idcode(libswd_ctx_t *libswdctx, libswd_operation_t operation,
          return LIBSWD_ERROR_BADOPCODE;
 
  int res, cmdcnt=0;
- char APnDP, RnW, addr, cparity, *ack, *parity;
+ char APnDP, RnW, addr, request, *ack, *parity;
 
  APnDP=0;
  RnW=1;
  addr=LIBSWD_DP_IDCODE_ADDR;
 
+ // Probes that execute whole SWD transactions get a transfer record.
+ res=libswd_drv_caps(libswdctx);
+ if (res<0) return res;
+ if (res&LIBSWD_DRIVER_CAP_TRANSACTION){
+  request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(APnDP, RnW, addr)];
+  libswdctx->qlog.read.request=request;
+  if (operation==LIBSWD_OPERATION_ENQUEUE)
+   return libswd_bus_transfer_read(libswdctx, operation, &request, NULL, NULL, NULL);
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, idcode, &ack, &parity);
+  if (res<0) return res;
+  cmdcnt=res;
+  libswdctx->log.dp.idcode=**idcode;
+  libswdctx->log.dp.parity=*parity;
+  libswdctx->log.dp.ack   =*ack;
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "LIBSWD_I: libswd_dp_read_idcode(libswdctx=@%p, operation=%s, **idcode=0x%X/%s).\n", (void*)libswdctx, libswd_operation_string(operation), **idcode, libswd_bin32_string(*idcode));
+  return cmdcnt;
+ }
+
  res=libswd_bus_write_request(libswdctx, LIBSWD_OPERATION_ENQUEUE, &APnDP, &RnW, &addr);
  if (res<1) return res;
  cmdcnt=+res;
@@ -300,9 +513,7 @@ int libswd_dp_read_idcode(libswd_ctx_t *libswdctx, libswd_operation_t operation,
   libswdctx->log.dp.idcode=**idcode;
   libswdctx->log.dp.parity=*parity;
   libswdctx->log.dp.ack   =*ack;
-  res=libswd_bin32_parity_even(*idcode, &cparity); 
-  if (res<0) return res;
-  if (cparity!=*parity) return LIBSWD_ERROR_PARITY;
+  // Data parity was already verified by the driver on execution.
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "LIBSWD_I: libswd_dp_read_idcode(libswdctx=@%p, operation=%s, **idcode=0x%X/%s).\n", (void*)libswdctx, libswd_operation_string(operation), **idcode, libswd_bin32_string(*idcode));
   return cmdcnt;
  } else return LIBSWD_ERROR_BADOPCODE;
@@ -343,53 +554,37 @@ int libswd_dp_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char a
   return LIBSWD_ERROR_BADOPCODE;
 
  int res, cmdcnt=0;
- char APnDP, RnW, cparity, *ack, *parity, request;
+ char request;
 
- APnDP=0;
- RnW=1;
-
- res=libswd_bitgen8_request(libswdctx, &APnDP, &RnW, &addr, &request);
- if (res<0) return res;
- res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
- if (res<1) return res;
- cmdcnt=+res;
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(0, 1, addr)];
+ libswdctx->qlog.read.request=request;
 
  if (operation==LIBSWD_OPERATION_ENQUEUE){
-  res=libswd_bus_read_ack(libswdctx, operation, (char**)&libswdctx->qlog.read.ack);
-  if (res<1) return res;
-  cmdcnt=+res;
-  res=libswd_bus_read_data_p(libswdctx, operation, (int**)&data, (char**)&libswdctx->qlog.read.parity);
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, data, NULL, NULL);
   if (res<1) return res;
   cmdcnt=+res;
   return cmdcnt;
 
  } else if (operation==LIBSWD_OPERATION_EXECUTE){
-  res=libswd_bus_read_ack(libswdctx, operation, &ack);
+  // ACK and data parity are verified by the driver on transfer execution.
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, data, NULL, NULL);
   if (res>=0) {
-   res=libswd_bus_read_data_p(libswdctx, operation, data, &parity);
-   if (res<0) return res;
-   res=libswd_bin32_parity_even(*data, &cparity); 
-   if (res<0) return res;
-   if (cparity!=*parity) return LIBSWD_ERROR_PARITY;
    cmdcnt=+res;
   } else if (res==LIBSWD_ERROR_ACK_WAIT) {
    //We got ACK==WAIT, retry last transfer until success or failure.
-   int retry, ctrlstat, abort;
-   for (retry=LIBSWD_RETRY_COUNT_DEFAULT; retry>0; retry--){
+   int ctrlstat, abort;
+   libswd_retry_t retry;
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
     abort=0xFFFFFFFE;
     res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat);
     if (res<0) continue;
-    res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
-    if (res<0) continue; 
-    res=libswd_bus_read_ack(libswdctx, LIBSWD_OPERATION_EXECUTE, &ack);
-    if (res<0) continue;
-    res=libswd_bus_read_data_p(libswdctx, LIBSWD_OPERATION_EXECUTE, data, &parity);
+    res=libswd_bus_transfer_read(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, data, NULL, NULL);
     if (res<0) continue;
     res=libswd_dp_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_RDBUFF_ADDR, data);
     if (res<0) continue;
     break;
    }
-   if (retry==0) return LIBSWD_ERROR_MAXRETRY;
+   if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
   }
   if (res<0) {
    libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_dp_read(libswdctx=@%p, operation=%s, addr=0x%X, **data=0x%X/%s) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, **data, libswd_bin32_string(*data), libswd_error_string(res));
@@ -411,6 +606,78 @@ int libswd_dp_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char a
  } else return LIBSWD_ERROR_BADOPCODE;
 } 
 
+/** Macro: Generic read of the DP register into the caller buffer.
+ * Read data is deposited into the buffer by the flush engine, so no pointers
+ * into the queue elements are returned (see libswd_cmd_enqueue_transfer_read_buf()).
+ * When operation is LIBSWD_OPERATION_EXECUTE it also caches register values.
+ * \param *libswdctx swd context to work on.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param addr is the address of the DP register to read.
+ * \param *buf is the caller buffer where result will be stored.
+ * \param offset is the byte offset of the result in the buffer.
+ * \param len is the number of low-order result bytes to store (1..4).
+ * \return number of elements processed or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_dp_read_buf(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, char *buf, int offset, int len){
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_dp_read_buf(libswdctx=@%p, operation=%s, addr=0x%X, *buf=%p, offset=%d, len=%d) entering function...\n", (void*)libswdctx, libswd_operation_string(operation), addr, (void*)buf, offset, len);
+
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT; 
+ if (buf==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+
+ int res, cmdcnt=0, data;
+ char request;
+
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(0, 1, addr)];
+ libswdctx->qlog.read.request=request;
+
+ if (operation==LIBSWD_OPERATION_ENQUEUE){
+  res=libswd_bus_transfer_read_buf(libswdctx, operation, &request, buf, offset, len);
+  if (res<1) return res;
+  cmdcnt=+res;
+  return cmdcnt;
+
+ } else if (operation==LIBSWD_OPERATION_EXECUTE){
+  // ACK and data parity are verified by the driver on transfer execution.
+  res=libswd_bus_transfer_read_buf(libswdctx, operation, &request, buf, offset, len);
+  if (res>=0) {
+   cmdcnt=+res;
+  } else if (res==LIBSWD_ERROR_ACK_WAIT) {
+   //We got ACK==WAIT, retry last transfer until success or failure.
+   int ctrlstat, abort;
+   libswd_retry_t retry;
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
+    abort=0xFFFFFFFE;
+    res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat);
+    if (res<0) continue;
+    res=libswd_bus_transfer_read_buf(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, buf, offset, len);
+    if (res<0) continue;
+    break;
+   }
+   if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
+  }
+  if (res<0) {
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_dp_read_buf(libswdctx=@%p, operation=%s, addr=0x%X) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, libswd_error_string(res));
+   return res;
+  }
+  // Driver keeps the last read data in the context log.
+  data=libswdctx->log.read.data;
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_dp_read_buf(libswdctx=@%p, operation=%s, addr=0x%X, data=0x%X/%s) execution OK.\n", (void*)libswdctx, libswd_operation_string(operation), addr, data, libswd_bin32_string(&data));
+  switch(addr){
+   case LIBSWD_DP_IDCODE_ADDR: libswdctx->log.dp.idcode=data; break;
+   case LIBSWD_DP_RDBUFF_ADDR: libswdctx->log.dp.rdbuff=data; break;
+   case LIBSWD_DP_RESEND_ADDR: libswdctx->log.dp.resend=data; break;
+   case LIBSWD_DP_CTRLSTAT_ADDR: // which is also LIBSWD_DP_WCR_ADDR
+    if (libswdctx->log.dp.select&LIBSWD_DP_SELECT_CTRLSEL){
+     libswdctx->log.dp.wcr=data;
+    } else libswdctx->log.dp.ctrlstat=data;
+    break;
+  }
+  return cmdcnt;
+ } else return LIBSWD_ERROR_BADOPCODE;
+} 
+
 /** Macro function: Generic write of the DP register.
  * When operation is LIBSWD_OPERATION_EXECUTE it also caches register values.
  * \param *libswdctx swd context to work on.
@@ -428,48 +695,36 @@ int libswd_dp_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char
   return LIBSWD_ERROR_BADOPCODE;
 
  int res, cmdcnt=0;
- char APnDP, RnW, cparity, *ack, *parity, request;
+ char request;
 
- APnDP=0;
- RnW=0;
-
- res=libswd_bitgen8_request(libswdctx, &APnDP, &RnW, &addr, &request);
- if (res<0) return res; 
- res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
- if (res<1) return res;
- cmdcnt=+res;
-
- libswd_bin32_parity_even(data, (char *)&libswdctx->qlog.write.parity);
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(0, 0, addr)];
+ libswdctx->qlog.write.request=request;
+ libswdctx->qlog.write.data=*data;
+ libswd_bin32_parity_even(data, &libswdctx->qlog.write.parity);
 
  if (operation==LIBSWD_OPERATION_ENQUEUE){
-  res=libswd_bus_read_ack(libswdctx, operation, (char**)&libswdctx->qlog.write.ack);
-  if (res<1) return res;
-  cmdcnt=+res;
-  res=libswd_bus_write_data_ap(libswdctx, operation, data);
+  res=libswd_bus_transfer_write(libswdctx, operation, &request, data, NULL);
   if (res<1) return res;
   cmdcnt=+res;
   return cmdcnt;
 
  } else if (operation==LIBSWD_OPERATION_EXECUTE){
-  res=libswd_bus_read_ack(libswdctx, operation, &ack);
+  res=libswd_bus_transfer_write(libswdctx, operation, &request, data, NULL);
   if (res>=0) {
-   res=libswd_bus_write_data_ap(libswdctx, operation, data);
+   cmdcnt=+res;
   } else if (res==LIBSWD_ERROR_ACK_WAIT) {
    //We got ACK==WAIT, retry last transfer until success or failure.
-   int retry, ctrlstat, abort;
-   for (retry=LIBSWD_RETRY_COUNT_DEFAULT; retry>0; retry--){
+   int ctrlstat, abort;
+   libswd_retry_t retry;
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
     abort=0xFFFFFFFF;
     res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat); 
     if (res<0) continue;
-    res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
-    if (res<0) continue; 
-    res=libswd_bus_read_ack(libswdctx, LIBSWD_OPERATION_EXECUTE, &ack);
-    if (res<0) continue;
-    res=libswd_bus_write_data_ap(libswdctx, LIBSWD_OPERATION_EXECUTE, data);
+    res=libswd_bus_transfer_write(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, data, NULL);
     if (res<0) continue;
     break;
    }
-   if (retry==0) return LIBSWD_ERROR_MAXRETRY;
+   if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
   }
   if (res<0) {
    libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_dp_write(libswdctx=@%p, operation=%s, addr=0x%X, *data=0x%X/%s) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, *data, libswd_bin32_string(data), libswd_error_string(res));
@@ -562,61 +817,271 @@ int libswd_ap_read(libswd_ctx_t *libswdctx, libswd_operation_t operation, char a
  if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
   return LIBSWD_ERROR_BADOPCODE;
 
- int res, cmdcnt=0, retry, ctrlstat, abort;
- char APnDP, RnW, cparity, *ack, *parity, request;
+ int res, cmdcnt=0, ctrlstat, abort;
+ libswd_retry_t retry;
+ char request;
 
  res=libswd_ap_bank_select(libswdctx, LIBSWD_OPERATION_ENQUEUE, addr);
  if (res<0) return res;
 
- APnDP=1;
- RnW=1;
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(1, 1, addr)];
+ libswdctx->qlog.read.request=request;
+
+ if (operation==LIBSWD_OPERATION_ENQUEUE){
+  // AP read result is posted, it has to be collected with RDBUFF read.
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, NULL, NULL, NULL);
+  if (res<1) return res;
+  cmdcnt=+res;
+  res=libswd_dap_apidle_enqueue(libswdctx, 1);
+  if (res<0) return res;
+  cmdcnt+=res;
+  return cmdcnt;
 
- res=libswd_bitgen8_request(libswdctx, &APnDP, &RnW, &addr, &request);
+ } else if (operation==LIBSWD_OPERATION_EXECUTE){
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, data, NULL, NULL);
+  if (res>=0) {
+   cmdcnt=+res;
+  } else if (res==LIBSWD_ERROR_ACK_WAIT) {
+   //We got ACK==WAIT, retry last transfer until success or failure.
+   libswd_dap_apidle_update(libswdctx, 0, 1);
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
+    abort=0xFFFFFFFE;
+    res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, NULL);
+    if (res<0) continue;
+    res=libswd_bus_transfer_read(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, data, NULL, NULL);
+    if (res<0) continue;
+   break;
+   }
+   if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
+  }
+  // Give the AP time to complete the read before RDBUFF collects it.
+  res=libswd_dap_apidle_enqueue(libswdctx, 1);
+  if (res<0) return res;
+  libswd_dap_apidle_update(libswdctx, 1, 0);
+  res=libswd_dp_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_RDBUFF_ADDR, data);
+  if (res<0) {
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_ap_read(libswdctx=@%p, operation=%s, addr=0x%X, **data=0x%X/%s) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, **data, libswd_bin32_string(*data), libswd_error_string(res));
+   return res;
+  }
+  // Clear all possible error flags that may remain, but don't abort transaction.
+  // With deferred checking they are checked once for the block instead.
+  if (!libswdctx->config.stickydeferred){
+   abort=0xFFFFFFFE;
+   res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat);
+   if (res<0) return res;
+  }
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_read(libswdctx=@%p, command=%s, addr=0x%X, **data=0x%X/%s) execution OK.\n", (void*)libswdctx, libswd_operation_string(operation), addr, **data, libswd_bin32_string(*data));
+  return cmdcnt;
+ } else return LIBSWD_ERROR_BADOPCODE;
+} 
+
+/** Macro function: Generic read of the AP register into the caller buffer.
+ * Posted AP read is always followed by the DP RDBUFF read that deposits the
+ * result into the buffer, so both operations can be safely enqueued many
+ * times and flushed at once. Address field should contain AP BANK on bits [4..7].
+ * \param *libswdctx swd context to work on.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param addr is the address of the AP register to read plus AP BANK on bits [4..7].
+ * \param *buf is the caller buffer where result will be stored.
+ * \param offset is the byte offset of the result in the buffer.
+ * \param len is the number of low-order result bytes to store (1..4).
+ * \return number of elements processed or LIBSWD_ERROR code on failure.
+ */
+int libswd_ap_read_buf(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, char *buf, int offset, int len){
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_read_buf(*libswdctx=%p, command=%s, addr=0x%X, *buf=%p, offset=%d, len=%d) entering function...\n", (void*)libswdctx, libswd_operation_string(operation), (unsigned char)addr, (void*)buf, offset, len);
+
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT; 
+ if (buf==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+
+ int res, cmdcnt=0, ctrlstat, abort, last=0;
+ libswd_retry_t retry;
+ char request;
+
+ res=libswd_ap_bank_select(libswdctx, LIBSWD_OPERATION_ENQUEUE, addr);
  if (res<0) return res;
- res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
- if (res<1) return res;
- cmdcnt=+res;
+
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(1, 1, addr)];
+ libswdctx->qlog.read.request=request;
 
  if (operation==LIBSWD_OPERATION_ENQUEUE){
-  res=libswd_bus_read_ack(libswdctx, operation, (char**)&libswdctx->qlog.read.ack);
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, NULL, NULL, NULL);
   if (res<1) return res;
   cmdcnt=+res;
-  res=libswd_bus_read_data_p(libswdctx, operation, (int**)&libswdctx->qlog.read.data, (char**)&libswdctx->qlog.read.parity);
+  res=libswd_dap_apidle_enqueue(libswdctx, 1);
+  if (res<0) return res;
+  cmdcnt+=res;
+  res=libswd_dp_read_buf(libswdctx, operation, LIBSWD_DP_RDBUFF_ADDR, buf, offset, len);
   if (res<1) return res;
   cmdcnt=+res;
   return cmdcnt;
 
  } else if (operation==LIBSWD_OPERATION_EXECUTE){
-  res=libswd_bus_read_ack(libswdctx, operation, &ack);
+  res=libswd_bus_transfer_read(libswdctx, operation, &request, NULL, NULL, NULL);
   if (res>=0) {
-   res=libswd_bus_read_data_p(libswdctx, operation, data, &parity);
-   if (res<0) return res;
+   cmdcnt=+res;
   } else if (res==LIBSWD_ERROR_ACK_WAIT) {
    //We got ACK==WAIT, retry last transfer until success or failure.
-   for (retry=LIBSWD_RETRY_COUNT_DEFAULT; retry>0; retry--){
+   libswd_dap_apidle_update(libswdctx, 0, 1);
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
     abort=0xFFFFFFFE;
     res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, NULL);
     if (res<0) continue;
-    res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
-    if (res<0) continue; 
-    res=libswd_bus_read_ack(libswdctx, LIBSWD_OPERATION_EXECUTE, &ack);
-    if (res<0) continue;
-    res=libswd_bus_read_data_p(libswdctx, LIBSWD_OPERATION_EXECUTE, data, &parity);
+    res=libswd_bus_transfer_read(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, NULL, NULL, NULL);
     if (res<0) continue;
    break;
    }
-   if (retry==0) return LIBSWD_ERROR_MAXRETRY;
+   if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
   }
-  res=libswd_dp_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_RDBUFF_ADDR, data);
+  // Give the AP time to complete the read before RDBUFF collects it.
+  res=libswd_dap_apidle_enqueue(libswdctx, 1);
+  if (res<0) return res;
+  libswd_dap_apidle_update(libswdctx, 1, 0);
+  res=libswd_dp_read_buf(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_RDBUFF_ADDR, buf, offset, len);
   if (res<0) {
-   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_ap_read(libswdctx=@%p, operation=%s, addr=0x%X, **data=0x%X/%s) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, **data, libswd_bin32_string(*data), libswd_error_string(res));
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_ap_read_buf(libswdctx=@%p, operation=%s, addr=0x%X) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, libswd_error_string(res));
    return res;
   }
   // Clear all possible error flags that may remain, but don't abort transaction.
-  abort=0xFFFFFFFE;
-  res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat);
+  // With deferred checking they are checked once for the block instead.
+  if (!libswdctx->config.stickydeferred){
+   abort=0xFFFFFFFE;
+   res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat);
+   if (res<0) return res;
+  }
+  memcpy(&last, buf+offset, len);
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_read_buf(libswdctx=@%p, command=%s, addr=0x%X, data=0x%X) execution OK.\n", (void*)libswdctx, libswd_operation_string(operation), addr, last);
+  return cmdcnt;
+ } else return LIBSWD_ERROR_BADOPCODE;
+} 
+
+/** Enqueue posted AP reads first..count-1 and the final DP RDBUFF read, see
+ * libswd_ap_read_buf_posted(). Each AP read collects the result of the one
+ * before it, so read k stores into slot k-1 and RDBUFF into the last slot.
+ * \param *libswdctx swd context to work on.
+ * \param *request is the AP read request to enqueue.
+ * \param *buf is the caller buffer where results will be stored.
+ * \param offset is the byte offset of the first result in the buffer.
+ * \param len is the number of low-order result bytes to store (1..4).
+ * \param first is the first AP read to enqueue (0..count).
+ * \param count is the number of AP reads in the sequence.
+ * \return number of elements enqueued or LIBSWD_ERROR code on failure.
+ */
+static int libswd_ap_read_buf_posted_enqueue(libswd_ctx_t *libswdctx, char *request, char *buf, int offset, int len, int first, int count){
+ int i, res, cmdcnt=0;
+ for (i=first;i<count;i++){
+  if (i==0){
+   res=libswd_bus_transfer_read(libswdctx, LIBSWD_OPERATION_ENQUEUE, request, NULL, NULL, NULL);
+  } else res=libswd_bus_transfer_read_buf(libswdctx, LIBSWD_OPERATION_ENQUEUE, request, buf, offset+(i-1)*len, len);
+  if (res<1) return res;
+  cmdcnt+=res;
+  res=libswd_dap_apidle_enqueue(libswdctx, 1);
   if (res<0) return res;
-  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_read(libswdctx=@%p, command=%s, addr=0x%X, **data=0x%X/%s) execution OK.\n", (void*)libswdctx, libswd_operation_string(operation), addr, **data, libswd_bin32_string(*data));
+  cmdcnt+=res;
+ }
+ res=libswd_dp_read_buf(libswdctx, LIBSWD_OPERATION_ENQUEUE, LIBSWD_DP_RDBUFF_ADDR, buf, offset+(count-1)*len, len);
+ if (res<1) return res;
+ cmdcnt+=res;
+ return cmdcnt;
+}
+
+/** Macro function: Pipelined read of the AP register into the caller buffer.
+ * AP reads are posted, result of each AP read is returned by the next one,
+ * so count reads are sent back to back, each collecting the result of its
+ * predecessor, and only the last result is collected with DP RDBUFF read.
+ * Reading count values costs count+1 transactions instead of two (plus
+ * error handling) for each libswd_ap_read_buf(). Meant for registers that
+ * are read repeatedly, i.e. MEM-AP DRW with TAR auto increment.
+ * On ACK=WAIT the sequence is resumed from the transfer that failed, results
+ * collected before it are already stored. Failed transfer is the last one
+ * left on the truncated queue, its index follows from the slot it stores into.
+ * With ring command queue long sequences are executed in parts, see
+ * libswd_dap_ring_chunk(), each part collected with its own RDBUFF read.
+ * Address field should contain AP BANK on bits [4..7].
+ * \param *libswdctx swd context to work on.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param addr is the address of the AP register to read plus AP BANK on bits [4..7].
+ * \param *buf is the caller buffer where results will be stored.
+ * \param offset is the byte offset of the first result in the buffer.
+ * \param len is the number of low-order bytes of each result to store (1..4), results are len bytes apart.
+ * \param count is the number of reads.
+ * \return number of elements processed or LIBSWD_ERROR code on failure.
+ */
+int libswd_ap_read_buf_posted(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, char *buf, int offset, int len, int count){
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_read_buf_posted(*libswdctx=%p, command=%s, addr=0x%X, *buf=%p, offset=%d, len=%d, count=%d) entering function...\n", (void*)libswdctx, libswd_operation_string(operation), (unsigned char)addr, (void*)buf, offset, len, count);
+
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT; 
+ if (buf==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+ if (count<1 || len<1 || len>4) return LIBSWD_ERROR_PARAM;
+
+ int res, cmdcnt=0, first, done, chunk, ctrlstat, abort, last=0;
+ libswd_retry_t retry;
+ char request;
+ libswd_cmd_t *cmd;
+
+ res=libswd_ap_bank_select(libswdctx, LIBSWD_OPERATION_ENQUEUE, addr);
+ if (res<0) return res;
+
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(1, 1, addr)];
+ libswdctx->qlog.read.request=request;
+
+ if (operation==LIBSWD_OPERATION_ENQUEUE){
+  return libswd_ap_read_buf_posted_enqueue(libswdctx, &request, buf, offset, len, 0, count);
+
+ } else if (operation==LIBSWD_OPERATION_EXECUTE){
+  // Ring queue takes long sequences in parts, each one posted on its own.
+  chunk=libswd_dap_ring_chunk(libswdctx, 1, count);
+  if (chunk<count){
+   for (first=0;first<count;first+=chunk){
+    res=libswd_ap_read_buf_posted(libswdctx, operation, addr, buf, offset+first*len, len, (count-first<chunk)?count-first:chunk);
+    if (res<0) return res;
+    cmdcnt+=res;
+   }
+   return cmdcnt;
+  }
+  first=0;
+  libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry);
+  libswd_retry_next(&retry);
+  while (1){
+   res=libswd_ap_read_buf_posted_enqueue(libswdctx, &request, buf, offset, len, first, count);
+   if (res<1) return res;
+   cmdcnt+=res;
+   res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, LIBSWD_OPERATION_EXECUTE);
+   if (res!=LIBSWD_ERROR_ACK_WAIT) break;
+   //We got ACK==WAIT, transfers before the failed one are done, resume from there.
+   //Retries are counted for the transfer that makes no progress.
+   //Read k stores into slot k-1, RDBUFF read into slot count-1.
+   done=first;
+   for (cmd=libswdctx->cmdqptr.tail; cmd && cmd->cmdtype!=LIBSWD_CMDTYPE_MOSI_TRANSFER; cmd=cmd->prev);
+   if (cmd && cmd->transfer.status==LIBSWD_ERROR_ACK_WAIT
+       && cmd->transfer.dest>=buf+offset+first*len && cmd->transfer.dest<buf+offset+count*len)
+    first=(cmd->transfer.dest-buf-offset)/len+1;
+   libswd_dap_apidle_update(libswdctx, first-done, 1);
+   if (first>done){
+    libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry);
+    libswd_retry_next(&retry);
+   } else if (!libswd_retry_next(&retry)) return LIBSWD_ERROR_MAXRETRY;
+   abort=0xFFFFFFFE;
+   libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, NULL);
+  }
+  if (res<0) {
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_ap_read_buf_posted(libswdctx=@%p, operation=%s, addr=0x%X, count=%d) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, count, libswd_error_string(res));
+   return res;
+  }
+  cmdcnt+=res;
+  libswd_dap_apidle_update(libswdctx, count-first, 0);
+  // Clear all possible error flags that may remain, but don't abort transaction.
+  // With deferred checking they are checked once for the block instead.
+  if (!libswdctx->config.stickydeferred){
+   abort=0xFFFFFFFE;
+   res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat);
+   if (res<0) return res;
+  }
+  memcpy(&last, buf+offset+(count-1)*len, len);
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_read_buf_posted(libswdctx=@%p, command=%s, addr=0x%X, count=%d, last=0x%X) execution OK.\n", (void*)libswdctx, libswd_operation_string(operation), addr, count, last);
   return cmdcnt;
  } else return LIBSWD_ERROR_BADOPCODE;
 } 
@@ -636,53 +1101,43 @@ int libswd_ap_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char
  if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
   return LIBSWD_ERROR_BADOPCODE;
 
- int res, cmdcnt=0, retry, ctrlstat, abort;
- char APnDP, RnW, cparity, *ack, *parity, request;
+ int res, cmdcnt=0, ctrlstat, abort;
+ libswd_retry_t retry;
+ char request;
 
  res=libswd_ap_bank_select(libswdctx, LIBSWD_OPERATION_ENQUEUE, addr);
  if (res<0) return res;
 
- APnDP=1;
- RnW=0;
-
- res=libswd_bitgen8_request(libswdctx, &APnDP, &RnW, &addr, &request);
- if (res<0) return res;
- res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
- if (res<1) return res;
- cmdcnt=+res;
- libswd_bin32_parity_even(data, (char *)&libswdctx->qlog.write.parity);
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(1, 0, addr)];
+ libswdctx->qlog.write.request=request;
+ libswdctx->qlog.write.data=*data;
+ libswd_bin32_parity_even(data, &libswdctx->qlog.write.parity);
 
  if (operation==LIBSWD_OPERATION_ENQUEUE){
-  res=libswd_bus_read_ack(libswdctx, operation, (char**)&libswdctx->qlog.write.ack);
-  if (res<1) return res;
-  cmdcnt=+res;
-  libswdctx->qlog.write.data=*data;
-  res=libswd_bus_write_data_ap(libswdctx, operation, &libswdctx->qlog.write.data);
+  res=libswd_bus_transfer_write(libswdctx, operation, &request, data, NULL);
   if (res<1) return res;
   cmdcnt=+res;
+  res=libswd_dap_apidle_enqueue(libswdctx, 0);
+  if (res<0) return res;
+  cmdcnt+=res;
   return cmdcnt;
 
  } else if (operation==LIBSWD_OPERATION_EXECUTE){
-  res=libswd_bus_read_ack(libswdctx, operation, &ack);
+  res=libswd_bus_transfer_write(libswdctx, operation, &request, data, NULL);
   if (res>=0) {
-   res=libswd_bus_write_data_ap(libswdctx, operation, data);
-   if (res<0) return res;
    cmdcnt+=res;
   } else if (res==LIBSWD_ERROR_ACK_WAIT) {
    //We got ACK==WAIT, retry last transfer until success or failure.
-   for (retry=LIBSWD_RETRY_COUNT_DEFAULT; retry>0; retry--){
+   libswd_dap_apidle_update(libswdctx, 0, 1);
+   for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
     abort=0xFFFFFFFE;
     res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, NULL);
     if (res<0) continue;
-    res=libswd_bus_write_request_raw(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request);
-    if (res<0) continue; 
-    res=libswd_bus_read_ack(libswdctx, LIBSWD_OPERATION_EXECUTE, &ack);
-    if (res<0) continue;
-    res=libswd_bus_write_data_ap(libswdctx, LIBSWD_OPERATION_EXECUTE, data);
+    res=libswd_bus_transfer_write(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, data, NULL);
     if (res<0) continue;
     break;
    }
-   if (retry==0) return LIBSWD_ERROR_MAXRETRY;
+   if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
   }
   if (res<0) {
    libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_ap_write(libswdctx=@%p, operation=%s, addr=0x%X, *data=0x%X/%s) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, *data, libswd_bin32_string(data), libswd_error_string(res));
@@ -690,12 +1145,121 @@ int libswd_ap_write(libswd_ctx_t *libswdctx, libswd_operation_t operation, char
    res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, &ctrlstat); 
    return res;
   }
+  // Idle cycles are sent with the next transfer, so the write can complete.
+  res=libswd_dap_apidle_enqueue(libswdctx, 0);
+  if (res<0) return res;
+  libswd_dap_apidle_update(libswdctx, 1, 0);
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_write(libswdctx=@%p, operation=%s, addr=0x%X, *data=0x%X/%s) execution OK.\n", (void*)libswdctx, libswd_operation_string(operation), addr, *data, libswd_bin32_string(data));
   return cmdcnt;
  } else return LIBSWD_ERROR_BADOPCODE;
  return LIBSWD_OK;
 } 
 
+/** Macro function: Streaming write of count values into the AP register.
+ * All writes are enqueued and flushed as one stream without handling the
+ * ACK of each one (with libswdctx->config.cmdqpipelined set they share
+ * batches). CTRL/STAT:ORUNDETECT, set by libswd_dap_init(), makes target
+ * ignore everything after a WAIT/FAULT, so once the stream is done only
+ * STICKYORUN is verified. When a transfer was lost stream falls back to
+ * the slow path: flags are cleared and writes from the lost one onwards
+ * are repeated with libswd_ap_write(), that verifies and retries each one.
+ * Lost transfer is found counting from the first one of the stream, so
+ * on execution elements pending before the stream are flushed first.
+ * With ring command queue long streams are executed in parts, see
+ * libswd_dap_ring_chunk(), each part verified as described above.
+ * Meant for registers that are written repeatedly, i.e. MEM-AP DRW with
+ * TAR auto increment. Address field should contain AP BANK on bits [4..7].
+ * \param *libswdctx swd context to work on.
+ * \param operation can be LIBSWD_OPERATION_ENQUEUE or LIBSWD_OPERATION_EXECUTE.
+ * \param addr is the address of the AP register to write plus AP BANK on bits[4..7].
+ * \param *data is the array of values to be written.
+ * \param count is the number of values to write.
+ * \return number of elements processed or LIBSWD_ERROR code on failure.
+ */
+int libswd_ap_write_stream(libswd_ctx_t *libswdctx, libswd_operation_t operation, char addr, int *data, int count){
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_write_stream(libswdctx=@%p, operation=%s, addr=0x%X, *data=@%p, count=%d).\n", (void*)libswdctx, libswd_operation_string(operation), addr, (void*)data, count);
+
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT; 
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
+  return LIBSWD_ERROR_BADOPCODE;
+ if (count<1) return LIBSWD_ERROR_PARAM;
+
+ int i, res, cmdcnt=0, done=0, chunk, ctrlstat, abort;
+ char request;
+ libswd_cmd_t *cmd, *first=NULL;
+
+ res=libswd_ap_bank_select(libswdctx, LIBSWD_OPERATION_ENQUEUE, addr);
+ if (res<0) return res;
+
+ request=LIBSWD_REQUEST_HEADER[LIBSWD_REQUEST_INDEX(1, 0, addr)];
+ libswdctx->qlog.write.request=request;
+ libswdctx->qlog.write.data=data[count-1];
+ libswd_bin32_parity_even(&data[count-1], &libswdctx->qlog.write.parity);
+
+ // Ring queue takes long streams in parts, each one verified on its own.
+ chunk=libswd_dap_ring_chunk(libswdctx, 0, count);
+ if (operation==LIBSWD_OPERATION_EXECUTE && chunk<count){
+  for (i=0;i<count;i+=chunk){
+   res=libswd_ap_write_stream(libswdctx, operation, addr, data+i, (count-i<chunk)?count-i:chunk);
+   if (res<0) return res;
+   cmdcnt+=res;
+  }
+  return cmdcnt;
+ }
+ // Nothing before the stream may fail and truncate its first transfer.
+ if (operation==LIBSWD_OPERATION_EXECUTE && libswd_cmdq_seek_exectail(libswdctx)!=libswdctx->cmdqptr.tail){
+  res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, LIBSWD_OPERATION_EXECUTE);
+  if (res<0) return res;
+  cmdcnt+=res;
+ }
+ for (i=0;i<count;i++){
+  res=libswd_bus_transfer_write(libswdctx, LIBSWD_OPERATION_ENQUEUE, &request, &data[i], NULL);
+  if (res<1) return res;
+  cmdcnt+=res;
+  // Elements appended since the last flush are never retired, so it stays put.
+  if (i==0) first=libswdctx->cmdqptr.tail;
+  res=libswd_dap_apidle_enqueue(libswdctx, 0);
+  if (res<0) return res;
+  cmdcnt+=res;
+ }
+ if (operation==LIBSWD_OPERATION_ENQUEUE) return cmdcnt;
+
+ res=libswd_cmdq_flush(libswdctx, &libswdctx->cmdq, LIBSWD_OPERATION_EXECUTE);
+ if (res>=0){
+  cmdcnt+=res;
+  // Nothing was lost unless STICKYORUN says so.
+  res=libswd_dap_sticky_check(libswdctx, &ctrlstat);
+  if (res!=LIBSWD_ERROR_STICKY){
+   if (res<0) return res;
+   libswd_dap_apidle_update(libswdctx, count, 0);
+   return cmdcnt;
+  }
+  if (!(ctrlstat&LIBSWD_DP_CTRLSTAT_STICKYORUN)) return res;
+ } else if (res!=LIBSWD_ERROR_ACK_WAIT && res!=LIBSWD_ERROR_ACK_FAULT) {
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_ap_write_stream(libswdctx=@%p, operation=%s, addr=0x%X, count=%d) failed: %s.\n", (void*)libswdctx, libswd_operation_string(operation), addr, count, libswd_error_string(res));
+  return res;
+ }
+
+ // Transfers before the lost one are done, target ignored the rest.
+ for (cmd=first; cmd && done<count; cmd=cmd->next){
+  if (cmd->cmdtype!=LIBSWD_CMDTYPE_MOSI_TRANSFER) continue;
+  if (cmd->transfer.status!=LIBSWD_OK || cmd->transfer.ack!=LIBSWD_ACK_OK_VAL) break;
+  done++;
+ }
+ libswd_dap_apidle_update(libswdctx, done, 1);
+ libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_ap_write_stream(libswdctx=@%p, operation=%s, addr=0x%X, count=%d): transfer %d lost, falling back to verified writes...\n", (void*)libswdctx, libswd_operation_string(operation), addr, count, done);
+ abort=0xFFFFFFFE;
+ res=libswd_dap_errors_handle(libswdctx, LIBSWD_OPERATION_EXECUTE, &abort, NULL);
+ if (res<0) return res;
+ for (i=done;i<count;i++){
+  res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, addr, &data[i]);
+  if (res<0) return res;
+  cmdcnt+=res;
+ }
+ return cmdcnt;
+}
+
 
 
 /** @} */
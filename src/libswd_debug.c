@@ -97,7 +97,8 @@ int libswd_debug_halt(libswd_ctx_t *libswdctx, libswd_operation_t operation)
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (operation!=LIBSWD_OPERATION_EXECUTE && operation!=LIBSWD_OPERATION_ENQUEUE) return LIBSWD_ERROR_PARAM;
 
- int retval, i, dbgdhcsr;
+ int retval, dbgdhcsr;
+ libswd_retry_t retry;
  char buf[4];
 
  if (!libswdctx->log.debug.initialized)
@@ -108,7 +109,7 @@ int libswd_debug_halt(libswd_ctx_t *libswdctx, libswd_operation_t operation)
  // Halt the CPU.
  retval=libswd_memap_read_int_32(libswdctx, operation, LIBSWD_ARM_DEBUG_DHCSR_ADDR, 1, &dbgdhcsr); 
  if (retval<0) return retval;
- for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+ for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_DEBUG, &retry); libswd_retry_next(&retry);)
  {
   dbgdhcsr=LIBSWD_ARM_DEBUG_DHCSR_DBGKEY;
   dbgdhcsr|=LIBSWD_ARM_DEBUG_DHCSR_CDEBUGEN;
@@ -135,7 +136,8 @@ int libswd_debug_run(libswd_ctx_t *libswdctx, libswd_operation_t operation)
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (operation!=LIBSWD_OPERATION_EXECUTE && operation!=LIBSWD_OPERATION_ENQUEUE) return LIBSWD_ERROR_PARAM;
 
- int retval, i, dbgdhcsr;
+ int retval, dbgdhcsr;
+ libswd_retry_t retry;
  char buf[4];
 
  if (!libswdctx->log.debug.initialized)
@@ -146,7 +148,7 @@ int libswd_debug_run(libswd_ctx_t *libswdctx, libswd_operation_t operation)
  // UnHalt the CPU.
  retval=libswd_memap_read_int_32(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_ARM_DEBUG_DHCSR_ADDR, 1, &dbgdhcsr); 
  if (retval<0) return retval;
- for (i=LIBSWD_RETRY_COUNT_DEFAULT;i;i--)
+ for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_DEBUG, &retry); libswd_retry_next(&retry);)
  {
   dbgdhcsr=LIBSWD_ARM_DEBUG_DHCSR_DBGKEY;
   dbgdhcsr|=LIBSWD_ARM_DEBUG_DHCSR_CDEBUGEN;
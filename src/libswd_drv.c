@@ -42,12 +42,184 @@
  * @{
  ******************************************************************************/
 
-extern int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
-extern int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
-extern int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst);
-extern int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst);
-extern int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits);
-extern int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits);
+// Application defined drivers are optional, see libswd_drv_init().
+#ifdef __GNUC__
+#define LIBSWD_DRV_EXTERN __attribute__((weak))
+#else
+#define LIBSWD_DRV_EXTERN
+#endif
+extern int libswd_drv_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst) LIBSWD_DRV_EXTERN;
+extern int libswd_drv_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst) LIBSWD_DRV_EXTERN;
+extern int libswd_drv_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits, int nLSBfirst) LIBSWD_DRV_EXTERN;
+extern int libswd_drv_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits, int nLSBfirst) LIBSWD_DRV_EXTERN;
+extern int libswd_drv_mosi_trn(libswd_ctx_t *libswdctx, int bits) LIBSWD_DRV_EXTERN;
+extern int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits) LIBSWD_DRV_EXTERN;
+
+/** Set up default driver entry points of a new context (see libswd_init()).
+ * Per-command entry points are taken from libswd_drv_{mosi,miso}_{8,32,trn}
+ * "extern" functions when application defines them, otherwise they are left
+ * empty for libswd_drv_register().
+ * \param *libswdctx swd context pointer.
+ * \return LIBSWD_OK on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_init(libswd_ctx_t *libswdctx){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (libswdctx->driver==NULL) return LIBSWD_ERROR_DRIVER;
+ libswdctx->driver->mosi_8=libswd_drv_mosi_8;
+ libswdctx->driver->mosi_32=libswd_drv_mosi_32;
+ libswdctx->driver->miso_8=libswd_drv_miso_8;
+ libswdctx->driver->miso_32=libswd_drv_miso_32;
+ libswdctx->driver->mosi_trn=libswd_drv_mosi_trn;
+ libswdctx->driver->miso_trn=libswd_drv_miso_trn;
+ return LIBSWD_OK;
+}
+
+/** Register interface driver for the selected context.
+ * Entry points, capabilities and driver pointers are copied into the
+ * context driver structure, so one static table can serve many contexts
+ * (driver pointers can be set in libswdctx->driver afterwards).
+ * Driver must provide all per-command entry points, transmit_batch(),
+ * or stage_reserve() along with stage_commit().
+ * \param *libswdctx swd context pointer.
+ * \param *driver driver table to use.
+ * \return capabilities of the registered driver, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_register(libswd_ctx_t *libswdctx, const libswd_driver_t *driver){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (driver==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (libswdctx->driver==NULL) return LIBSWD_ERROR_DRIVER;
+ *libswdctx->driver=*driver;
+ if (!(libswd_drv_caps(libswdctx)&(LIBSWD_DRIVER_CAP_BITS|LIBSWD_DRIVER_CAP_BATCH))){
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR,
+   "LIBSWD_E: libswd_drv_register(libswdctx=@%p, driver=@%p): Driver has neither per-command nor batch entry points!\n",
+   (void*)libswdctx, (void*)driver);
+  return LIBSWD_ERROR_DRIVER;
+ }
+ return libswd_drv_caps(libswdctx);
+}
+
+/** Tell the capabilities of the context driver, so the fastest bus access
+ * path it supports can be selected.
+ * \param *libswdctx swd context pointer.
+ * \return libswd_driver_cap_t flags, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_caps(libswd_ctx_t *libswdctx){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ libswd_driver_t *driver=libswdctx->driver;
+ if (driver==NULL) return LIBSWD_ERROR_DRIVER;
+ int caps=driver->caps;
+ if (driver->mosi_8 && driver->mosi_32 && driver->miso_8 && driver->miso_32
+     && driver->mosi_trn && driver->miso_trn)
+  caps|=LIBSWD_DRIVER_CAP_BITS;
+ else caps&=~LIBSWD_DRIVER_CAP_BITS;
+ if (!(driver->mosi_packed && driver->miso_packed)) caps&=~LIBSWD_DRIVER_CAP_INLINETRN;
+ if (driver->mosi_packed && driver->miso_packed
+     && ((driver->mosi_trn && driver->miso_trn) || (caps&LIBSWD_DRIVER_CAP_INLINETRN)))
+  caps|=LIBSWD_DRIVER_CAP_PACKED;
+ else caps&=~LIBSWD_DRIVER_CAP_PACKED;
+ if (driver->stage_reserve && driver->stage_commit) caps|=LIBSWD_DRIVER_CAP_STAGED;
+ else caps&=~LIBSWD_DRIVER_CAP_STAGED;
+ if (driver->transmit_batch || (caps&LIBSWD_DRIVER_CAP_STAGED)) caps|=LIBSWD_DRIVER_CAP_BATCH;
+ else caps&=~LIBSWD_DRIVER_CAP_BATCH;
+ if (driver->transfer) caps|=LIBSWD_DRIVER_CAP_TRANSACTION;
+ else caps&=~LIBSWD_DRIVER_CAP_TRANSACTION;
+ return caps;
+}
+
+/** Shift out up to 8 bits, LSB-first, using the packed-bit driver entry
+ * point when available, otherwise with driver mosi_8().
+ * \param *libswdctx swd context pointer.
+ * \param *cmd command being transmitted.
+ * \param *data bits to send.
+ * \param bits number of bits to send (1..8).
+ * \return number of bits sent, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_shift_mosi_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits){
+ if (libswdctx->driver->mosi_packed)
+  return libswdctx->driver->mosi_packed(libswdctx, cmd, (unsigned char*)data, bits);
+ return libswdctx->driver->mosi_8(libswdctx, cmd, data, bits, LIBSWD_DIR_LSBFIRST);
+}
+
+/** Shift out up to 32 bits, LSB-first, see libswd_drv_shift_mosi_8().
+ * \param *libswdctx swd context pointer.
+ * \param *cmd command being transmitted.
+ * \param *data bits to send.
+ * \param bits number of bits to send (1..32).
+ * \return number of bits sent, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_shift_mosi_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits){
+ unsigned char buf[4];
+ if (libswdctx->driver->mosi_packed){
+  buf[0]=*data;
+  buf[1]=*data>>8;
+  buf[2]=*data>>16;
+  buf[3]=*data>>24;
+  return libswdctx->driver->mosi_packed(libswdctx, cmd, buf, bits);
+ }
+ return libswdctx->driver->mosi_32(libswdctx, cmd, data, bits, LIBSWD_DIR_LSBFIRST);
+}
+
+/** Shift in up to 8 bits, LSB-first, using the packed-bit driver entry
+ * point when available, otherwise with driver miso_8().
+ * \param *libswdctx swd context pointer.
+ * \param *cmd command being transmitted.
+ * \param *data will hold received bits.
+ * \param bits number of bits to receive (1..8).
+ * \return number of bits received, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_shift_miso_8(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, char *data, int bits){
+ if (libswdctx->driver->miso_packed)
+  return libswdctx->driver->miso_packed(libswdctx, cmd, (unsigned char*)data, bits);
+ return libswdctx->driver->miso_8(libswdctx, cmd, data, bits, LIBSWD_DIR_LSBFIRST);
+}
+
+/** Shift in up to 32 bits, LSB-first, see libswd_drv_shift_miso_8().
+ * \param *libswdctx swd context pointer.
+ * \param *cmd command being transmitted.
+ * \param *data will hold received bits.
+ * \param bits number of bits to receive (1..32).
+ * \return number of bits received, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_shift_miso_32(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int *data, int bits){
+ int res;
+ unsigned char buf[4]={0, 0, 0, 0};
+ if (libswdctx->driver->miso_packed){
+  res=libswdctx->driver->miso_packed(libswdctx, cmd, buf, bits);
+  if (res<0) return res;
+  *data=buf[0]|(buf[1]<<8)|(buf[2]<<16)|((unsigned)buf[3]<<24);
+  return res;
+ }
+ return libswdctx->driver->miso_32(libswdctx, cmd, data, bits, LIBSWD_DIR_LSBFIRST);
+}
+
+/** Tell if context driver encodes TRN inline (LIBSWD_DRIVER_CAP_INLINETRN).
+ * \param *libswdctx swd context pointer.
+ * \return non-zero when TRN is shifted with packed-bit entry points.
+ */
+static int libswd_drv_inlinetrn(libswd_ctx_t *libswdctx){
+ return (libswdctx->driver->caps&LIBSWD_DRIVER_CAP_INLINETRN)
+        && libswdctx->driver->mosi_packed && libswdctx->driver->miso_packed;
+}
+
+/** Clock TRN cycles with driver mosi_trn() or miso_trn(). Drivers that encode
+ * TRN inline get them as host released cycles of miso_packed() instead, so
+ * the direction switch goes out with the surrounding data.
+ * \param *libswdctx swd context pointer.
+ * \param *cmd command being transmitted.
+ * \param bits number of TRN cycles.
+ * \param miso non-zero for TRN to MISO, zero for TRN back to MOSI.
+ * \return number of cycles clocked, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_shift_trn(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int bits, int miso){
+ unsigned char buf[1];
+ if (libswd_drv_inlinetrn(libswdctx)){
+  if (bits<LIBSWD_TURNROUND_MIN_VAL || bits>LIBSWD_TURNROUND_MAX_VAL)
+   return LIBSWD_ERROR_TURNAROUND;
+  return libswdctx->driver->miso_packed(libswdctx, cmd, buf, bits);
+ }
+ if (miso) return libswdctx->driver->miso_trn(libswdctx, bits);
+ return libswdctx->driver->mosi_trn(libswdctx, bits);
+}
 
 /** Transmit selected command from the *cmdq to the interface driver.
  * Also update the libswdctx->log structure (this should be done only here!).
@@ -62,8 +234,10 @@ extern int libswd_drv_miso_trn(libswd_ctx_t *libswdctx, int bits);
 int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
  if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
  if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (!(libswd_drv_caps(libswdctx)&(LIBSWD_DRIVER_CAP_BITS|LIBSWD_DRIVER_CAP_PACKED)))
+  return LIBSWD_ERROR_DRIVER;
   
- int res=LIBSWD_ERROR_BADCMDTYPE, errcode=LIBSWD_ERROR_RESULT;
+ int res=LIBSWD_ERROR_BADCMDTYPE;
 
  switch (cmd->cmdtype){
   case LIBSWD_CMDTYPE_MOSI:
@@ -74,21 +248,21 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
   case LIBSWD_CMDTYPE_MOSI_CONTROL:
    // 8 clock cycles.
    if (cmd->bits!=8) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_mosi_8(libswdctx, cmd, &cmd->control, 8, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_mosi_8(libswdctx, cmd, &cmd->control, 8);
    if (res>=0) libswdctx->log.write.control=cmd->control;
    break;
 
   case LIBSWD_CMDTYPE_MOSI_BITBANG:
    // 1 clock cycle.
    if (cmd->bits!=1) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_mosi_8(libswdctx, cmd, &cmd->mosibit, 1, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_mosi_8(libswdctx, cmd, &cmd->mosibit, 1);
    if (res>=0) libswdctx->log.write.bitbang=cmd->mosibit;
    break;
 
   case LIBSWD_CMDTYPE_MOSI_PARITY:
    // 1 clock cycle.
    if (cmd->bits!=1) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_mosi_8(libswdctx, cmd, &cmd->parity, 1, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_mosi_8(libswdctx, cmd, &cmd->parity, 1);
    if (res>=0) libswdctx->log.write.parity=cmd->parity;
    break;
 
@@ -96,13 +270,13 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
    // 1..4-bit clock cycle.
    if (cmd->bits<LIBSWD_TURNROUND_MIN_VAL && cmd->bits>LIBSWD_TURNROUND_MAX_VAL)
     return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_mosi_trn(libswdctx, cmd->bits);
+   res=libswd_drv_shift_trn(libswdctx, cmd, cmd->bits, 0);
    break;
 
   case LIBSWD_CMDTYPE_MOSI_REQUEST:
    // 8 clock cycles.
    if (cmd->bits!=LIBSWD_REQUEST_BITLEN) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_mosi_8(libswdctx, cmd, &cmd->request, 8, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_mosi_8(libswdctx, cmd, &cmd->request, 8);
    if (res>=0){
     libswdctx->log.write.request=cmd->request;
     // Log human-readable request fields for easier transmission debug.
@@ -114,28 +288,28 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
   case LIBSWD_CMDTYPE_MOSI_DATA:
    // 32 clock cycles.
    if (cmd->bits!=LIBSWD_DATA_BITLEN) return LIBSWD_ERROR_BADCMDDATA; 
-   res=libswd_drv_mosi_32(libswdctx, cmd, &cmd->mosidata, 32, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_mosi_32(libswdctx, cmd, &cmd->mosidata, 32);
    if (res>=0) libswdctx->log.write.data=cmd->mosidata;
    break;
 
   case LIBSWD_CMDTYPE_MISO_ACK:
    // 3 clock cycles.
    if (cmd->bits!=LIBSWD_ACK_BITLEN) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_miso_8(libswdctx, cmd, &cmd->ack, cmd->bits, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_miso_8(libswdctx, cmd, &cmd->ack, cmd->bits);
    if (res>=0) libswdctx->log.read.ack=cmd->ack;
    break;
 
   case LIBSWD_CMDTYPE_MISO_BITBANG:
    // 1 clock cycle.
    if (cmd->bits!=1) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_miso_8(libswdctx, cmd, &cmd->misobit, 1, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_miso_8(libswdctx, cmd, &cmd->misobit, 1);
    if (res>=0) libswdctx->log.read.bitbang=cmd->misobit;
    break;
 
   case LIBSWD_CMDTYPE_MISO_PARITY:
    // 1 clock cycle.
    if (cmd->bits!=1) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_miso_8(libswdctx, cmd, &cmd->parity, 1, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_miso_8(libswdctx, cmd, &cmd->parity, 1);
    if (res>=0) libswdctx->log.read.parity=cmd->parity;
    break;
 
@@ -143,16 +317,21 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
    // 1..4 clock cycles
    if (cmd->bits<LIBSWD_TURNROUND_MIN_VAL && cmd->bits>LIBSWD_TURNROUND_MAX_VAL)
     return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_miso_trn(libswdctx, cmd->bits);
+   res=libswd_drv_shift_trn(libswdctx, cmd, cmd->bits, 1);
    break;
 
   case LIBSWD_CMDTYPE_MISO_DATA:
    // 32 clock cycles
    if (cmd->bits!=LIBSWD_DATA_BITLEN) return LIBSWD_ERROR_BADCMDDATA;
-   res=libswd_drv_miso_32(libswdctx, cmd, &cmd->misodata, cmd->bits, LIBSWD_DIR_LSBFIRST);
+   res=libswd_drv_shift_miso_32(libswdctx, cmd, &cmd->misodata, cmd->bits);
    if (res>=0) libswdctx->log.read.data=cmd->misodata;
    break;
 
+  case LIBSWD_CMDTYPE_MOSI_TRANSFER:
+   // Complete transaction, see libswd_transfer_t.
+   res=libswd_drv_transfer(libswdctx, cmd);
+   break;
+
   case LIBSWD_CMDTYPE_UNDEFINED:
    res=0;
    break; 
@@ -169,13 +348,42 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
 
  if (res<0) return res;
  cmd->done=1;
+ if (libswdctx->bitstream){
+  res=libswd_bitstream_append_cmd(libswdctx, cmd, cmd->data32);
+  if (res<0) return res;
+ }
+
+ return libswd_drv_transmit_verify(libswdctx, cmd, res);
+}
+
+/** Verify ACK/PARITY of the command that was just transmitted.
+ * When ACK/PARITY error is detected queue tail is removed as it is invalid.
+ * When CTRL/STAT:STICKYORUN=1 ACK={WAIT,FAULT] requires additional data phase.
+ * \param *libswdctx swd context pointer.
+ * \param *cmd pointer to the command that was transmitted.
+ * \param res result of the command transmission.
+ * \return res on success, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_transmit_verify(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int res){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+
+ int errcode=LIBSWD_ERROR_RESULT;
+ char ack=cmd->ack;
+
+ /* Transfer record keeps its own ACK and status, parity is handled below. */
+ if (cmd->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER){
+  if (cmd->transfer.status==LIBSWD_OK) return res;
+  ack=cmd->transfer.ack;
+ }
 
  /* Now verify the ACK value, notify caller about possible errors, truncate cmdq if libswdctx.config.autofixerrors is not set.
   * Accodring to ADIv5.0 specification (ARM IHI 0031A, section 5.4.5) data phase is required when STICKYORUN=1.
   * Unfortunately at this point we cannot read the CTRL/STAT flag, so we will write zeros to avoid random Request.
   */
- if (cmd->cmdtype==LIBSWD_CMDTYPE_MISO_ACK){
-  switch(cmd->ack){
+ if (cmd->cmdtype==LIBSWD_CMDTYPE_MISO_ACK
+  || (cmd->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER && cmd->transfer.status!=LIBSWD_ERROR_PARITY)){
+  switch(ack){
    // If the ACK was OK then simply return to the caller.
    case LIBSWD_ACK_OK_VAL: return res;
    // For other ACK codes produce a warning and remember the code.
@@ -205,19 +413,26 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
      "LIBSWD_D: libswd_drv_transmit(libswdctx=@%p, cmd=@%p): ACK!=OK, clearing cmdq tail to preserve synchronization...\n",
      (void*)libswdctx, (void*)cmd );
    // Save DATA and PARITY queue elements for ACK={WAIT,FAULT} as they may be referenced by application.
+   // Transfer record holds its own data and parity.
    if (errcode==LIBSWD_ERROR_ACK_WAIT || errcode==LIBSWD_ERROR_ACK_FAULT)
-    if (cmd->next) if(cmd->next->next) cmd=cmd->next->next;
+    if (cmd->cmdtype==LIBSWD_CMDTYPE_MISO_ACK)
+     if (cmd->next) if(cmd->next->next) cmd=cmd->next->next;
    // Now free the queue tail.
-   if (libswd_cmdq_free_tail(cmd)<0) {
+   res=libswd_cmdq_free_tail(libswdctx, cmd);
+   if (res<0) {
     libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
       "LIBSWD_W: libswd_drv_transmit(libswdctx=@%p, cmd=@%p): Cannot free cmdq tail in ACK error handling routine, Protocol Error Sequence imminent...\n",
       (void*)libswdctx, (void*)cmd );
     return LIBSWD_ERROR_QUEUENOTFREE;
    }
+   libswdctx->cmdqptr.tail=cmd;
+   libswdctx->cmdqptr.len-=res;
    // TODO: MOVE THIS INTO SEPARATE ERROR HANDLING ROUTINE
    // If ACK={WAIT,FAULT} then append data phase and again flush the queue to maintain sync.
    // MOSI_TRN + 33 zero data cycles should be universal for STICKYORUN={0,1} ???
-   if (errcode==LIBSWD_ERROR_ACK_WAIT || errcode==LIBSWD_ERROR_ACK_FAULT){
+   // Probe executing whole transfer records does the data phase on its own.
+   if ((errcode==LIBSWD_ERROR_ACK_WAIT || errcode==LIBSWD_ERROR_ACK_FAULT)
+       && !(cmd->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER && libswdctx->driver->transfer)){
     libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_drv_transmit(libswdctx=@%p, cmd=@%p): Performing data phase after ACK={WAIT,FAULT}...\n", (void*)libswdctx, (void*)cmd);
     int data=0;
     char parity=0;
@@ -265,12 +480,15 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
     libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
       "LIBSWD_W: libswd_drv_transmit(libswdctx=@%p, cmd=@%p): Bad PARITY, clearing cmdq tail to preserve synchronization...\n",
       (void*)libswdctx, (void*)cmd );
-    if (libswd_cmdq_free_tail(cmd)<0) {
+    res=libswd_cmdq_free_tail(libswdctx, cmd);
+    if (res<0) {
      libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
        "LIBSWD_W: libswd_drv_transmit(libswdctx=@%p, cmd=@%p): Cannot free cmdq tail in PARITY error hanlig routine!\n",
        (void*)libswdctx, (void*)cmd);
      return LIBSWD_ERROR_QUEUENOTFREE;
     }
+    libswdctx->cmdqptr.tail=cmd;
+    libswdctx->cmdqptr.len-=res;
     // Return parity error.
     return LIBSWD_ERROR_PARITY;
    }
@@ -284,8 +502,747 @@ int libswd_drv_transmit(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
   }
  }
 
+ /* Transfer record parity was verified on expansion, only clean up here. */
+ if (cmd->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER && cmd->transfer.status==LIBSWD_ERROR_PARITY){
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING,
+    "LIBSWD_W: libswd_drv_transmit(libswdctx=@%p, cmd=@%p): Parity mismatch detected (%s/%d), clearing cmdq tail to preserve synchronization...\n",
+    (void*)libswdctx, (void*)cmd, libswd_bin32_string(&cmd->transfer.data), cmd->transfer.parity );
+  res=libswd_cmdq_free_tail(libswdctx, cmd);
+  if (res<0) return LIBSWD_ERROR_QUEUENOTFREE;
+  libswdctx->cmdqptr.tail=cmd;
+  libswdctx->cmdqptr.len-=res;
+  return LIBSWD_ERROR_PARITY;
+ }
+
  /* Everyting went fine, return number of elements processed. */
  return res;
 }
 
+/** Complete transfer record executed by the probe as a whole, with driver
+ * transfer() or transfer_block() entry point. ACK and data are already in
+ * the record, parity is calculated here as probe does not report it.
+ * \param *libswdctx swd context pointer.
+ * \param *cmd pointer to the executed transfer record.
+ * \param parityerror non-zero if probe reported read data parity mismatch.
+ * \return number of clock cycles of the transfer, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_transfer_complete(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd, int parityerror){
+ int res;
+ libswd_transfer_t *transfer=&cmd->transfer;
+
+ libswdctx->log.write.request=transfer->request;
+ libswdctx->log.read.ack=transfer->ack;
+ switch (transfer->ack){
+  case LIBSWD_ACK_OK_VAL:    transfer->status=LIBSWD_OK; break;
+  case LIBSWD_ACK_WAIT_VAL:  transfer->status=LIBSWD_ERROR_ACK_WAIT; return cmd->bits;
+  case LIBSWD_ACK_FAULT_VAL: transfer->status=LIBSWD_ERROR_ACK_FAULT; return cmd->bits;
+  default:                   transfer->status=LIBSWD_ERROR_ACKUNKNOWN; return cmd->bits;
+ }
+ res=libswd_bin32_parity_even(&transfer->data, &transfer->parity);
+ if (res<0) return res;
+ if (transfer->request&LIBSWD_REQUEST_RnW){
+  // Received parity bit is unknown, only tell it did not match.
+  if (parityerror){
+   transfer->parity=!transfer->parity;
+   transfer->status=LIBSWD_ERROR_PARITY;
+  }
+  libswdctx->log.read.data=transfer->data;
+  libswdctx->log.read.parity=transfer->parity;
+  if (transfer->dest && transfer->status==LIBSWD_OK)
+   memcpy(transfer->dest, &transfer->data, transfer->destlen);
+ } else {
+  libswdctx->log.write.data=transfer->data;
+  libswdctx->log.write.parity=transfer->parity;
+ }
+ return cmd->bits;
+}
+
+/** Expand transfer record into bus operations for drivers that encode TRN
+ * inline (LIBSWD_DRIVER_CAP_INLINETRN). TRN cycles are clocked along with
+ * the ACK and read data, so a transfer costs three packed-bit driver calls:
+ * Request, TRN+ACK(+TRN for write), then Data+Parity(+TRN for read).
+ * \param *libswdctx swd context pointer.
+ * \param *cmd pointer to the transfer record to be sent.
+ * \return number of clock cycles transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_transfer_inline(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
+ int i, res, clks=0, trn=libswdctx->config.trnlen, rnw;
+ unsigned char buf[6];
+ char parity;
+ libswd_transfer_t *transfer=&cmd->transfer;
+
+ rnw=transfer->request&LIBSWD_REQUEST_RnW;
+ res=libswdctx->driver->mosi_packed(libswdctx, cmd, (unsigned char*)&transfer->request, LIBSWD_REQUEST_BITLEN);
+ if (res<0) return res;
+ clks+=res;
+ libswdctx->log.write.request=transfer->request;
+ // Write turns the bus back to MOSI after ACK in any case.
+ res=libswdctx->driver->miso_packed(libswdctx, cmd, buf, trn+LIBSWD_ACK_BITLEN+(rnw?0:trn));
+ if (res<0) return res;
+ clks+=res;
+ transfer->ack=0;
+ for (i=0;i<LIBSWD_ACK_BITLEN;i++)
+  if (buf[(trn+i)>>3]&(1<<((trn+i)&7))) transfer->ack|=1<<i;
+ libswdctx->log.read.ack=transfer->ack;
+
+ if (transfer->ack!=LIBSWD_ACK_OK_VAL){
+  if (rnw){
+   res=libswd_drv_shift_trn(libswdctx, cmd, trn, 0);
+   if (res<0) return res;
+   clks+=res;
+  }
+  switch (transfer->ack){
+   case LIBSWD_ACK_WAIT_VAL:  transfer->status=LIBSWD_ERROR_ACK_WAIT; break;
+   case LIBSWD_ACK_FAULT_VAL: transfer->status=LIBSWD_ERROR_ACK_FAULT; break;
+   default:                   transfer->status=LIBSWD_ERROR_ACKUNKNOWN;
+  }
+  return clks;
+ }
+
+ if (rnw){
+  res=libswdctx->driver->miso_packed(libswdctx, cmd, buf, LIBSWD_DATA_BITLEN+1+trn);
+  if (res<0) return res;
+  clks+=res;
+  transfer->data=buf[0]|(buf[1]<<8)|(buf[2]<<16)|((unsigned)buf[3]<<24);
+  transfer->parity=buf[4]&1;
+  libswdctx->log.read.data=transfer->data;
+  libswdctx->log.read.parity=transfer->parity;
+  res=libswd_bin32_parity_even(&transfer->data, &parity);
+  if (res<0) return res;
+  transfer->status=(parity==transfer->parity)?LIBSWD_OK:LIBSWD_ERROR_PARITY;
+  if (transfer->dest && transfer->status==LIBSWD_OK)
+   memcpy(transfer->dest, &transfer->data, transfer->destlen);
+ } else {
+  buf[0]=transfer->data;
+  buf[1]=transfer->data>>8;
+  buf[2]=transfer->data>>16;
+  buf[3]=transfer->data>>24;
+  buf[4]=transfer->parity&1;
+  res=libswdctx->driver->mosi_packed(libswdctx, cmd, buf, LIBSWD_DATA_BITLEN+1);
+  if (res<0) return res;
+  clks+=res;
+  libswdctx->log.write.data=transfer->data;
+  libswdctx->log.write.parity=transfer->parity;
+  transfer->status=LIBSWD_OK;
+ }
+ return clks;
+}
+
+/** Expand transfer record (see libswd_transfer_t) into bus operations and
+ * transmit them to the interface driver. ACK and read data parity are verified
+ * here and the result is stored in the cmd->transfer.status field, so caller
+ * can decide what to do next without looking at separate queue elements.
+ * When driver provides transfer() entry point the record is passed to the
+ * probe as a whole instead.
+ * \param *libswdctx swd context pointer.
+ * \param *cmd pointer to the transfer record to be sent.
+ * \return number of clock cycles transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_transfer(libswd_ctx_t *libswdctx, libswd_cmd_t *cmd){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (cmd->cmdtype!=LIBSWD_CMDTYPE_MOSI_TRANSFER) return LIBSWD_ERROR_BADCMDTYPE;
+
+ int res, clks=0;
+ char parity;
+ libswd_transfer_t *transfer=&cmd->transfer;
+
+ if (libswdctx->driver->transfer){
+  res=libswdctx->driver->transfer(libswdctx, transfer->request, &transfer->data, &transfer->ack);
+  if (res<0 && res!=LIBSWD_ERROR_PARITY) return res;
+  return libswd_drv_transfer_complete(libswdctx, cmd, res==LIBSWD_ERROR_PARITY);
+ }
+ if (libswd_drv_inlinetrn(libswdctx)) return libswd_drv_transfer_inline(libswdctx, cmd);
+
+ res=libswd_drv_shift_mosi_8(libswdctx, cmd, &transfer->request, LIBSWD_REQUEST_BITLEN);
+ if (res<0) return res;
+ clks+=res;
+ libswdctx->log.write.request=transfer->request;
+ res=libswd_drv_shift_trn(libswdctx, cmd, libswdctx->config.trnlen, 1);
+ if (res<0) return res;
+ clks+=res;
+ res=libswd_drv_shift_miso_8(libswdctx, cmd, &transfer->ack, LIBSWD_ACK_BITLEN);
+ if (res<0) return res;
+ clks+=res;
+ libswdctx->log.read.ack=transfer->ack;
+
+ if (transfer->ack!=LIBSWD_ACK_OK_VAL){
+  // Target does not drive the data phase, only turn the bus back to MOSI.
+  res=libswd_drv_shift_trn(libswdctx, cmd, libswdctx->config.trnlen, 0);
+  if (res<0) return res;
+  clks+=res;
+  switch (transfer->ack){
+   case LIBSWD_ACK_WAIT_VAL:  transfer->status=LIBSWD_ERROR_ACK_WAIT; break;
+   case LIBSWD_ACK_FAULT_VAL: transfer->status=LIBSWD_ERROR_ACK_FAULT; break;
+   default:                   transfer->status=LIBSWD_ERROR_ACKUNKNOWN;
+  }
+  return clks;
+ }
+
+ if (transfer->request&LIBSWD_REQUEST_RnW){
+  res=libswd_drv_shift_miso_32(libswdctx, cmd, &transfer->data, LIBSWD_DATA_BITLEN);
+  if (res<0) return res;
+  clks+=res;
+  res=libswd_drv_shift_miso_8(libswdctx, cmd, &transfer->parity, 1);
+  if (res<0) return res;
+  clks+=res;
+  res=libswd_drv_shift_trn(libswdctx, cmd, libswdctx->config.trnlen, 0);
+  if (res<0) return res;
+  clks+=res;
+  libswdctx->log.read.data=transfer->data;
+  libswdctx->log.read.parity=transfer->parity;
+  res=libswd_bin32_parity_even(&transfer->data, &parity);
+  if (res<0) return res;
+  transfer->status=(parity==transfer->parity)?LIBSWD_OK:LIBSWD_ERROR_PARITY;
+  // Deposit valid read data directly into the caller buffer.
+  if (transfer->dest && transfer->status==LIBSWD_OK)
+   memcpy(transfer->dest, &transfer->data, transfer->destlen);
+ } else {
+  res=libswd_drv_shift_trn(libswdctx, cmd, libswdctx->config.trnlen, 0);
+  if (res<0) return res;
+  clks+=res;
+  res=libswd_drv_shift_mosi_32(libswdctx, cmd, &transfer->data, LIBSWD_DATA_BITLEN);
+  if (res<0) return res;
+  clks+=res;
+  res=libswd_drv_shift_mosi_8(libswdctx, cmd, &transfer->parity, 1);
+  if (res<0) return res;
+  clks+=res;
+  libswdctx->log.write.data=transfer->data;
+  libswdctx->log.write.parity=transfer->parity;
+  transfer->status=LIBSWD_OK;
+ }
+ return clks;
+}
+
+/** Transmit command queue span (libswdctx->cmdqspan) to the interface driver.
+ * Elements are transmitted in order with libswd_drv_transmit(), so their
+ * ACK/PARITY is verified exactly as in element by element transmission.
+ * When driver provides transfer_block() entry point, runs of consecutive
+ * transfer records with the same Request are executed with a single driver
+ * call, then verified one by one as usual. Scan stops when error handling
+ * truncated the queue after an element, caller should continue with
+ * remaining elements from the returned **cmd.
+ * \param *libswdctx swd context pointer.
+ * \param **cmd is set to the last transmitted queue element.
+ * \return number of elements transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_transmit_span(libswd_ctx_t *libswdctx, libswd_cmd_t **cmd){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (!(libswd_drv_caps(libswdctx)&(LIBSWD_DRIVER_CAP_BITS|LIBSWD_DRIVER_CAP_PACKED)))
+  return LIBSWD_ERROR_DRIVER;
+
+ int i, res, blockpos=0, blocklen=0, blockdone=0;
+ char blockack=0;
+ libswd_cmdqspan_t *cmdqspan=&libswdctx->cmdqspan;
+
+ for (i=0;i<cmdqspan->len;i++){
+  *cmd=cmdqspan->cmd[i];
+  if ((*cmd)->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER && i>=blockpos+blocklen
+      && libswdctx->driver->transfer && libswdctx->driver->transfer_block){
+   // Group transfers with the same Request into one probe block transfer.
+   blockpos=i;
+   for (blocklen=0;i+blocklen<cmdqspan->len;blocklen++){
+    if (cmdqspan->cmd[i+blocklen]->cmdtype!=LIBSWD_CMDTYPE_MOSI_TRANSFER
+        || cmdqspan->cmd[i+blocklen]->transfer.request!=(*cmd)->transfer.request) break;
+    cmdqspan->data[i+blocklen]=cmdqspan->cmd[i+blocklen]->transfer.data;
+   }
+   if (blocklen>1){
+    res=libswdctx->driver->transfer_block(libswdctx, (*cmd)->transfer.request,
+                                          &cmdqspan->data[i], blocklen, &blockack);
+    if (res<0) return res;
+    blockdone=res;
+   } else blocklen=0;
+  }
+  if (i<blockpos+blocklen){
+   // Already executed with the block, elements after the failing one are never reached.
+   (*cmd)->transfer.data=cmdqspan->data[i];
+   (*cmd)->transfer.ack=(i-blockpos<blockdone)?LIBSWD_ACK_OK_VAL:blockack;
+   res=libswd_drv_transfer_complete(libswdctx, *cmd, i-blockpos==blockdone);
+   if (res<0) return res;
+   (*cmd)->done=1;
+   if (libswdctx->bitstream){
+    res=libswd_bitstream_append_cmd(libswdctx, *cmd, (*cmd)->data32);
+    if (res<0) return res;
+   }
+   res=libswd_drv_transmit_verify(libswdctx, *cmd, (*cmd)->bits);
+  } else res=libswd_drv_transmit(libswdctx, *cmd);
+  if (res<0) return res;
+  // Queue tail was replaced by the error handling.
+  if (i+1<cmdqspan->len && (*cmd)->next!=cmdqspan->cmd[i+1]) return i+1;
+ }
+ return cmdqspan->len;
+}
+
+/** Append clock cycles to the batch bitstream, LSB first.
+ * Bitstreams grow on demand and are reused by the next batch.
+ * \param *batch batch to append cycles to.
+ * \param data payload to be clocked out (ignored for MISO cycles).
+ * \param bits number of clock cycles to append (0..32).
+ * \param miso non-zero when host releases SWDIO and samples it.
+ * \return number of clock cycles appended, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_batch_append(libswd_batch_t *batch, int data, int bits, int miso){
+ if (batch==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
+ int i, pos, size;
+ unsigned char mask;
+ void *ptr;
+ if (batch->bits+bits>batch->size*8){
+  size=(batch->size)?batch->size*2:LIBSWD_CMDPOOL_SLABLEN;
+  ptr=realloc(batch->mosi, size);
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  batch->mosi=(unsigned char*)ptr;
+  ptr=realloc(batch->miso, size);
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  batch->miso=(unsigned char*)ptr;
+  ptr=realloc(batch->dir, size);
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  batch->dir=(unsigned char*)ptr;
+  batch->size=size;
+ }
+ for (i=0;i<bits;i++){
+  pos=batch->bits+i;
+  mask=1<<(pos&7);
+  if (!miso && (data>>i)&1) {
+   batch->mosi[pos>>3]|=mask;
+  } else batch->mosi[pos>>3]&=~mask;
+  if (miso) {
+   batch->dir[pos>>3]|=mask;
+  } else batch->dir[pos>>3]&=~mask;
+ }
+ batch->bits+=bits;
+ return bits;
+}
+
+/** Extract captured MISO bits from the batch bitstream, LSB first.
+ * \param *batch batch to extract bits from.
+ * \param pos position of the first bit in the bitstream.
+ * \param bits number of bits to extract (0..32).
+ * \param *data will hold the extracted bits.
+ * \return number of bits extracted, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_batch_extract(libswd_batch_t *batch, int pos, int bits, int *data){
+ if (batch==NULL || data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32 || pos<0 || pos+bits>batch->bits) return LIBSWD_ERROR_PARAM;
+ int i;
+ *data=0;
+ for (i=0;i<bits;i++)
+  if (batch->miso[(pos+i)>>3]&(1<<((pos+i)&7))) *data|=1<<i;
+ return bits;
+}
+
+/** Tell if context driver has the staging buffer (LIBSWD_DRIVER_CAP_STAGED).
+ * \param *libswdctx swd context pointer.
+ * \return non-zero when batch is built with stage_reserve()/stage_commit().
+ */
+static int libswd_drv_staged(libswd_ctx_t *libswdctx){
+ return libswdctx->driver->stage_reserve && libswdctx->driver->stage_commit;
+}
+
+/** Append clock cycles to the context batch, see libswd_drv_batch_append().
+ * With driver staging buffer (see libswd_driver_t stage_reserve()) cycles
+ * are stored straight into the driver outgoing frame and its receive buffer
+ * position is remembered for libswd_drv_batch_get().
+ * \param *libswdctx swd context pointer.
+ * \param data payload to be clocked out (ignored for MISO cycles).
+ * \param bits number of clock cycles to append (0..32).
+ * \param miso non-zero when host releases SWDIO and samples it.
+ * \return number of clock cycles appended, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_batch_put(libswd_ctx_t *libswdctx, int data, int bits, int miso){
+ if (!libswd_drv_staged(libswdctx))
+  return libswd_drv_batch_append(&libswdctx->batch, data, bits, miso);
+ if (bits<0 || bits>32) return LIBSWD_ERROR_PARAM;
+ if (bits==0) return 0;
+ int i, pos, rxpos, size;
+ unsigned char *mosi;
+ void *ptr;
+ libswd_stage_t *stage=&libswdctx->stage;
+ if (stage->len>=stage->size){
+  size=(stage->size)?stage->size*2:LIBSWD_CMDPOOL_SLABLEN;
+  ptr=realloc(stage->cycle, size*sizeof(int));
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  stage->cycle=(int*)ptr;
+  ptr=realloc(stage->rxpos, size*sizeof(int));
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  stage->rxpos=(int*)ptr;
+  stage->size=size;
+ }
+ rxpos=libswdctx->driver->stage_reserve(libswdctx, bits, miso, &mosi, &pos);
+ if (rxpos<0) return rxpos;
+ if (!miso){
+  for (i=0;i<bits;i++,pos++){
+   if ((data>>i)&1) {
+    mosi[pos>>3]|=1<<(pos&7);
+   } else mosi[pos>>3]&=~(1<<(pos&7));
+  }
+ }
+ stage->cycle[stage->len]=libswdctx->batch.bits;
+ stage->rxpos[stage->len++]=rxpos;
+ libswdctx->batch.bits+=bits;
+ return bits;
+}
+
+/** Extract captured MISO bits of the context batch, see
+ * libswd_drv_batch_extract(). With driver staging buffer they are decoded
+ * straight from the driver receive buffer. Bits must belong to one
+ * libswd_drv_batch_put() call.
+ * \param *libswdctx swd context pointer.
+ * \param pos position of the first bit in the batch.
+ * \param bits number of bits to extract (0..32).
+ * \param *data will hold the extracted bits.
+ * \return number of bits extracted, or LIBSWD_ERROR_CODE on failure.
+ */
+static int libswd_drv_batch_get(libswd_ctx_t *libswdctx, int pos, int bits, int *data){
+ if (!libswd_drv_staged(libswdctx))
+  return libswd_drv_batch_extract(&libswdctx->batch, pos, bits, data);
+ libswd_stage_t *stage=&libswdctx->stage;
+ if (data==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (bits<0 || bits>32 || pos<0 || pos+bits>libswdctx->batch.bits || stage->rx==NULL)
+  return LIBSWD_ERROR_PARAM;
+ int i, lo=0, hi=stage->len-1, mid;
+ // Find the staged run that holds the first bit.
+ while (lo<hi){
+  mid=(lo+hi+1)/2;
+  if (stage->cycle[mid]<=pos) lo=mid; else hi=mid-1;
+ }
+ pos=stage->rxpos[lo]+pos-stage->cycle[lo];
+ *data=0;
+ for (i=0;i<bits;i++)
+  if (stage->rx[(pos+i)>>3]&(1<<((pos+i)&7))) *data|=1<<i;
+ return bits;
+}
+
+/** Transmit command queue span (libswdctx->cmdqspan) to the interface
+ * driver using its transmit_batch() entry point. Elements are converted into
+ * batches of clock cycles (see libswd_batch_t), each batch is a single driver
+ * call, then captured MISO bits are scattered back to the elements. Batch ends
+ * after each ACK and read data parity, so nothing else is clocked out before
+ * they are verified.
+ * Transfer record (see libswd_transfer_t) is therefore split in two batches,
+ * its data phase leads the next batch and depends on the received ACK.
+ * With libswdctx->config.cmdqpipelined set and CTRL/STAT:ORUNDETECT enabled
+ * transfer records are pipelined instead: data phase is clocked right after
+ * the ACK assuming ACK=OK, so many transfers share a batch of up to
+ * libswdctx->config.batchmaxlen clock cycles (or less if driver maxbatchbits
+ * says so). Each transfer ACK is verified after the batch completes. Overrun detection makes the target answer every
+ * transfer after a WAIT/FAULT with FAULT (and ignore it) until sticky flags
+ * are cleared, so transfers after the failed one can be safely sent again.
+ * Read data parity of each completed batch is verified at once with
+ * libswd_bin32_parity_verify(), then
+ * ACK/PARITY problems are handled with libswd_drv_transmit_verify() exactly
+ * as in libswd_drv_transmit(), caller should continue with remaining
+ * elements from the returned **cmd.
+ * Drivers with staging buffer get the batch built in their outgoing frame
+ * with stage_reserve() and sent with stage_commit(), entries are then
+ * scattered from the driver receive buffer, so no bitstream is copied.
+ * \param *libswdctx swd context pointer.
+ * \param **cmd is set to the last transmitted queue element.
+ * \return number of entries transmitted, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_drv_transmit_batch(libswd_ctx_t *libswdctx, libswd_cmd_t **cmd){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (cmd==NULL) return LIBSWD_ERROR_NULLPOINTER;
+ if (libswdctx->driver==NULL) return LIBSWD_ERROR_DRIVER;
+ if (libswdctx->driver->transmit_batch==NULL && !libswd_drv_staged(libswdctx))
+  return LIBSWD_ERROR_DRIVER;
+
+ int i, n, bad, first, last, pos, data, res=0, cont=0, end, pipelined, batchmaxlen;
+ char *data8, trnlen=libswdctx->config.trnlen;
+ void *ptr;
+ libswd_cmdqspan_t *cmdqspan=&libswdctx->cmdqspan;
+ libswd_batch_t *batch=&libswdctx->batch;
+ libswd_transfer_t *transfer;
+
+ if (batch->possize<cmdqspan->size){
+  ptr=realloc(batch->pos, cmdqspan->size*sizeof(int));
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  batch->pos=(int*)ptr;
+  ptr=realloc(batch->words, cmdqspan->size*sizeof(int));
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  batch->words=(int*)ptr;
+  ptr=realloc(batch->parities, cmdqspan->size*sizeof(char));
+  if (ptr==NULL) return LIBSWD_ERROR_OUTOFMEM;
+  batch->parities=(char*)ptr;
+  batch->possize=cmdqspan->size;
+ }
+ pipelined=libswdctx->config.cmdqpipelined
+  && (libswdctx->log.dp.ctrlstat&LIBSWD_DP_CTRLSTAT_ORUNDETECT);
+ batchmaxlen=libswdctx->config.batchmaxlen;
+ if (libswdctx->driver->maxbatchbits>0 && libswdctx->driver->maxbatchbits<batchmaxlen)
+  batchmaxlen=libswdctx->driver->maxbatchbits;
+
+ for (first=0;first<cmdqspan->len;){
+  // Build the batch. Entry first may be the transfer record continuation (cont).
+  batch->bits=0;
+  libswdctx->stage.len=0;
+  for (last=first,end=0;last<cmdqspan->len && !end;last++){
+   i=last;
+   batch->pos[i]=batch->bits;
+   data8=&cmdqspan->cmd[i]->data8;
+   switch (cmdqspan->cmd[i]->cmdtype){
+    case LIBSWD_CMDTYPE_MOSI_CONTROL:
+    case LIBSWD_CMDTYPE_MOSI_REQUEST:
+     if (cmdqspan->cmd[i]->bits!=8){
+      res=LIBSWD_ERROR_BADCMDDATA;
+      break;
+     }
+     res=libswd_drv_batch_put(libswdctx, *data8, 8, 0);
+     break;
+    case LIBSWD_CMDTYPE_MOSI_BITBANG:
+    case LIBSWD_CMDTYPE_MOSI_PARITY:
+     if (cmdqspan->cmd[i]->bits!=1){
+      res=LIBSWD_ERROR_BADCMDDATA;
+      break;
+     }
+     res=libswd_drv_batch_put(libswdctx, *data8, 1, 0);
+     break;
+    case LIBSWD_CMDTYPE_MOSI_DATA:
+     if (cmdqspan->cmd[i]->bits!=LIBSWD_DATA_BITLEN){
+      res=LIBSWD_ERROR_BADCMDDATA;
+      break;
+     }
+     res=libswd_drv_batch_put(libswdctx, cmdqspan->cmd[i]->data32, 32, 0);
+     break;
+    case LIBSWD_CMDTYPE_MOSI_TRN:
+    case LIBSWD_CMDTYPE_MISO_TRN:
+     res=libswd_drv_batch_put(libswdctx, 0, cmdqspan->cmd[i]->bits, 1);
+     break;
+    case LIBSWD_CMDTYPE_MISO_ACK:
+     if (cmdqspan->cmd[i]->bits!=LIBSWD_ACK_BITLEN){
+      res=LIBSWD_ERROR_BADCMDDATA;
+      break;
+     }
+     res=libswd_drv_batch_put(libswdctx, 0, LIBSWD_ACK_BITLEN, 1);
+     end=1;
+     break;
+    case LIBSWD_CMDTYPE_MISO_BITBANG:
+    case LIBSWD_CMDTYPE_MISO_PARITY:
+     if (cmdqspan->cmd[i]->bits!=1){
+      res=LIBSWD_ERROR_BADCMDDATA;
+      break;
+     }
+     res=libswd_drv_batch_put(libswdctx, 0, 1, 1);
+     // Data parity is verified before anything else is clocked out.
+     if (cmdqspan->cmd[i]->cmdtype==LIBSWD_CMDTYPE_MISO_PARITY && i>0)
+      if (cmdqspan->cmd[i-1]->cmdtype==LIBSWD_CMDTYPE_MISO_DATA) end=1;
+     break;
+    case LIBSWD_CMDTYPE_MISO_DATA:
+     if (cmdqspan->cmd[i]->bits!=LIBSWD_DATA_BITLEN){
+      res=LIBSWD_ERROR_BADCMDDATA;
+      break;
+     }
+     res=libswd_drv_batch_put(libswdctx, 0, 32, 1);
+     break;
+    case LIBSWD_CMDTYPE_MOSI_TRANSFER:
+     transfer=&cmdqspan->cmd[i]->transfer;
+     if (!(cont && i==first)){
+      // Request, TRN, ACK.
+      res=libswd_drv_batch_put(libswdctx, transfer->request, LIBSWD_REQUEST_BITLEN, 0);
+      if (res>=0) res=libswd_drv_batch_put(libswdctx, 0, trnlen, 1);
+      if (res>=0) res=libswd_drv_batch_put(libswdctx, 0, LIBSWD_ACK_BITLEN, 1);
+      if (!pipelined){
+       end=1;
+      } else if (res>=0 && (transfer->request&LIBSWD_REQUEST_RnW)){
+       // Data phase assuming ACK=OK: Data, Parity, TRN.
+       res=libswd_drv_batch_put(libswdctx, 0, LIBSWD_DATA_BITLEN, 1);
+       if (res>=0) res=libswd_drv_batch_put(libswdctx, 0, 1, 1);
+       if (res>=0) res=libswd_drv_batch_put(libswdctx, 0, trnlen, 1);
+      } else if (res>=0){
+       // Data phase assuming ACK=OK: TRN, Data, Parity.
+       res=libswd_drv_batch_put(libswdctx, 0, trnlen, 1);
+       if (res>=0) res=libswd_drv_batch_put(libswdctx, transfer->data, LIBSWD_DATA_BITLEN, 0);
+       if (res>=0) res=libswd_drv_batch_put(libswdctx, transfer->parity, 1, 0);
+      }
+     } else if (transfer->ack!=LIBSWD_ACK_OK_VAL){
+      // TRN only, then let verification handle the ACK.
+      res=libswd_drv_batch_put(libswdctx, 0, trnlen, 1);
+      end=1;
+     } else if (transfer->request&LIBSWD_REQUEST_RnW){
+      // Data, Parity, TRN.
+      res=libswd_drv_batch_put(libswdctx, 0, LIBSWD_DATA_BITLEN, 1);
+      if (res>=0) res=libswd_drv_batch_put(libswdctx, 0, 1, 1);
+      if (res>=0) res=libswd_drv_batch_put(libswdctx, 0, trnlen, 1);
+      end=1;
+     } else {
+      // TRN, Data, Parity.
+      res=libswd_drv_batch_put(libswdctx, 0, trnlen, 1);
+      if (res>=0) res=libswd_drv_batch_put(libswdctx, transfer->data, LIBSWD_DATA_BITLEN, 0);
+      if (res>=0) res=libswd_drv_batch_put(libswdctx, transfer->parity, 1, 0);
+     }
+     break;
+    case LIBSWD_CMDTYPE_UNDEFINED:
+     res=0;
+     break;
+    default:
+     res=LIBSWD_ERROR_BADCMDTYPE;
+   }
+   if (res<0){
+    if (libswd_drv_staged(libswdctx)) libswdctx->driver->stage_commit(libswdctx, NULL);
+    return res;
+   }
+   if (pipelined && batch->bits>=batchmaxlen) end=1;
+  }
+
+  if (libswd_drv_staged(libswdctx)){
+   res=libswdctx->driver->stage_commit(libswdctx, &libswdctx->stage.rx);
+  } else res=libswdctx->driver->transmit_batch(libswdctx, batch);
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG,
+    "LIBSWD_D: libswd_drv_transmit_batch(libswdctx=@%p): entries %d..%d, %d clock cycles, driver returns %d\n",
+    (void*)libswdctx, first, last-1, batch->bits, res );
+  if (res<0) return res;
+
+  // Gather read data words of the batch and verify their parity at once.
+  for (i=first,n=0;i<last;i++){
+   pos=batch->pos[i];
+   switch (cmdqspan->cmd[i]->cmdtype){
+    case LIBSWD_CMDTYPE_MISO_PARITY:
+     if (i==0 || cmdqspan->cmd[i-1]->cmdtype!=LIBSWD_CMDTYPE_MISO_DATA) break;
+     if (i>first){
+      libswd_drv_batch_get(libswdctx, batch->pos[i-1], LIBSWD_DATA_BITLEN, &batch->words[n]);
+     } else batch->words[n]=cmdqspan->cmd[i-1]->data32;
+     libswd_drv_batch_get(libswdctx, pos, 1, &data);
+     batch->parities[n++]=data;
+     break;
+    case LIBSWD_CMDTYPE_MOSI_TRANSFER:
+     transfer=&cmdqspan->cmd[i]->transfer;
+     if (!(transfer->request&LIBSWD_REQUEST_RnW)) break;
+     if (!(cont && i==first)){
+      if (!pipelined) break;
+      libswd_drv_batch_get(libswdctx, pos+LIBSWD_REQUEST_BITLEN+trnlen, LIBSWD_ACK_BITLEN, &data);
+      if (data!=LIBSWD_ACK_OK_VAL) break;
+      pos+=LIBSWD_REQUEST_BITLEN+trnlen+LIBSWD_ACK_BITLEN;
+     } else if (transfer->ack!=LIBSWD_ACK_OK_VAL) break;
+     libswd_drv_batch_get(libswdctx, pos, LIBSWD_DATA_BITLEN, &batch->words[n]);
+     libswd_drv_batch_get(libswdctx, pos+LIBSWD_DATA_BITLEN, 1, &data);
+     batch->parities[n++]=data;
+     break;
+    default:
+     break;
+   }
+  }
+  bad=(n)?libswd_bin32_parity_verify(batch->words, batch->parities, n):0;
+  if (bad<0) return bad;
+
+  // Scatter captured bits back to the entries and verify them.
+  for (i=first,n=0;i<last;i++){
+   pos=batch->pos[i];
+   data8=&cmdqspan->cmd[i]->data8;
+   res=cmdqspan->cmd[i]->bits;
+   switch (cmdqspan->cmd[i]->cmdtype){
+    case LIBSWD_CMDTYPE_MOSI_CONTROL:
+     libswdctx->log.write.control=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MOSI_BITBANG:
+     libswdctx->log.write.bitbang=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MOSI_PARITY:
+     libswdctx->log.write.parity=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MOSI_REQUEST:
+     libswdctx->log.write.request=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MOSI_DATA:
+     libswdctx->log.write.data=cmdqspan->cmd[i]->data32;
+     break;
+    case LIBSWD_CMDTYPE_MISO_ACK:
+     libswd_drv_batch_get(libswdctx, pos, LIBSWD_ACK_BITLEN, &data);
+     *data8=data;
+     libswdctx->log.read.ack=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MISO_BITBANG:
+     libswd_drv_batch_get(libswdctx, pos, 1, &data);
+     *data8=data;
+     libswdctx->log.read.bitbang=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MISO_PARITY:
+     libswd_drv_batch_get(libswdctx, pos, 1, &data);
+     *data8=data;
+     libswdctx->log.read.parity=*data8;
+     break;
+    case LIBSWD_CMDTYPE_MISO_DATA:
+     libswd_drv_batch_get(libswdctx, pos, LIBSWD_DATA_BITLEN, &cmdqspan->cmd[i]->data32);
+     libswdctx->log.read.data=cmdqspan->cmd[i]->data32;
+     break;
+    case LIBSWD_CMDTYPE_MOSI_TRANSFER:
+     transfer=&cmdqspan->cmd[i]->transfer;
+     if (!(cont && i==first)){
+      libswd_drv_batch_get(libswdctx, pos+LIBSWD_REQUEST_BITLEN+trnlen, LIBSWD_ACK_BITLEN, &data);
+      transfer->ack=data;
+      libswdctx->log.write.request=transfer->request;
+      libswdctx->log.read.ack=transfer->ack;
+      if (!pipelined) break;
+      // Data phase follows the ACK in the same batch.
+      pos+=LIBSWD_REQUEST_BITLEN+trnlen+LIBSWD_ACK_BITLEN;
+     }
+     if (transfer->ack!=LIBSWD_ACK_OK_VAL){
+      switch (transfer->ack){
+       case LIBSWD_ACK_WAIT_VAL:  transfer->status=LIBSWD_ERROR_ACK_WAIT; break;
+       case LIBSWD_ACK_FAULT_VAL: transfer->status=LIBSWD_ERROR_ACK_FAULT; break;
+       default:                   transfer->status=LIBSWD_ERROR_ACKUNKNOWN;
+      }
+     } else if (transfer->request&LIBSWD_REQUEST_RnW){
+      libswd_drv_batch_get(libswdctx, pos, LIBSWD_DATA_BITLEN, &transfer->data);
+      libswd_drv_batch_get(libswdctx, pos+LIBSWD_DATA_BITLEN, 1, &data);
+      transfer->parity=data;
+      libswdctx->log.read.data=transfer->data;
+      libswdctx->log.read.parity=transfer->parity;
+      transfer->status=(n++==bad)?LIBSWD_ERROR_PARITY:LIBSWD_OK;
+      if (transfer->dest && transfer->status==LIBSWD_OK)
+       memcpy(transfer->dest, &transfer->data, transfer->destlen);
+     } else {
+      libswdctx->log.write.data=transfer->data;
+      libswdctx->log.write.parity=transfer->parity;
+      transfer->status=LIBSWD_OK;
+     }
+     break;
+    default:
+     break;
+   }
+
+   // Transfer record header was sent, its data phase leads the next batch.
+   if (cmdqspan->cmd[i]->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER && !(cont && i==first) && !pipelined) break;
+
+   if (libswdctx->config.loglevel>=LIBSWD_LOGLEVEL_PAYLOAD)
+    libswd_log(libswdctx, LIBSWD_LOGLEVEL_PAYLOAD,
+     "LIBSWD_P: libswd_drv_transmit_batch(libswdctx=@%p, cmd=@%p) bits=%-2d cmdtype=%-12s returns=%-3d payload=0x%08x (%s)\n",
+     libswdctx, cmdqspan->cmd[i], cmdqspan->cmd[i]->bits, libswd_cmd_string_cmdtype(cmdqspan->cmd[i]), res,
+     (cmdqspan->cmd[i]->bits>8)?cmdqspan->cmd[i]->data32:*data8,
+     (cmdqspan->cmd[i]->bits<=8)?libswd_bin8_string(data8):libswd_bin32_string(&cmdqspan->cmd[i]->data32));
+
+   cmdqspan->cmd[i]->done=1;
+   if (libswdctx->bitstream){
+    res=libswd_bitstream_append_cmd(libswdctx, cmdqspan->cmd[i], cmdqspan->cmd[i]->data32);
+    if (res<0) return res;
+   }
+
+   // Only ACK and PARITY are verified, they are mostly fine.
+   if (cmdqspan->cmd[i]->cmdtype==LIBSWD_CMDTYPE_MOSI_TRANSFER){
+    if (cmdqspan->cmd[i]->transfer.status==LIBSWD_OK) continue;
+   } else if (cmdqspan->cmd[i]->cmdtype==LIBSWD_CMDTYPE_MISO_ACK){
+    if (*data8==LIBSWD_ACK_OK_VAL) continue;
+   } else if (cmdqspan->cmd[i]->cmdtype==LIBSWD_CMDTYPE_MISO_PARITY){
+    if (i>0 && cmdqspan->cmd[i-1]->cmdtype==LIBSWD_CMDTYPE_MISO_DATA){
+     if (n++!=bad) continue;
+    }
+   } else continue;
+
+   // Problem found, let libswd_drv_transmit_verify() handle it on queue elements.
+   // Entries after this one were not transmitted, verification frees them.
+   *cmd=cmdqspan->cmd[i];
+   res=libswd_drv_transmit_verify(libswdctx, *cmd, res);
+   if (res<0) return res;
+   return i+1;
+  }
+
+  // Next batch starts with the transfer record data phase if header was sent.
+  cont=(i<last);
+  first=(cont)?i:last;
+ }
+
+ if (cmdqspan->len) *cmd=cmdqspan->cmd[cmdqspan->len-1];
+ return cmdqspan->len;
+}
+
 /** @} */
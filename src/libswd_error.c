@@ -87,6 +87,8 @@ char *libswd_error_string(libswd_error_code_t error){
   case LIBSWD_ERROR_FILE:         return "[LIBSWD_ERROR_FILE] file I/O related problem";
   case LIBSWD_ERROR_UNSUPPORTED:  return "[LIBSWD_ERROR_UNSUPPORTED] Target not supported";
   case LIBSWD_ERROR_MEMAPACCSIZE: return "[LIBSWD_ERROR_MEMAPACCSIZE] Invalid MEM-AP access size";
+  case LIBSWD_ERROR_STICKY: return "[LIBSWD_ERROR_STICKY] Sticky error flag found set in CTRL/STAT";
+  case LIBSWD_ERROR_QUEUEFULL: return "[LIBSWD_ERROR_QUEUEFULL] Command queue reached its length limit";
   default:                        return "undefined error";
  }
  return "undefined error";
@@ -100,7 +102,7 @@ int libswd_error_handle(libswd_ctx_t *libswdctx){
  libswd_cmd_t *exectail;
 
  // Verify if libswdctx->cmdq contains last executed element, correct if necessary.
- exectail=libswd_cmdq_find_exectail(libswdctx->cmdq);
+ exectail=libswd_cmdq_seek_exectail(libswdctx);
  if (exectail==NULL) {
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_error_handle(libswdctx=@%p): Cannot find last executed element on the queue!\n", (void*)libswdctx);
   return LIBSWD_ERROR_QUEUE;
@@ -114,6 +116,9 @@ int libswd_error_handle(libswd_ctx_t *libswdctx){
   case LIBSWD_CMDTYPE_MISO_ACK:
    retval=libswd_error_handle_ack(libswdctx);
    break;
+  case LIBSWD_CMDTYPE_MOSI_TRANSFER:
+   retval=libswd_error_handle_transfer(libswdctx);
+   break;
   default:
    return LIBSWD_ERROR_UNHANDLED;
  }
@@ -169,16 +174,23 @@ int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx){
  char *ack, *rparity;
  char parity=0;
 
- // Remember original cmdq, restore on return.
+ // Remember original cmdq and its pointers, restore on return.
  libswd_cmd_t *mastercmdq = libswdctx->cmdq;
+ libswd_cmdqptr_t mastercmdqptr = libswdctx->cmdqptr;
 
  // Append dummy data phase, fix sticky flags and retry operation.
  int retval, *ctrlstat, *rdata, abort;
 // retval=libswd_cmdq_init(errors);
- libswdctx->cmdq->errors=(libswd_cmd_t*)calloc(1,sizeof(libswd_cmd_t));
+ libswdctx->cmdq->errors=libswd_cmdq_pool_get(libswdctx);
  //retval = LIBSWD_ERROR_OUTOFMEM;
  if (libswdctx->cmdq->errors==NULL) goto libswd_error_handle_ack_wait_end;
  libswdctx->cmdq=libswdctx->cmdq->errors; // From now, this becomes out main cmdq for use with standard functions.
+ libswdctx->cmdqptr.head=libswdctx->cmdq;
+ libswdctx->cmdqptr.tail=libswdctx->cmdq;
+ libswdctx->cmdqptr.exectail=libswdctx->cmdq;
+ libswdctx->cmdqptr.flushed=libswdctx->cmdq;
+ libswdctx->cmdqptr.consumed=libswdctx->cmdq;
+ libswdctx->cmdqptr.len=0;
  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_error_handle_ack_wait(libswdctx=@%p): Performing data phase after ACK={WAIT,FAULT}...\n", (void*)libswdctx);
  int res, data=0;
  retval=libswd_bus_write_data_p(libswdctx, LIBSWD_OPERATION_EXECUTE, &data, &parity);
@@ -190,8 +202,8 @@ int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx){
  // 3. RETRY MEM-AP DRW READ - now it must be ACK=OK (it will return last mem-ap read result). 
  // 4. READ DP RDBUFF TO OBTAIN READ DATA
 
- int retrycnt;
- for (retrycnt=50/*LIBSWD_RETRY_COUNT_DEFAULT*/; retrycnt>0; retrycnt--){
+ libswd_retry_t retry;
+ for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
   retval=libswd_dp_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_CTRLSTAT_ADDR, &ctrlstat);
   if (retval<0) goto libswd_error_handle_ack_wait_end;
   abort=0x00000014;
@@ -214,7 +226,7 @@ int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx){
    break;
   }
  }
- if (retrycnt==0){
+ if (retry.expired){
   retval=LIBSWD_ERROR_MAXRETRY;
   goto libswd_error_handle_ack_wait_end;
  }
@@ -222,6 +234,7 @@ int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx){
  //Make sure we have RDATA and PARITY elements after libswdctx->cmdq.
  //Should we check for this at the procedure start???
  libswdctx->cmdq=mastercmdq;
+ libswdctx->cmdqptr=mastercmdqptr;
  if (libswdctx->cmdq->cmdtype==LIBSWD_CMDTYPE_MISO_ACK && libswdctx->cmdq->next->cmdtype==LIBSWD_CMDTYPE_MISO_DATA && libswdctx->cmdq->next->next->cmdtype==LIBSWD_CMDTYPE_MISO_PARITY){
   libswdctx->cmdq->ack=LIBSWD_ACK_OK_VAL;
   libswdctx->cmdq=libswdctx->cmdq->next;
@@ -231,6 +244,7 @@ int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx){
   //libswd_bin8_parity_even(rdata, &parity);
   libswdctx->cmdq->parity=*rparity;
   libswdctx->cmdq->done=1;
+  libswdctx->cmdqptr.exectail=libswdctx->cmdq;
   return LIBSWD_OK;
  } else libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: UNSUPPORTED COMMAND SEQUENCE ON CMDQ (NOT ACK->RDATA->PARITY)\n");
  
@@ -240,12 +254,186 @@ int libswd_error_handle_ack_wait(libswd_ctx_t *libswdctx){
 
 libswd_error_handle_ack_wait_end:
  // Exit ACK WAIT handling routine, verify retval before return.
- if (retval<0||retrycnt==0){
+ if (retval<0||retry.expired){
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_error_handle_ack_wait(libswdctx=@%p) ejecting: %s\n", (void*)libswdctx, libswd_error_string(retval));
  }
 
  libswdctx->cmdq=mastercmdq;
+ libswdctx->cmdqptr=mastercmdqptr;
  while (1) {printf("ACK WAIT HANDLER\n");usleep(1000);}
  return retval;
 }
+/** Handle ACK!=OK of the transfer record pointed by libswdctx->cmdq.
+ * Data phase is performed unless probe executes whole transfer records,
+ * then sticky flags are cleared in ABORT. On ACK=WAIT the request is
+ * retried on a separate queue (attached to the record as cmdq->errors)
+ * and the result is stored back into the record, as if the original
+ * transfer succeeded. ACK=FAULT is not retried, caller gets the error
+ * with sticky flags already cleared.
+ * \param *libswdctx swd context pointer.
+ * \return LIBSWD_OK when the record was fixed, or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_error_handle_transfer(libswd_ctx_t *libswdctx){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (libswdctx->cmdq->cmdtype!=LIBSWD_CMDTYPE_MOSI_TRANSFER){
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_WARNING, "LIBSWD_W: libswd_error_handle_transfer(libswdctx=@%p):libswdctx->cmdq does not point to transfer record!\n", (void*)libswdctx);
+  return LIBSWD_ERROR_UNHANDLED;
+ }
+
+ libswd_transfer_t *transfer=&libswdctx->cmdq->transfer;
+ if (transfer->ack==LIBSWD_ACK_OK_VAL) return (transfer->status==LIBSWD_OK)?LIBSWD_OK:LIBSWD_ERROR_UNHANDLED;
+ if (transfer->ack!=LIBSWD_ACK_WAIT_VAL && transfer->ack!=LIBSWD_ACK_FAULT_VAL) return LIBSWD_ERROR_UNHANDLED;
+
+ // Remember original cmdq and its pointers, restore on return.
+ libswd_cmd_t *mastercmdq=libswdctx->cmdq;
+ libswd_cmdqptr_t mastercmdqptr=libswdctx->cmdqptr;
+ char autofixerrors=libswdctx->config.autofixerrors;
+ char request=transfer->request, *ack, *parity, dparity=0;
+ int retval, abort, ddata=0, *data;
+ libswd_retry_t retry;
+
+ if (libswdctx->cmdq->errors) libswd_cmdq_free(libswdctx, libswdctx->cmdq->errors);
+ libswdctx->cmdq->errors=libswd_cmdq_pool_get(libswdctx);
+ if (libswdctx->cmdq->errors==NULL) return LIBSWD_ERROR_OUTOFMEM;
+ libswdctx->cmdq=libswdctx->cmdq->errors;
+ libswdctx->cmdqptr.head=libswdctx->cmdq;
+ libswdctx->cmdqptr.tail=libswdctx->cmdq;
+ libswdctx->cmdqptr.exectail=libswdctx->cmdq;
+ libswdctx->cmdqptr.flushed=libswdctx->cmdq;
+ libswdctx->cmdqptr.consumed=libswdctx->cmdq;
+ libswdctx->cmdqptr.len=0;
+ // Errors on this queue are returned here, not handled recursively.
+ libswdctx->config.autofixerrors=0;
+
+ if (!libswdctx->driver->transfer){
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_DEBUG, "LIBSWD_D: libswd_error_handle_transfer(libswdctx=@%p): Performing data phase after ACK={WAIT,FAULT}...\n", (void*)libswdctx);
+  retval=libswd_bus_write_data_p(libswdctx, LIBSWD_OPERATION_EXECUTE, &ddata, &dparity);
+  if (retval<0) goto libswd_error_handle_transfer_end;
+ }
+
+ if (transfer->ack==LIBSWD_ACK_FAULT_VAL){
+  abort=LIBSWD_DP_ABORT_STKCMPCLR|LIBSWD_DP_ABORT_STKERRCLR|LIBSWD_DP_ABORT_WDERRCLR|LIBSWD_DP_ABORT_ORUNERRCLR;
+  retval=libswd_dp_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_ABORT_ADDR, &abort);
+  if (retval>=0) retval=LIBSWD_ERROR_ACK_FAULT;
+  goto libswd_error_handle_transfer_end;
+ }
+
+ for (libswd_retry_start(libswdctx, LIBSWD_RETRY_CLASS_ACKWAIT, &retry); libswd_retry_next(&retry);){
+  // STICKYORUN is set on WAIT when overrun detection is enabled.
+  abort=LIBSWD_DP_ABORT_ORUNERRCLR;
+  retval=libswd_dp_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_DP_ABORT_ADDR, &abort);
+  if (retval<0) goto libswd_error_handle_transfer_end;
+  // Retried AP read returns the same posted data the original would.
+  if (request&LIBSWD_REQUEST_RnW){
+   retval=libswd_bus_transfer_read(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, &data, &ack, &parity);
+  } else retval=libswd_bus_transfer_write(libswdctx, LIBSWD_OPERATION_EXECUTE, &request, &transfer->data, &ack);
+  if (retval>=0) break;
+  if (retval!=LIBSWD_ERROR_ACK_WAIT) goto libswd_error_handle_transfer_end;
+ }
+ if (retry.expired){
+  retval=LIBSWD_ERROR_MAXRETRY;
+  goto libswd_error_handle_transfer_end;
+ }
+
+ // Store the retried transfer result into the original record.
+ transfer->ack=LIBSWD_ACK_OK_VAL;
+ transfer->status=LIBSWD_OK;
+ if (request&LIBSWD_REQUEST_RnW){
+  transfer->data=*data;
+  transfer->parity=*parity;
+  if (transfer->dest) memcpy(transfer->dest, &transfer->data, transfer->destlen);
+ } else libswd_bin32_parity_even(&transfer->data, &transfer->parity);
+ retval=LIBSWD_OK;
+
+libswd_error_handle_transfer_end:
+ if (retval<0)
+  libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR, "LIBSWD_E: libswd_error_handle_transfer(libswdctx=@%p) ejecting: %s\n", (void*)libswdctx, libswd_error_string(retval));
+ libswdctx->config.autofixerrors=autofixerrors;
+ libswdctx->cmdq=mastercmdq;
+ libswdctx->cmdqptr=mastercmdqptr;
+ return retval;
+}
+
+/** Default retry policy of each operation class, see libswd_retry_class_t. */
+static const libswd_retry_policy_t libswd_retry_policy_default[LIBSWD_RETRY_CLASS_COUNT] = {
+ {LIBSWD_RETRY_COUNT_DEFAULT, 0, 0, 0, LIBSWD_RETRY_BACKOFF_FIXED},
+ {LIBSWD_RETRY_COUNT_DEFAULT, 0, LIBSWD_RETRY_DELAY_DEFAULT, LIBSWD_RETRY_DELAY_DEFAULT, LIBSWD_RETRY_BACKOFF_FIXED},
+ {LIBSWD_RETRY_COUNT_DEFAULT, 0, 0, 0, LIBSWD_RETRY_BACKOFF_FIXED},
+ {0, LIBSWD_RETRY_POLL_BUDGET_DEFAULT, LIBSWD_RETRY_POLL_DELAY_DEFAULT, LIBSWD_RETRY_POLL_MAXDELAY_DEFAULT, LIBSWD_RETRY_BACKOFF_EXPONENTIAL}
+};
+
+/** Set retry policy of the operation class.
+ * Fast targets may drop the delays, slow targets may use the time budget
+ * instead of attempt count, so they get enough time to respond.
+ * \param *libswdctx swd context pointer.
+ * \param opclass is the operation class to configure.
+ * \param *policy is the new policy, NULL restores the default one.
+ * \return LIBSWD_OK on success or LIBSWD_ERROR_CODE on failure.
+ */
+int libswd_retry_policy_set(libswd_ctx_t *libswdctx, libswd_retry_class_t opclass, libswd_retry_policy_t *policy){
+ if (libswdctx==NULL) return LIBSWD_ERROR_NULLCONTEXT;
+ if (opclass<0 || opclass>=LIBSWD_RETRY_CLASS_COUNT) return LIBSWD_ERROR_PARAM;
+ if (policy==NULL){
+  libswdctx->config.retry[opclass]=libswd_retry_policy_default[opclass];
+  return LIBSWD_OK;
+ }
+ if (policy->attempts<0 || policy->budget<0 || policy->delay<0 || policy->maxdelay<0) return LIBSWD_ERROR_PARAM;
+ if (!policy->attempts && !policy->budget) return LIBSWD_ERROR_PARAM;
+ if (policy->backoff!=LIBSWD_RETRY_BACKOFF_FIXED && policy->backoff!=LIBSWD_RETRY_BACKOFF_EXPONENTIAL) return LIBSWD_ERROR_PARAM;
+ libswdctx->config.retry[opclass]=*policy;
+ return LIBSWD_OK;
+}
+
+/** Start the retry loop of the operation class.
+ * Retry loops are written as:
+ * for (libswd_retry_start(libswdctx, opclass, &retry); libswd_retry_next(&retry);){ ... }
+ * if (retry.expired) return LIBSWD_ERROR_MAXRETRY;
+ * Unknown operation class falls back to LIBSWD_RETRY_CLASS_ACKWAIT policy.
+ * \param *libswdctx swd context pointer.
+ * \param opclass is the operation class which policy applies.
+ * \param *retry is the loop state to initialize.
+ */
+void libswd_retry_start(libswd_ctx_t *libswdctx, libswd_retry_class_t opclass, libswd_retry_t *retry){
+ if (opclass<0 || opclass>=LIBSWD_RETRY_CLASS_COUNT) opclass=LIBSWD_RETRY_CLASS_ACKWAIT;
+ retry->policy=&libswdctx->config.retry[opclass];
+ retry->attempt=0;
+ retry->delay=retry->policy->delay;
+ retry->expired=0;
+ if (retry->policy->budget) gettimeofday(&retry->start, NULL);
+}
+
+/** Decide if another attempt can be made, sleep the backoff delay before it.
+ * First call always allows the first attempt without delay.
+ * \param *retry is the loop state started with libswd_retry_start().
+ * \return LIBSWD_TRUE if the attempt can be made, LIBSWD_FALSE when policy limits are reached (retry->expired is set).
+ */
+int libswd_retry_next(libswd_retry_t *retry){
+ libswd_retry_policy_t *policy=retry->policy;
+ struct timeval now;
+ int delay, elapsed;
+ if (retry->attempt){
+  if (policy->attempts && retry->attempt>=policy->attempts){
+   retry->expired=1;
+   return LIBSWD_FALSE;
+  }
+  delay=retry->delay;
+  if (policy->budget){
+   gettimeofday(&now, NULL);
+   elapsed=(now.tv_sec-retry->start.tv_sec)*1000000+(now.tv_usec-retry->start.tv_usec);
+   if (elapsed>=policy->budget){
+    retry->expired=1;
+    return LIBSWD_FALSE;
+   }
+   if (delay>policy->budget-elapsed) delay=policy->budget-elapsed;
+  }
+  if (delay) usleep(delay);
+  if (policy->backoff==LIBSWD_RETRY_BACKOFF_EXPONENTIAL){
+   retry->delay*=2;
+   if (retry->delay>policy->maxdelay) retry->delay=policy->maxdelay;
+  }
+ }
+ retry->attempt++;
+ return LIBSWD_TRUE;
+}
+
 /** @} */
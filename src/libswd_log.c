@@ -152,10 +152,11 @@ const char *libswd_operation_string(libswd_operation_t operation){
     DP SELECT register value as it determines CTRL/STAT or WCR access.
  * \param RnW is the read/write bit of the request packet.
  * \param addr is the address of the register.
- * \return char* array with the register name string.
+ * \return char* array with the register name string, kept in the context
+    and overwritten by the next call.
  */
 const char *libswd_request_string(libswd_ctx_t *libswdctx, char request){
- static char string[100], tmp[8]; string[0]=0;
+ char *string=libswdctx->requeststr, tmp[8]; string[0]=0;
  int apndp=request&LIBSWD_REQUEST_APnDP;
  int addr=0;
  addr|=((request&LIBSWD_REQUEST_A3)?1<<3:0);
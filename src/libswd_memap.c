@@ -209,7 +209,7 @@ int libswd_memap_read_char(libswd_ctx_t *libswdctx, libswd_operation_t operation
  if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
   return LIBSWD_ERROR_BADOPCODE;
 
- int i, loc, res=0, accsize=0, *memapcsw, *memaptar, *memapdrw;
+ int i, loc, res=0, accsize=0, *memapcsw, *memaptar;
  int chunk, chunks, chunksize=1024;
  float tdeltam;
  struct timeval tstart, tstop;
@@ -261,10 +261,10 @@ int libswd_memap_read_char(libswd_ctx_t *libswdctx, libswd_operation_t operation
    if (res<0) goto libswd_memap_read_char_error;
    libswdctx->log.memap.tar=loc;
    // Read data from DRW register.
-   res=libswd_ap_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, &memapdrw);
+   res=libswd_ap_read_buf(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, data, i, accsize);
    if (res<0) goto libswd_memap_read_char_error;
-   libswdctx->log.memap.drw=*memapdrw;
-   memcpy((void*)data+i, memapdrw, accsize);
+   libswdctx->log.memap.drw=0;
+   memcpy((void*)&libswdctx->log.memap.drw, data+i, accsize);
   }
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "\n");
  }
@@ -282,26 +282,33 @@ int libswd_memap_read_char(libswd_ctx_t *libswdctx, libswd_operation_t operation
    res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_TAR_ADDR, &loc);
    if (res<0) goto libswd_memap_read_char_error;
    libswdctx->log.memap.tar=loc;
-   for (i=0;i<chunksize;i+=accsize)
-   {
-    if ((chunk*chunksize)+i>=count) break;
-    // Measure transfer speed.
-    gettimeofday(&tstop, NULL);
-    tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
-    libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
-               "LIBSWD_I: libswd_memap_read_char() reading address 0x%08X (chunk 0x%X/0x%X, speed %fKB/s)\r",
-               loc+i, chunk, chunks, count/tdeltam);
-    fflush(0);
-    // Implode and Write data to DRW register.
-    res=libswd_ap_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, &memapdrw);
-    if (res<0) goto libswd_memap_read_char_error;
-    libswdctx->log.memap.drw=*memapdrw;
-    memcpy((void*)data+(chunk*chunksize)+i, memapdrw, accsize);
-   }
+   // Number of DRW reads in this chunk.
+   i=count-chunk*chunksize;
+   if (i>chunksize) i=chunksize;
+   i=(i+accsize-1)/accsize;
+   // Measure transfer speed.
+   gettimeofday(&tstop, NULL);
+   tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
+              "LIBSWD_I: libswd_memap_read_char() reading address 0x%08X (chunk 0x%X/0x%X, speed %fKB/s)\r",
+              loc, chunk, chunks, count/tdeltam);
+   fflush(0);
+   // Stream posted DRW reads, each one returns result of the previous.
+   res=libswd_ap_read_buf_posted(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, data, chunk*chunksize, accsize, i);
+   if (res<0) goto libswd_memap_read_char_error;
+   libswdctx->log.memap.drw=0;
+   memcpy((void*)&libswdctx->log.memap.drw, data+chunk*chunksize+(i-1)*accsize, accsize);
   }
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "\n");
  }
 
+ // Sticky error flags are checked once for the whole block.
+ if (libswdctx->config.stickydeferred)
+ {
+  res=libswd_dap_sticky_check(libswdctx, NULL);
+  if (res<0) goto libswd_memap_read_char_error;
+ }
+
  return LIBSWD_OK;
 
 libswd_memap_read_char_error:
@@ -417,7 +424,7 @@ int libswd_memap_read_int(libswd_ctx_t *libswdctx, libswd_operation_t operation,
  if (operation!=LIBSWD_OPERATION_ENQUEUE && operation!=LIBSWD_OPERATION_EXECUTE)
   return LIBSWD_ERROR_BADOPCODE;
 
- int i, loc, res, *memapcsw, *memaptar, *memapdrw;
+ int i, loc, res, *memapcsw, *memaptar;
  int chunk, chunks, chunksize=1024;
  float tdeltam;
  struct timeval tstart, tstop;
@@ -451,10 +458,9 @@ int libswd_memap_read_int(libswd_ctx_t *libswdctx, libswd_operation_t operation,
    if (res<0) goto libswd_memap_read_int_error;
    libswdctx->log.memap.tar=loc;
    // Read data from DRW register.
-   res=libswd_ap_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, &memapdrw);
+   res=libswd_ap_read_buf(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, (char*)data, i*4, 4);
    if (res<0) goto libswd_memap_read_int_error;
-   libswdctx->log.memap.drw=*memapdrw;
-   data[i]=*memapdrw;
+   libswdctx->log.memap.drw=data[i];
   }
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "\n");
  }
@@ -471,26 +477,31 @@ int libswd_memap_read_int(libswd_ctx_t *libswdctx, libswd_operation_t operation,
    res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_TAR_ADDR, &loc);
    if (res<0) goto libswd_memap_read_int_error;
    libswdctx->log.memap.tar=loc;
-   for (i=0;i<chunksize;i++)
-   {
-    if ((chunk*chunksize)+(i*4)>=count) break;
-    // Measure transfer speed.
-    gettimeofday(&tstop, NULL);
-    tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
-    libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
-               "LIBSWD_I: libswd_memap_read_int() reading address 0x%08X (chunk 0x%X/0x%X, speed %fKB/s)\r",
-               loc+(i*4), chunk, chunks, count*4/tdeltam );
-    fflush(0);
-    // Write data to DRW register.
-    res=libswd_ap_read(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, &memapdrw);
-    if (res<0) goto libswd_memap_read_int_error;
-    libswdctx->log.memap.drw=*memapdrw;
-    data[chunk*chunksize+i]=*memapdrw;
-   }
+   // Number of DRW reads in this chunk.
+   i=(count-chunk*chunksize+3)/4;
+   if (i>chunksize) i=chunksize;
+   // Measure transfer speed.
+   gettimeofday(&tstop, NULL);
+   tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
+              "LIBSWD_I: libswd_memap_read_int() reading address 0x%08X (chunk 0x%X/0x%X, speed %fKB/s)\r",
+              loc, chunk, chunks, count*4/tdeltam );
+   fflush(0);
+   // Stream posted DRW reads, each one returns result of the previous.
+   res=libswd_ap_read_buf_posted(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, (char*)data, chunk*chunksize*4, 4, i);
+   if (res<0) goto libswd_memap_read_int_error;
+   libswdctx->log.memap.drw=data[chunk*chunksize+i-1];
   }
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "\n");
  }
 
+ // Sticky error flags are checked once for the whole block.
+ if (libswdctx->config.stickydeferred)
+ {
+  res=libswd_dap_sticky_check(libswdctx, NULL);
+  if (res<0) goto libswd_memap_read_int_error;
+ }
+
  return LIBSWD_OK;
 
 libswd_memap_read_int_error:
@@ -605,7 +616,7 @@ int libswd_memap_write_char(libswd_ctx_t *libswdctx, libswd_operation_t operatio
   return LIBSWD_ERROR_BADOPCODE;
 
  int i, loc, res=0, accsize=0, *memapcsw, *memaptar, *memapdrw;
- int chunk, chunks, chunksize=1024;
+ int chunk, chunks, chunksize=1024, words, *drwbuf=NULL;
  float tdeltam;
  struct timeval tstart, tstop;
 
@@ -674,6 +685,12 @@ int libswd_memap_write_char(libswd_ctx_t *libswdctx, libswd_operation_t operatio
   // 2^10 chunks are used due to TAR Auto Increment limitations.
   // Check if packed transfer, if so use word access.
   if (libswdctx->log.memap.csw&LIBSWD_MEMAP_CSW_ADDRINC_PACKED) accsize=4;
+  drwbuf=(int*)malloc(chunksize*sizeof(int));
+  if (drwbuf==NULL)
+  {
+   res=LIBSWD_ERROR_OUTOFMEM;
+   goto libswd_memap_write_char_error;
+  }
   chunks=count/chunksize;
   for (chunk=0;chunk*chunksize<count;chunk++)
   {
@@ -682,17 +699,17 @@ int libswd_memap_write_char(libswd_ctx_t *libswdctx, libswd_operation_t operatio
    res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_TAR_ADDR, &loc);
    if (res<0) goto libswd_memap_write_char_error;
    libswdctx->log.memap.tar=loc;
-   for (i=0;i<chunksize;i+=accsize)
+   // Measure transfer speed.
+   gettimeofday(&tstop, NULL);
+   tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
+              "LIBSWD_I: libswd_memap_write_char() writing address 0x%08X (chunk 0x%X/0x%X, speed %fKB/s)\r",
+              loc, chunk, chunks, count/tdeltam );
+   fflush(0);
+   // Implode the chunk into DRW words.
+   for (i=0,words=0;i<chunksize;i+=accsize,words++)
    {
     if ((chunk*chunksize)+i>=count) break;
-    // Measure transfer speed.
-    gettimeofday(&tstop, NULL);
-    tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
-    libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
-               "LIBSWD_I: libswd_memap_write_char() writing address 0x%08X (chunk 0x%X/0x%X, speed %fKB/s)\r",
-               loc+i, chunk, chunks, count/tdeltam );
-    fflush(0);
-    // Implode and Write data to DRW register.
     memcpy((void*)&libswdctx->log.memap.drw, data+(chunk*chunksize)+i, accsize);
     if (accsize == 2 && ((loc+i) % 4) == 2)
     {
@@ -700,19 +717,31 @@ int libswd_memap_write_char(libswd_ctx_t *libswdctx, libswd_operation_t operatio
      libswdctx->log.memap.drw <<= 16;
     }
     // TODO probably need something similar for 8 bit accesses
-    res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, &libswdctx->log.memap.drw);
-    if (res<0) goto libswd_memap_write_char_error;
+    drwbuf[words]=libswdctx->log.memap.drw;
    }
+   // Stream the whole chunk into DRW, STICKYORUN is verified once at its end.
+   res=libswd_ap_write_stream(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, drwbuf, words);
+   if (res<0) goto libswd_memap_write_char_error;
   }
+  free(drwbuf);
+  drwbuf=NULL;
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "\n");
  }
 
+ // Sticky error flags are checked once for the whole block.
+ if (libswdctx->config.stickydeferred)
+ {
+  res=libswd_dap_sticky_check(libswdctx, NULL);
+  if (res<0) goto libswd_memap_write_char_error;
+ }
+
  return LIBSWD_OK;
 
 libswd_memap_write_char_error:
  libswd_log(libswdctx, LIBSWD_LOGLEVEL_ERROR,
             "LIBSWD_E: libswd_memap_write_char(): %s\n",
             libswd_error_string(res) );
+ if (drwbuf) free(drwbuf);
  return res;
 }
 
@@ -871,25 +900,30 @@ int libswd_memap_write_int(libswd_ctx_t *libswdctx, libswd_operation_t operation
    res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_TAR_ADDR, &loc);
    if (res<0) goto libswd_memap_write_int_error;
    libswdctx->log.memap.tar=loc;
-   for (i=0;i<chunksize;i++)
-   {
-    if ((chunk*chunksize)+(i*4)>=count) break;
-    // Measure transfer speed.
-    gettimeofday(&tstop, NULL);
-    tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
-    libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
-               "LIBSWD_I: libswd_memap_write_int() writing address 0x%08X (chunk 0x%X/0x%X speed %fKB/s)\r",
-               loc+(i*4), chunk, chunks, count*4/tdeltam );
-    fflush(0);
-    // Implode and Write data to DRW register.
-    libswdctx->log.memap.drw=data[chunk*chunksize+i];
-    res=libswd_ap_write(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, &libswdctx->log.memap.drw);
-    if (res<0) goto libswd_memap_write_int_error;
-   }
+   // Measure transfer speed.
+   gettimeofday(&tstop, NULL);
+   tdeltam=fabsf((tstop.tv_sec-tstart.tv_sec)*1000+(tstop.tv_usec-tstart.tv_usec)/1000);
+   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO,
+              "LIBSWD_I: libswd_memap_write_int() writing address 0x%08X (chunk 0x%X/0x%X speed %fKB/s)\r",
+              loc, chunk, chunks, count*4/tdeltam );
+   fflush(0);
+   // Stream the whole chunk into DRW, STICKYORUN is verified once at its end.
+   i=(count-chunk*chunksize+3)/4;
+   if (i>chunksize) i=chunksize;
+   res=libswd_ap_write_stream(libswdctx, LIBSWD_OPERATION_EXECUTE, LIBSWD_MEMAP_DRW_ADDR, data+chunk*chunksize, i);
+   if (res<0) goto libswd_memap_write_int_error;
+   libswdctx->log.memap.drw=data[chunk*chunksize+i-1];
   }
   libswd_log(libswdctx, LIBSWD_LOGLEVEL_INFO, "\n");
  }
 
+ // Sticky error flags are checked once for the whole block.
+ if (libswdctx->config.stickydeferred)
+ {
+  res=libswd_dap_sticky_check(libswdctx, NULL);
+  if (res<0) goto libswd_memap_write_int_error;
+ }
+
  return LIBSWD_OK;
 
 libswd_memap_write_int_error: